@@ -197,6 +197,9 @@ OTA_FIRMWARE_DIR = OTA_BASE_DIR / "firmware"
 OTA_PATCHES_DIR = OTA_BASE_DIR / "patches"
 OTA_CHUNK_SIZE = 512  # bytes per chunk
 
+# Device log uploads (firmware "upload_logs" command)
+DEVICE_LOGS_DIR = Path("/opt/datajam-nbiot/logs")
+
 # TimezoneFinder instance
 tf = TimezoneFinder()
 
@@ -275,6 +278,17 @@ def init_db():
         ip_address TEXT
     )""")
 
+    # Presence sessions closed on-device (firmware v5.5) - no MACs, just visit shape
+    conn.execute("""CREATE TABLE IF NOT EXISTS presence_sessions (
+        id INTEGER PRIMARY KEY AUTOINCREMENT,
+        device_id TEXT NOT NULL,
+        start_ts TEXT NOT NULL,
+        duration_min INTEGER NOT NULL,
+        best_zone INTEGER,
+        received_at TEXT NOT NULL
+    )""")
+    conn.execute("CREATE INDEX IF NOT EXISTS idx_sessions_device_start ON presence_sessions(device_id, start_ts)")
+
     # Device configs for remote configuration (v2.9 - added RSSI/dwell thresholds)
     conn.execute("""CREATE TABLE IF NOT EXISTS device_configs (
         device_id TEXT PRIMARY KEY,
@@ -386,6 +400,48 @@ def init_db():
         ("devices", "anomalous", "INTEGER DEFAULT 0"),
         ("devices", "anomaly_reason", "TEXT"),
         ("devices", "anomaly_detected_at", "TEXT"),
+        # Cellular data budget governor (firmware v5.5)
+        ("device_configs", "data_budget_mb", "INTEGER DEFAULT 0"),
+        ("heartbeats", "bytes_day", "INTEGER"),
+        ("heartbeats", "bytes_month", "INTEGER"),
+        ("heartbeats", "governor_level", "INTEGER"),
+        # Traffic-adaptive report interval (firmware v5.5)
+        ("device_configs", "report_interval_min_ms", "INTEGER DEFAULT 120000"),
+        ("device_configs", "report_interval_max_ms", "INTEGER DEFAULT 1800000"),
+        ("readings", "report_interval_s", "INTEGER"),
+        # On-device anomaly detection (firmware v5.5)
+        ("readings", "anomaly", "TEXT"),
+        # Live occupancy estimate (firmware v5.5)
+        ("readings", "occupancy", "INTEGER"),
+        # Cross-day returning visitors (firmware v5.5)
+        ("readings", "stable_ids", "INTEGER"),
+        ("readings", "returning_permille", "INTEGER"),
+        # MAC-rotation-corrected uniques from probe IE fingerprints (firmware v5.5)
+        ("readings", "unique_corrected", "INTEGER"),
+        ("readings", "rotations_linked", "INTEGER"),
+        # BLE dwell buckets and RSSI zones (firmware v5.5 counting engine)
+        ("readings", "ble_dwell_0_1", "INTEGER"),
+        ("readings", "ble_dwell_1_5", "INTEGER"),
+        ("readings", "ble_dwell_5_10", "INTEGER"),
+        ("readings", "ble_dwell_10plus", "INTEGER"),
+        ("readings", "ble_rssi_immediate", "INTEGER"),
+        ("readings", "ble_rssi_near", "INTEGER"),
+        ("readings", "ble_rssi_far", "INTEGER"),
+        ("readings", "ble_rssi_remote", "INTEGER"),
+        # Radio schedule: time-sliced vs concurrent WiFi+BLE (firmware v5.5)
+        ("device_configs", "radio_mode", "TEXT DEFAULT 'sliced'"),
+        ("readings", "radio_mode", "INTEGER"),
+        # Wall-clock-aligned reporting periods (firmware v5.5)
+        ("readings", "period_end_ts", "TEXT"),
+        ("readings", "period_partial", "INTEGER"),
+        # Sequence-numbered, idempotent readings (firmware v5.5)
+        ("readings", "seq", "INTEGER"),
+        ("readings", "seq_last", "INTEGER"),
+        ("readings", "seq_stream", "INTEGER"),
+        ("devices", "seq_stream", "INTEGER"),
+        ("devices", "seq_acked", "INTEGER DEFAULT 0"),
+        # Timestamp quality: 0 unsynced, 1 stale, 2 server time, 3 network time (firmware v5.5)
+        ("readings", "time_quality", "INTEGER"),
     ]
 
     for table, column, col_type in migrations:
@@ -408,6 +464,31 @@ def init_db():
         if "already exists" not in str(e):
             print(f"[MIGRATION] Index creation note: {e}")
 
+    # A session re-sent with a reading must not count as a second visit
+    # (duplicates stored before the index existed are dropped once)
+    if not conn.execute("SELECT 1 FROM sqlite_master WHERE type = 'index' AND name = 'idx_sessions_unique'").fetchone():
+        conn.execute("""
+            DELETE FROM presence_sessions WHERE id NOT IN (
+                SELECT MIN(id) FROM presence_sessions
+                GROUP BY device_id, start_ts, duration_min, best_zone)
+        """)
+        conn.execute("""
+            CREATE UNIQUE INDEX idx_sessions_unique
+            ON presence_sessions(device_id, start_ts, duration_min, best_zone)
+        """)
+        print("[MIGRATION] Created unique index idx_sessions_unique")
+
+    # A reading re-sent after a lost response carries the same sequence
+    try:
+        conn.execute("""
+            CREATE UNIQUE INDEX IF NOT EXISTS idx_readings_seq
+            ON readings(device_id, seq_stream, seq)
+            WHERE seq IS NOT NULL
+        """)
+    except sqlite3.OperationalError as e:
+        if "already exists" not in str(e):
+            print(f"[MIGRATION] Index creation note: {e}")
+
     conn.commit()
     conn.close()
 
@@ -493,17 +574,48 @@ def calculate_crc16(data: bytes) -> int:
             crc &= 0xFFFF
     return crc
 
+# ============== Reading Sequence Acks ==============
+
+def _advance_seq_ack(conn, device_id, seq_stream, seq_floor):
+    """
+    Highest sequence held contiguously for the device's current stream.
+    Everything below the device's floor is either stored or gone for good,
+    so the ack jumps to floor - 1 before walking stored readings upward
+    (a merged reading covers seq..seq_last). A new stream restarts at 0.
+    """
+    row = conn.execute(
+        "SELECT seq_stream, seq_acked FROM devices WHERE device_id = ?", (device_id,)
+    ).fetchone()
+    acked = (row["seq_acked"] or 0) if row and row["seq_stream"] == seq_stream else 0
+    if seq_floor is not None:
+        acked = max(acked, int(seq_floor) - 1)
+    while True:
+        nxt = conn.execute("""
+            SELECT MAX(COALESCE(seq_last, seq)) AS last FROM readings
+            WHERE device_id = ? AND seq_stream = ? AND seq = ?
+        """, (device_id, seq_stream, acked + 1)).fetchone()
+        if not nxt or nxt["last"] is None:
+            break
+        acked = max(acked + 1, nxt["last"])
+    conn.execute("UPDATE devices SET seq_stream = ?, seq_acked = ? WHERE device_id = ?",
+                 (seq_stream, acked, device_id))
+    return acked
+
 # ============== Rate Limit Error Handler ==============
 
 @app.errorhandler(429)
 def ratelimit_handler(e):
     """Handle rate limit exceeded errors."""
     print(f"[RATE_LIMIT] Exceeded: {e.description}", flush=True)
-    return jsonify({
+    retry_after = e.get_response().headers.get("Retry-After", 60)
+    response = jsonify({
         "error": "Rate limit exceeded",
         "message": e.description,
-        "retry_after": e.get_response().headers.get("Retry-After", 60)
-    }), 429
+        "retry_after": retry_after
+    })
+    # Firmware honors the header (plus its own per-device jitter) before retrying
+    response.headers["Retry-After"] = str(retry_after)
+    return response, 429
 
 # ============== Public Endpoints ==============
 
@@ -568,12 +680,35 @@ def receive_reading():
         ble_android = data.get('ble_android', 0) or 0
         ble_other = data.get('ble_other', 0) or 0
         ble_rssi_avg = data.get('ble_rssi_avg')
+        # BLE dwell [short, medium, long, loyal] and zones [immediate, near, far, remote]
+        ble_dwell = list(data.get('bdw') or [None] * 4)[:4]
+        ble_zones = list(data.get('bz') or [None] * 4)[:4]
+        ble_dwell += [None] * (4 - len(ble_dwell))
+        ble_zones += [None] * (4 - len(ble_zones))
 
         # Data quality/auditability fields (v5.3 firmware / v2.8 backend)
         overflow_count = data.get('of', 0) or 0    # Uniques dropped due to cap
         cache_depth = data.get('cd', 0) or 0       # Cache depth when sent
         send_failures = data.get('sf', 0) or 0     # Consecutive failures before this
-        age_seconds = data.get('age', 0) or 0      # 0 = live, >0 = cached reading
+        age_seconds = data.get('age', 0) or 0      # Seconds since the period closed (held or cached)
+        report_interval_s = data.get('ri')         # Adaptive interval the reading covers
+        device_anomaly = data.get('an')            # On-device detector reasons, e.g. "uniq_drop,stall"
+        occupancy = data.get('occupancy')          # Distinct devices, last 15 min, near zone or closer
+        radio_mode = data.get('rm')                # 0 = time-sliced, 1 = concurrent WiFi+BLE, 2 = merged across both
+        unique_corrected = data.get('uc')          # Uniques with MAC rotations merged (<= u)
+        rotations_linked = data.get('rl')          # MAC rotations merged (omitted in compact payloads)
+        stable_ids = data.get('rvn')               # Distinct stable identifiers today so far
+        returning_permille = data.get('rv')        # Of those, permille seen on an earlier day
+        period_start_s = data.get('ps')            # Period start, Unix s (aligned firmware, clock synced)
+        period_end_s = data.get('pe')              # Period end, Unix s
+        period_partial = data.get('pp')            # 1 = period starts or ends off the wall-clock grid
+        seq = data.get('sq')                       # Reading sequence number (first covered when merged)
+        seq_last = data.get('sql', seq)            # Last sequence covered by a merged reading
+        seq_stream = data.get('sqs')               # Sequence stream id (new after an NVS wipe)
+        seq_floor = data.get('sqf')                # Lowest sequence the device still holds
+        time_quality = data.get('tq')              # 0 unsynced, 1 stale, 2 server, 3 network time
+        sessions = data.get('ss') or []            # [[start Unix minute, minutes, best zone], ...]
+        sessions_dropped = data.get('sd', 0) or 0  # Lost to the device's ring overflow
 
         # Keep signal_dbm for backwards compatibility in database
         signal_dbm = cell_rssi
@@ -585,15 +720,35 @@ def receive_reading():
         received_at = now.isoformat()
 
         # Calculate period_start_ts: when this reading's period actually occurred
-        # For cached readings (age > 0), we subtract age from receive time
-        period_time = now - timedelta(seconds=age_seconds)
-        # Normalize to 5-minute boundary (bucket)
-        period_start = period_time.replace(
-            minute=(period_time.minute // 5) * 5,
-            second=0,
-            microsecond=0
-        )
-        period_start_ts = period_start.isoformat()
+        period_end_ts = None
+        if period_start_s is not None and period_end_s is not None:
+            # Aligned firmware stamps its period on wall-clock boundaries -
+            # rollups across devices are plain sums over period_start_ts
+            period_start_ts = datetime.fromtimestamp(int(period_start_s), timezone.utc).isoformat()
+            period_end_ts = datetime.fromtimestamp(int(period_end_s), timezone.utc).isoformat()
+        else:
+            # Readings held or cached (age > 0) closed age seconds before receipt
+            period_time = now - timedelta(seconds=age_seconds)
+            bucket_minutes = 5
+            if report_interval_s is not None:
+                # Adaptive-interval firmware reports as often as every 2 minutes,
+                # so its readings use 1-minute buckets. Those are keyed on the
+                # device's own close time (t, fixed when the period closed) -
+                # receive time moves on every re-send and would let a retry
+                # land in the next bucket past idx_readings_period.
+                bucket_minutes = 1
+                try:
+                    period_time = datetime.strptime(str(timestamp), "%Y-%m-%dT%H:%M:%SZ").replace(
+                        tzinfo=timezone.utc) - timedelta(seconds=int(report_interval_s))
+                except (TypeError, ValueError):
+                    pass  # Unparseable t - fall back to receive time
+            # Normalize to the bucket boundary
+            period_start = period_time.replace(
+                minute=(period_time.minute // bucket_minutes) * bucket_minutes,
+                second=0,
+                microsecond=0
+            )
+            period_start_ts = period_start.isoformat()
 
         conn = get_db()
 
@@ -608,19 +763,38 @@ def receive_reading():
                                   rssi_immediate, rssi_near, rssi_far, rssi_remote,
                                   ble_impressions, ble_unique, ble_apple, ble_android, ble_other, ble_rssi_avg,
                                   period_start_ts, overflow_count, cache_depth, send_failures, age_seconds,
+                                  report_interval_s, anomaly, occupancy, stable_ids, returning_permille,
+                                  unique_corrected, rotations_linked,
+                                  ble_dwell_0_1, ble_dwell_1_5, ble_dwell_5_10, ble_dwell_10plus,
+                                  ble_rssi_immediate, ble_rssi_near, ble_rssi_far, ble_rssi_remote,
+                                  radio_mode, period_end_ts, period_partial, seq, seq_last, seq_stream, time_quality,
                                   received_at)
-            VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+            VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?,
+                    ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
         """, (device_id, timestamp, impressions, unique_count, signal_dbm,
               battery_pct, firmware, apple_count, android_count, other_count,
               probe_rssi_avg, probe_rssi_min, probe_rssi_max, cell_rssi,
               dwell_0_1, dwell_1_5, dwell_5_10, dwell_10plus,
               rssi_immediate, rssi_near, rssi_far, rssi_remote,
               ble_impressions, ble_unique, ble_apple, ble_android, ble_other, ble_rssi_avg,
-              period_start_ts, overflow_count, cache_depth, send_failures, age_seconds, received_at))
+              period_start_ts, overflow_count, cache_depth, send_failures, age_seconds,
+              report_interval_s, device_anomaly, occupancy, stable_ids, returning_permille,
+              unique_corrected, rotations_linked, *ble_dwell, *ble_zones, radio_mode,
+              period_end_ts, period_partial, seq, seq_last, seq_stream, time_quality, received_at))
 
         # Check if insert actually happened (or was ignored as duplicate)
         was_duplicate = cursor.rowcount == 0
 
+        # Closed presence sessions ride with live readings
+        if sessions and not was_duplicate:
+            conn.executemany("""
+                INSERT OR IGNORE INTO presence_sessions (device_id, start_ts, duration_min, best_zone, received_at)
+                VALUES (?, ?, ?, ?, ?)
+            """, [(device_id,
+                   datetime.fromtimestamp(int(sess[0]) * 60, timezone.utc).isoformat(),
+                   int(sess[1]), int(sess[2]), received_at)
+                  for sess in sessions if isinstance(sess, list) and len(sess) == 3])
+
         # Update device last_seen
         conn.execute("""
             UPDATE devices SET last_seen_at = ?, last_signal_dbm = ?, last_battery_pct = ?,
@@ -628,6 +802,10 @@ def receive_reading():
             WHERE device_id = ?
         """, (received_at, signal_dbm, battery_pct, firmware, device_id))
 
+        seq_acked = None
+        if seq is not None and seq_stream is not None:
+            seq_acked = _advance_seq_ack(conn, device_id, int(seq_stream), seq_floor)
+
         conn.commit()
 
         # Log for debugging
@@ -647,7 +825,17 @@ def receive_reading():
         if any([overflow_count, cache_depth, send_failures, age_seconds]):
             quality_info = f" quality(of:{overflow_count} cd:{cache_depth} sf:{send_failures} age:{age_seconds}s)"
         dup_info = " [DUPLICATE]" if was_duplicate else ""
-        print(f"[READING] {device_id}: {impressions} probes, {unique_count} unique "
+        if stable_ids:
+            returning = f" {returning_permille / 10:.1f}% returning" if returning_permille is not None else ""
+            dup_info = f" stable_ids:{stable_ids}{returning}" + dup_info
+        if sessions or sessions_dropped:
+            dup_info = f" sessions:{len(sessions)}" + (f" (dropped:{sessions_dropped})" if sessions_dropped else "") + dup_info
+
+        # Device-side detector fired - flag it like a server-side anomaly (non-blocking)
+        if device_anomaly and not was_duplicate:
+            _flag_anomaly(device_id, f"Device: {device_anomaly} (age {age_seconds}s)")
+        corrected_info = f" ({unique_corrected} rotation-corrected)" if unique_corrected is not None else ""
+        print(f"[READING] {device_id}: {impressions} probes, {unique_count} unique{corrected_info} "
               f"(Apple:{apple_count} Android:{android_count} Other:{other_count}) "
               f"cell_rssi:{cell_rssi}{rssi_info}{dwell_info}{zone_info}{ble_info}{quality_info}{dup_info} @ {period_start_ts}")
 
@@ -655,6 +843,8 @@ def receive_reading():
         response = {"status": "ok"}
         if was_duplicate:
             response["note"] = "duplicate_ignored"
+        if seq_acked is not None:
+            response["ack"] = seq_acked
 
         device_row = conn.execute("SELECT pending_command FROM devices WHERE device_id = ?", (device_id,)).fetchone()
         if device_row and device_row['pending_command']:
@@ -687,6 +877,10 @@ def heartbeat():
         battery_pct = data.get('bat') or data.get('battery_pct')
         firmware = data.get('v') or data.get('fw') or data.get('firmware_version')
         uptime_seconds = data.get('uptime') or data.get('uptime_seconds')
+        # Cellular data usage (bytes today / this month, governor level 0-2)
+        bytes_day = data.get('ub_day')
+        bytes_month = data.get('ub_month')
+        governor_level = data.get('gov')
 
         now = datetime.now(timezone.utc).isoformat()
         ip_address = request.remote_addr
@@ -694,9 +888,11 @@ def heartbeat():
 
         # Log heartbeat with uptime
         conn.execute("""
-            INSERT INTO heartbeats (device_id, timestamp, signal_dbm, battery_pct, firmware_version, uptime_seconds, ip_address)
-            VALUES (?, ?, ?, ?, ?, ?, ?)
-        """, (device_id, now, signal_dbm, battery_pct, firmware, uptime_seconds, ip_address))
+            INSERT INTO heartbeats (device_id, timestamp, signal_dbm, battery_pct, firmware_version, uptime_seconds, ip_address,
+                                    bytes_day, bytes_month, governor_level)
+            VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+        """, (device_id, now, signal_dbm, battery_pct, firmware, uptime_seconds, ip_address,
+              bytes_day, bytes_month, governor_level))
 
         # Update device last_seen and firmware_version
         conn.execute("""
@@ -709,7 +905,8 @@ def heartbeat():
 
         # Log for debugging
         uptime_str = f"{uptime_seconds}s" if uptime_seconds is not None else "N/A"
-        print(f"[HEARTBEAT] {device_id} v{firmware} uptime:{uptime_str} cell:{signal_dbm}dBm", flush=True)
+        usage_str = f" data:{bytes_day}/{bytes_month}B gov:{governor_level}" if bytes_month is not None else ""
+        print(f"[HEARTBEAT] {device_id} v{firmware} uptime:{uptime_str} cell:{signal_dbm}dBm{usage_str}", flush=True)
 
         # Check for pending command
         response = {"status": "ok", "server_time": now}
@@ -762,6 +959,9 @@ def get_device_config(device_id):
             response = {
                 "config_version": config.get('config_version', 1) if hasattr(config, 'get') else (config['config_version'] if 'config_version' in config.keys() else 1),
                 "report_interval_ms": config['report_interval_ms'],
+                # Adaptive interval bounds
+                "report_interval_min_ms": (config['report_interval_min_ms'] or 120000) if 'report_interval_min_ms' in config.keys() else 120000,
+                "report_interval_max_ms": (config['report_interval_max_ms'] or 1800000) if 'report_interval_max_ms' in config.keys() else 1800000,
                 "heartbeat_interval_ms": config['heartbeat_interval_ms'],
                 "geolocation_on_boot": bool(config['geolocation_on_boot']),
                 "wifi_channels": [int(c) for c in config['wifi_channels'].split(',')],
@@ -773,6 +973,10 @@ def get_device_config(device_id):
                 "dwell_short_threshold": config['dwell_short_threshold'] if 'dwell_short_threshold' in config.keys() else 1,
                 "dwell_medium_threshold": config['dwell_medium_threshold'] if 'dwell_medium_threshold' in config.keys() else 5,
                 "dwell_long_threshold": config['dwell_long_threshold'] if 'dwell_long_threshold' in config.keys() else 10,
+                # Monthly cellular data budget, 0 = unlimited
+                "data_budget_mb": (config['data_budget_mb'] or 0) if 'data_budget_mb' in config.keys() else 0,
+                # Radio schedule: "sliced" (WiFi/BLE alternate) or "coex" (concurrent)
+                "radio_mode": (config['radio_mode'] or 'sliced') if 'radio_mode' in config.keys() else 'sliced',
                 "updated_at": config['updated_at']
             }
         else:
@@ -780,6 +984,8 @@ def get_device_config(device_id):
             response = {
                 "config_version": 1,
                 "report_interval_ms": 300000,      # 5 minutes
+                "report_interval_min_ms": 120000,  # Adaptive bounds: 2 minutes
+                "report_interval_max_ms": 1800000, # ... to 30 minutes
                 "heartbeat_interval_ms": 86400000, # 24 hours
                 "geolocation_on_boot": True,
                 "wifi_channels": [1, 6, 11],
@@ -791,6 +997,10 @@ def get_device_config(device_id):
                 "dwell_short_threshold": 1,
                 "dwell_medium_threshold": 5,
                 "dwell_long_threshold": 10,
+                # Monthly cellular data budget, 0 = unlimited
+                "data_budget_mb": 0,
+                # Radio schedule: "sliced" (WiFi/BLE alternate) or "coex" (concurrent)
+                "radio_mode": "sliced",
                 "updated_at": None
             }
 
@@ -842,6 +1052,23 @@ def update_device_config(device_id):
         if not (60000 <= report_interval <= 3600000):
             return jsonify({"error": "report_interval_ms must be between 60000 (1 min) and 3600000 (60 min)"}), 400
 
+        # Validate adaptive interval bounds (min <= report_interval <= max)
+        interval_min = data.get('report_interval_min_ms', min(120000, report_interval))
+        interval_max = data.get('report_interval_max_ms', max(1800000, report_interval))
+        if not (60000 <= interval_min <= report_interval <= interval_max <= 14400000):
+            return jsonify({"error": "Interval bounds must satisfy 60000 <= report_interval_min_ms <= "
+                                     "report_interval_ms <= report_interval_max_ms <= 14400000"}), 400
+
+        # Validate monthly data budget (0 = unlimited, else 1 MB - 10 GB)
+        data_budget_mb = data.get('data_budget_mb', 0)
+        if not (isinstance(data_budget_mb, int) and 0 <= data_budget_mb <= 10240):
+            return jsonify({"error": "data_budget_mb must be between 0 (unlimited) and 10240"}), 400
+
+        # Validate radio schedule
+        radio_mode = data.get('radio_mode', 'sliced')
+        if radio_mode not in ('sliced', 'coex'):
+            return jsonify({"error": "radio_mode must be 'sliced' or 'coex'"}), 400
+
         # Get current config_version and increment
         existing = conn.execute(
             "SELECT config_version FROM device_configs WHERE device_id = ?",
@@ -854,14 +1081,17 @@ def update_device_config(device_id):
 
         conn.execute("""
             INSERT OR REPLACE INTO device_configs
-            (device_id, report_interval_ms, heartbeat_interval_ms, geolocation_on_boot, wifi_channels,
+            (device_id, report_interval_ms, report_interval_min_ms, report_interval_max_ms,
+             heartbeat_interval_ms, geolocation_on_boot, wifi_channels,
              rssi_immediate_threshold, rssi_near_threshold, rssi_far_threshold,
              dwell_short_threshold, dwell_medium_threshold, dwell_long_threshold,
-             config_version, updated_at)
-            VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+             data_budget_mb, radio_mode, config_version, updated_at)
+            VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
         """, (
             device_id,
             report_interval,
+            interval_min,
+            interval_max,
             data.get('heartbeat_interval_ms', 86400000),
             1 if data.get('geolocation_on_boot', True) else 0,
             wifi_channels,
@@ -871,6 +1101,8 @@ def update_device_config(device_id):
             dwell_short,
             dwell_medium,
             dwell_long,
+            data_budget_mb,
+            radio_mode,
             new_version,
             now
         ))
@@ -985,6 +1217,73 @@ def receive_geolocation():
         print(f"[ERROR] receive_geolocation: {e}", flush=True)
         return jsonify({"error": str(e)}), 500
 
+# ============== Device Log Upload ==============
+
+def lzss_decompress(data: bytes) -> bytes:
+    """
+    Decode the firmware's LZSS log format.
+    A flag byte precedes each group of up to 8 items (LSB first); flag bit 0 is a
+    literal byte, 1 is a 2-byte match: offset-1 in 12 bits, length-3 in 4 bits.
+    """
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        flags = data[i]
+        i += 1
+        for bit in range(8):
+            if i >= len(data):
+                break
+            if flags & (1 << bit):
+                if i + 1 >= len(data):
+                    raise ValueError("Truncated match")
+                b0, b1 = data[i], data[i + 1]
+                i += 2
+                offset = (b0 | ((b1 >> 4) << 8)) + 1
+                length = (b1 & 0x0F) + 3
+                if offset > len(out):
+                    raise ValueError("Match offset before start of output")
+                for _ in range(length):
+                    out.append(out[-offset])
+            else:
+                out.append(data[i])
+                i += 1
+    return bytes(out)
+
+
+@app.route("/api/logs", methods=["POST"])
+@limiter.limit("10 per hour")  # On-demand only (upload_logs command)
+@require_device_auth
+def receive_logs():
+    """
+    Receive a compressed log excerpt from a device.
+    Query params: ?d=JBNB0001&raw=4096&total=123456
+    Body: LZSS-compressed log text (application/octet-stream)
+    """
+    try:
+        device_id = g.device_id
+        raw_len = request.args.get('raw', type=int)
+        total_len = request.args.get('total', type=int)
+
+        text = lzss_decompress(request.get_data())
+        if raw_len is not None and len(text) != raw_len:
+            return jsonify({"error": f"Decoded {len(text)} bytes, expected {raw_len}"}), 400
+
+        DEVICE_LOGS_DIR.mkdir(parents=True, exist_ok=True)
+        stamp = datetime.now(timezone.utc).strftime("%Y%m%dT%H%M%SZ")
+        log_path = DEVICE_LOGS_DIR / f"{device_id}_{stamp}.log"
+        log_path.write_bytes(text)
+
+        print(f"[LOGS] {device_id}: {len(request.get_data())} bytes -> {len(text)} bytes "
+              f"(device total {total_len}) saved to {log_path}", flush=True)
+
+        return jsonify({"status": "ok", "bytes": len(text)}), 201
+
+    except ValueError as e:
+        return jsonify({"error": f"Bad log body: {e}"}), 400
+    except Exception as e:
+        print(f"[ERROR] receive_logs: {e}", flush=True)
+        return jsonify({"error": str(e)}), 500
+
 # ============== OTA Update Endpoints ==============
 
 @app.route("/api/ota/check", methods=["POST"])
@@ -1475,8 +1774,10 @@ def queue_command(device_id):
         data = request.get_json()
         command = data.get('command')
 
-        valid_commands = ['reboot', 'send_now', 'geolocate', 'ota_check']
-        if command not in valid_commands:
+        valid_commands = ['reboot', 'send_now', 'geolocate', 'ota_check', 'fetch_config', 'upload_logs']
+        # upload_logs accepts an optional size suffix: upload_logs:<KB>
+        base_command = command.split(':', 1)[0] if isinstance(command, str) else command
+        if base_command not in valid_commands:
             return jsonify({"error": f"Invalid command. Use: {', '.join(valid_commands)}"}), 400
 
         conn = get_db()
@@ -0,0 +1,57 @@
+// =============================================================================
+// HalfSipHash-2-4
+// =============================================================================
+// Keyed 32-bit hash behind the device fingerprints (see Device Fingerprints
+// in main.cpp). Header-only and free of Arduino dependencies so the native
+// test environment checks it against the reference vectors.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef IRAM_ATTR
+#define IRAM_ATTR
+#endif
+
+#define HSIP_ROTL(x, b) (uint32_t)(((x) << (b)) | ((x) >> (32 - (b))))
+#define HSIP_ROUND \
+    do { \
+        v0 += v1; v1 = HSIP_ROTL(v1, 5); v1 ^= v0; v0 = HSIP_ROTL(v0, 16); \
+        v2 += v3; v3 = HSIP_ROTL(v3, 8); v3 ^= v2; \
+        v0 += v3; v3 = HSIP_ROTL(v3, 7); v3 ^= v0; \
+        v2 += v1; v1 = HSIP_ROTL(v1, 13); v1 ^= v2; v2 = HSIP_ROTL(v2, 16); \
+    } while (0)
+
+// HalfSipHash-2-4 with a 32-bit output (reference algorithm, little-endian words)
+static inline uint32_t IRAM_ATTR halfSipHash24(const uint32_t* key, const uint8_t* in, size_t len) {
+    uint32_t v0 = key[0];
+    uint32_t v1 = key[1];
+    uint32_t v2 = 0x6c796765 ^ key[0];
+    uint32_t v3 = 0x74656462 ^ key[1];
+    uint32_t b = (uint32_t)len << 24;
+
+    size_t blocks = len & ~(size_t)3;
+    for (size_t i = 0; i < blocks; i += 4) {
+        uint32_t m = (uint32_t)in[i] | ((uint32_t)in[i + 1] << 8) |
+                     ((uint32_t)in[i + 2] << 16) | ((uint32_t)in[i + 3] << 24);
+        v3 ^= m;
+        HSIP_ROUND;
+        HSIP_ROUND;
+        v0 ^= m;
+    }
+    for (size_t i = blocks; i < len; i++) {
+        b |= (uint32_t)in[i] << (8 * (i - blocks));
+    }
+
+    v3 ^= b;
+    HSIP_ROUND;
+    HSIP_ROUND;
+    v0 ^= b;
+    v2 ^= 0xff;
+    HSIP_ROUND;
+    HSIP_ROUND;
+    HSIP_ROUND;
+    HSIP_ROUND;
+    return v1 ^ v3;
+}
@@ -0,0 +1,107 @@
+// =============================================================================
+// Delta OTA - resumable download bookkeeping
+// =============================================================================
+// One bit per patch chunk, persisted to NVS with the OTA state at each
+// checkpoint. After a power loss the bitmap from the last checkpoint says
+// which chunks are on SPIFFS; anything fetched since is fetched again.
+// Header-only and free of Arduino dependencies so the native test
+// environment can replay downloads interrupted between checkpoints.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Largest patch we can track: 4096 x 512 B = 2 MB (bitmap is 512 bytes)
+#define OTA_MAX_CHUNKS 4096
+
+// Download progress checkpointing - NVS is committed every N chunks or
+// T ms, whichever comes first, instead of after every chunk. Chunks past
+// the last checkpoint are re-fetched after a power loss.
+#ifndef OTA_CHECKPOINT_CHUNKS
+#define OTA_CHECKPOINT_CHUNKS 32
+#endif
+#ifndef OTA_CHECKPOINT_MS
+#define OTA_CHECKPOINT_MS 120000
+#endif
+
+// Bytes of bitmap persisted for a patch of total chunks
+static inline size_t otaBitmapBytes(uint16_t total) {
+    return ((size_t)total + 7) / 8;
+}
+
+static inline bool otaBitmapHave(const uint8_t* bitmap, uint16_t chunk) {
+    return (bitmap[chunk >> 3] >> (chunk & 7)) & 1;
+}
+
+static inline void otaBitmapMark(uint8_t* bitmap, uint16_t chunk) {
+    bitmap[chunk >> 3] |= (uint8_t)(1 << (chunk & 7));
+}
+
+// First chunk not yet downloaded, or total when complete
+static inline uint16_t otaBitmapNextMissing(const uint8_t* bitmap, uint16_t total) {
+    for (uint16_t i = 0; i < total; i++) {
+        if (!otaBitmapHave(bitmap, i)) return i;
+    }
+    return total;
+}
+
+// Chunks held - the bitmap is authoritative for what is on SPIFFS
+static inline uint16_t otaBitmapCount(const uint8_t* bitmap, uint16_t total) {
+    uint16_t have = 0;
+    for (uint16_t i = 0; i < total && i < OTA_MAX_CHUNKS; i++) {
+        if (otaBitmapHave(bitmap, i)) have++;
+    }
+    return have;
+}
+
+// Commit progress now? chunksSince includes the chunk just marked
+static inline bool otaCheckpointDue(uint16_t chunksSince, uint32_t msSince) {
+    return chunksSince >= OTA_CHECKPOINT_CHUNKS || msSince >= OTA_CHECKPOINT_MS;
+}
+
+// Download progress as the firmware keeps it: the bitmap in RAM plus what
+// has accumulated since it was last persisted
+struct OtaChunkProgress {
+    uint8_t bitmap[OTA_MAX_CHUNKS / 8];   // One bit per chunk held on SPIFFS
+    uint16_t sinceCheckpoint;             // Chunks marked since the bitmap was persisted
+    uint32_t lastCheckpointMs;            // When it was last persisted
+};
+
+// Fresh download - nothing held
+static inline void otaProgressClear(OtaChunkProgress* p, uint32_t nowMs) {
+    memset(p->bitmap, 0, sizeof(p->bitmap));
+    p->sinceCheckpoint = 0;
+    p->lastCheckpointMs = nowMs;
+}
+
+// Chunk to fetch next, or total when the patch is complete
+static inline uint16_t otaProgressNext(const OtaChunkProgress* p, uint16_t total) {
+    return otaBitmapNextMissing(p->bitmap, total);
+}
+
+// Record a downloaded chunk; true when the bitmap should be persisted now
+static inline bool otaProgressMark(OtaChunkProgress* p, uint16_t chunk, uint32_t nowMs) {
+    otaBitmapMark(p->bitmap, chunk);
+    p->sinceCheckpoint++;
+    return otaCheckpointDue(p->sinceCheckpoint, nowMs - p->lastCheckpointMs);
+}
+
+// The bitmap was just persisted
+static inline void otaProgressCheckpointed(OtaChunkProgress* p, uint32_t nowMs) {
+    p->sinceCheckpoint = 0;
+    p->lastCheckpointMs = nowMs;
+}
+
+// After a reboot, with the bitmap reloaded from the last checkpoint: drop
+// stray bits past the patch and return the chunks held. Everything else,
+// including chunks fetched after that checkpoint, is fetched again.
+static inline uint16_t otaProgressResume(OtaChunkProgress* p, uint16_t total, uint32_t nowMs) {
+    if (total > OTA_MAX_CHUNKS) total = OTA_MAX_CHUNKS;
+    size_t used = otaBitmapBytes(total);
+    memset(p->bitmap + used, 0, sizeof(p->bitmap) - used);
+    if (total & 7) p->bitmap[total >> 3] &= (uint8_t)((1 << (total & 7)) - 1);
+    otaProgressCheckpointed(p, nowMs);
+    return otaBitmapCount(p->bitmap, total);
+}
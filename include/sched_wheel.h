@@ -0,0 +1,180 @@
+// =============================================================================
+// Event Scheduler - hierarchical timer wheel
+// =============================================================================
+// The timer wheel behind the loop task's scheduler (see Event Scheduler in
+// main.cpp). Header-only and free of Arduino dependencies so the native test
+// environment can drive it from a fake tick, including across the wrap.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCHED_TICK_MS            10
+#define SCHED_WHEEL_BITS         6
+#define SCHED_WHEEL_SLOTS        (1 << SCHED_WHEEL_BITS)
+#define SCHED_WHEEL_LEVELS       3
+#define SCHED_WHEEL_SPAN         (1UL << (SCHED_WHEEL_BITS * SCHED_WHEEL_LEVELS))  // Ticks
+#define SCHED_MAX_TIMERS         16
+#define SCHED_MAX_SLEEP_MS       1000   // Wake at least this often (watchdog feed)
+#define SCHED_LATE_TOLERANCE_MS  50
+
+struct SchedTimer {
+    const char* name;
+    void (*fn)();
+    uint32_t periodMs;      // 0 = one-shot
+    uint32_t expires;       // Wheel tick of the deadline
+    SchedTimer* next;
+    SchedTimer* prev;
+    SchedTimer** slot;      // Wheel slot holding the timer (list head)
+    bool active;
+    uint32_t fired;
+    uint32_t missed;        // Dispatched late, or periods skipped
+    uint32_t maxLateMs;
+};
+
+static SchedTimer* g_schedWheel[SCHED_WHEEL_LEVELS][SCHED_WHEEL_SLOTS];
+static SchedTimer* g_schedTimers[SCHED_MAX_TIMERS];  // Registry for stats / next deadline
+static uint8_t g_schedTimerCount = 0;
+static uint32_t g_schedNow = 0;                      // Next tick to process
+static SchedTimer* g_schedPending = nullptr;         // Slot being expired
+
+// Current wheel tick - defined by the includer (esp_timer on the device, a
+// fake clock in the host tests). Must wrap at 2^32 like the wheel indices.
+static inline uint32_t schedTickNow();
+
+static void schedUnlink(SchedTimer* t) {
+    if (t->prev) {
+        t->prev->next = t->next;
+    } else if (t->slot) {
+        *t->slot = t->next;
+    }
+    if (t->next) t->next->prev = t->prev;
+    t->next = t->prev = nullptr;
+    t->slot = nullptr;
+}
+
+// File a timer into the level whose span covers its deadline
+static void schedFile(SchedTimer* t) {
+    uint32_t delta = t->expires - g_schedNow;
+    uint32_t at = t->expires;
+    if ((int32_t)delta < 0) {
+        delta = 0;
+        at = g_schedNow;          // Already due - next processed tick
+    } else if (delta >= SCHED_WHEEL_SPAN) {
+        delta = SCHED_WHEEL_SPAN - 1;
+        at = g_schedNow + delta;  // Park; re-filed when the top level turns
+    }
+    int level = 0;
+    while (level < SCHED_WHEEL_LEVELS - 1 &&
+           delta >= (1UL << (SCHED_WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    SchedTimer** slot = &g_schedWheel[level][(at >> (SCHED_WHEEL_BITS * level)) & (SCHED_WHEEL_SLOTS - 1)];
+    t->prev = nullptr;
+    t->next = *slot;
+    t->slot = slot;
+    if (*slot) (*slot)->prev = t;
+    *slot = t;
+}
+
+static void schedTimerInit(SchedTimer* t, const char* name, void (*fn)()) {
+    t->name = name;
+    t->fn = fn;
+    if (g_schedTimerCount < SCHED_MAX_TIMERS) g_schedTimers[g_schedTimerCount++] = t;
+}
+
+// (Re)arm: first deadline delayMs from now, then every periodMs (0 = once)
+static void timerStart(SchedTimer* t, uint32_t delayMs, uint32_t periodMs) {
+    if (t->active) schedUnlink(t);
+    t->periodMs = periodMs;
+    t->expires = schedTickNow() + (delayMs + SCHED_TICK_MS - 1) / SCHED_TICK_MS;
+    t->active = true;
+    schedFile(t);
+}
+
+static void timerStop(SchedTimer* t) {
+    if (!t->active) return;
+    schedUnlink(t);
+    t->active = false;
+}
+
+// Move a higher level's slot down as the wheel turns into it
+static void schedCascade(int level, uint32_t index) {
+    SchedTimer* t = g_schedWheel[level][index];
+    g_schedWheel[level][index] = nullptr;
+    while (t) {
+        SchedTimer* next = t->next;
+        t->next = t->prev = nullptr;
+        schedFile(t);
+        t = next;
+    }
+}
+
+static void schedExpire(SchedTimer* t) {
+    // Lateness in ticks - tick arithmetic stays valid across the counter wrap
+    uint32_t nowTick = schedTickNow();
+    int32_t lateTicks = (int32_t)(nowTick - t->expires);
+    uint32_t lateMs = lateTicks > 0 ? (uint32_t)lateTicks * SCHED_TICK_MS : 0;
+    t->fired++;
+    if (lateMs > t->maxLateMs) t->maxLateMs = lateMs;
+    if (lateMs > SCHED_LATE_TOLERANCE_MS) t->missed++;
+
+    t->active = false;
+    if (t->periodMs > 0) {
+        // Drift-free re-arm from the deadline; skip periods already gone
+        uint32_t periodTicks = (t->periodMs + SCHED_TICK_MS - 1) / SCHED_TICK_MS;
+        t->expires += periodTicks;
+        while ((int32_t)(t->expires - nowTick) <= 0) {
+            t->expires += periodTicks;
+            t->missed++;
+        }
+        t->active = true;
+        schedFile(t);
+    }
+    t->fn();
+}
+
+// Process every tick up to now, firing what is due
+static void schedRunTimers() {
+    uint32_t target = schedTickNow();
+    while ((int32_t)(target - g_schedNow) >= 0) {
+        uint32_t now = g_schedNow;
+        uint32_t index = now & (SCHED_WHEEL_SLOTS - 1);
+        if (index == 0) {
+            uint32_t index1 = (now >> SCHED_WHEEL_BITS) & (SCHED_WHEEL_SLOTS - 1);
+            if (index1 == 0) schedCascade(2, (now >> (2 * SCHED_WHEEL_BITS)) & (SCHED_WHEEL_SLOTS - 1));
+            schedCascade(1, index1);
+        }
+        // The slot becomes the pending list, so a callback that stops or
+        // re-arms a timer still waiting in it unlinks cleanly
+        g_schedPending = g_schedWheel[0][index];
+        g_schedWheel[0][index] = nullptr;
+        for (SchedTimer* p = g_schedPending; p; p = p->next) p->slot = &g_schedPending;
+        g_schedNow = now + 1;  // Timers armed from callbacks file relative to the next tick
+        while (g_schedPending) {
+            SchedTimer* t = g_schedPending;
+            schedUnlink(t);
+            if ((int32_t)(t->expires - now) > 0) {
+                schedFile(t);  // Parked long deadline - not yet due
+            } else {
+                schedExpire(t);
+            }
+        }
+        target = schedTickNow();
+    }
+}
+
+// Milliseconds the loop may sleep before the earliest deadline
+static uint32_t schedIdleMs() {
+    uint32_t nowTick = schedTickNow();
+    uint32_t best = SCHED_MAX_SLEEP_MS / SCHED_TICK_MS;
+    for (uint8_t i = 0; i < g_schedTimerCount; i++) {
+        const SchedTimer* t = g_schedTimers[i];
+        if (!t->active) continue;
+        int32_t ticks = (int32_t)(t->expires - nowTick);
+        if (ticks <= 0) return 0;
+        if ((uint32_t)ticks < best) best = ticks;
+    }
+    return best * SCHED_TICK_MS;
+}
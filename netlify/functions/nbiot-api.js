@@ -431,10 +431,11 @@ exports.handler = async (event) => {
 
       const readings = await supabaseQuery('GET', queryStr);
 
-      // Aggregate by hour
+      // Aggregate by hour - by the period a reading covers, so aligned
+      // readings ending on the hour land in the hour they counted
       const hourlyMap = {};
       (readings || []).forEach(r => {
-        const date = new Date(r.timestamp);
+        const date = new Date(r.period_start_ts || r.timestamp);
         const hourKey = `${date.getFullYear()}-${String(date.getMonth()+1).padStart(2,'0')}-${String(date.getDate()).padStart(2,'0')} ${String(date.getHours()).padStart(2,'0')}:00`;
 
         if (!hourlyMap[hourKey]) {
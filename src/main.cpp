@@ -45,6 +45,10 @@
 #include <Preferences.h>   // NVS for OTA state persistence
 #include <SPIFFS.h>        // File system for patch storage
 #include <mbedtls/sha256.h> // SHA-256 for patch verification
+#include <atomic>          // Lock-free log queue
+#include "halfsiphash.h"    // Device fingerprints (host-tested, see test/)
+#include "sched_wheel.h"    // Loop task timer wheel (host-tested, see test/)
+#include "ota_chunks.h"     // Delta OTA chunk bitmap (host-tested, see test/)
 
 // ESP-IDF OTA rollback protection
 extern "C" {
@@ -92,7 +96,27 @@ static const uint32_t NETWORK_INIT_TIMEOUT_MS = 120000;
 // Pin definitions for AtomS3 DTU-NB-IoT
 #define MODEM_TX_PIN    5       // ESP32 TX -> Modem RX
 #define MODEM_RX_PIN    6       // ESP32 RX <- Modem TX
-#define MODEM_BAUD      115200
+#define MODEM_BAUD      115200  // Power-on default rate of the SIM7028
+
+// Hardware flow control - the DTU-NB-IoT base only wires TX/RX, so RTS/CTS
+// stay off unless a board variant defines both pins
+#ifndef MODEM_RTS_PIN
+#define MODEM_RTS_PIN   -1      // ESP32 RTS -> Modem CTS
+#endif
+#ifndef MODEM_CTS_PIN
+#define MODEM_CTS_PIN   -1      // ESP32 CTS <- Modem RTS
+#endif
+
+// Negotiated rate via AT+IPR after the modem answers (0 = stay at MODEM_BAUD).
+// Without RTS/CTS a fast rate overruns the RX FIFO while the loop is busy,
+// so only boards that wire flow control default to it.
+#ifndef MODEM_BAUD_FAST
+#if MODEM_RTS_PIN >= 0 && MODEM_CTS_PIN >= 0
+#define MODEM_BAUD_FAST 921600
+#else
+#define MODEM_BAUD_FAST 0
+#endif
+#endif
 #define LED_PIN         35      // AtomS3 RGB LED (WS2812)
 #define BUTTON_PIN      41      // AtomS3 Main Button (front)
 #define RESET_BUTTON_PIN 39     // AtomS3 Side Button (reset/reboot)
@@ -111,8 +135,18 @@ static const uint32_t BLE_SCAN_DURATION_MS = 1000;     // 1 second BLE scanning
 // 97/3 split: BLE sampled briefly for device composition (Apple vs Other)
 // WiFi gets nearly all time for accurate probe counting
 
-// Maximum unique MACs to track per period (raised from 500 to prevent silent data loss)
-#define MAX_UNIQUE_MACS 2000
+// Concurrent mode ("radio_mode":"coex" in remote config): promiscuous capture
+// stays up and a low-duty passive BLE scan runs alongside it, sharing the
+// radio through the WiFi/BT software coexistence scheduler instead of
+// stop/start slices. Window/interval sets the BLE duty cycle.
+static const uint16_t BLE_COEX_SCAN_INTERVAL_MS = 300;
+static const uint16_t BLE_COEX_SCAN_WINDOW_MS = 30;    // 10% duty
+
+// Maximum unique MACs to track per period (raised from 500 to prevent silent data loss;
+// raised again when 32-bit fingerprints halved the per-entry size). Each counter's
+// hashed set is 4096 x 4 bytes at most 3/4 full, so WiFi + BLE stay within the
+// 32 KB the two 2000-entry 64-bit tables used.
+#define MAX_UNIQUE_MACS 3000
 
 // Privacy: Only count randomized MACs (filters out static/PII MACs)
 // Randomized MACs have bit 1 of first byte set (locally administered)
@@ -156,6 +190,24 @@ static uint32_t g_configVersion = 0;
 // Maximum retries per chunk before aborting
 #define OTA_MAX_CHUNK_RETRIES 3
 
+// Chunk limit and checkpoint cadence: OTA_MAX_CHUNKS, OTA_CHECKPOINT_CHUNKS
+// and OTA_CHECKPOINT_MS in include/ota_chunks.h
+
+// OTA background task - low priority, shares the modem with reading uplinks
+#define OTA_TASK_PRIORITY   (tskIDLE_PRIORITY + 1)
+#define OTA_TASK_STACK      6144
+#define OTA_IDLE_POLL_MS    1000    // State poll interval when nothing to do
+
+// Throttling: per-hour budget for bytes on the wire and modem hold time,
+// plus a minimum gap between chunks so reports always find the modem free
+#define OTA_BUDGET_BYTES_PER_HOUR   (256UL * 1024UL)
+#define OTA_BUDGET_MODEM_MS_PER_HOUR (15UL * 60UL * 1000UL)   // 25% duty
+#define OTA_CHUNK_GAP_MS            2000
+#define OTA_UPLINK_GUARD_MS         15000   // Don't open/send a chunk this close to a report
+#define OTA_CHUNK_RESPONSE_MS       10000   // Wait for a chunk response on the OTA link
+#define OTA_CHUNK_POLL_MS           20      // Response poll - keeps the UART drained
+#define OTA_MODEM_WAIT_MS           (5UL * 60UL * 1000UL)  // OTA task waits behind uplinks
+
 // OTA state machine states
 enum OtaDeltaState {
     OTA_DELTA_IDLE = 0,       // No OTA in progress
@@ -224,6 +276,218 @@ enum LedStatus {
 #define COLOR_CYAN      CRGB::Cyan
 #define COLOR_WHITE     CRGB::White
 
+// =============================================================================
+// Deferred Logging
+// =============================================================================
+// Serial over USB CDC can block when no host is attached, and every print adds
+// latency to AT transactions. Log calls format into a fixed-slot lock-free
+// queue instead; a low-priority task drains it to Serial and keeps a history
+// ring that the "upload_logs" command ships LZSS-compressed to the backend.
+//
+// Levels are stripped at compile time - build with -DLOG_LEVEL=4 for AT traffic.
+
+#define LOG_LEVEL_NONE   0
+#define LOG_LEVEL_ERROR  1
+#define LOG_LEVEL_WARN   2
+#define LOG_LEVEL_INFO   3
+#define LOG_LEVEL_DEBUG  4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_SLOT_COUNT     64      // Queued lines (must be a power of 2)
+#define LOG_SLOT_SIZE      128     // Max formatted length per call (longer is truncated)
+#define LOG_DUMP_MAX_SLOTS 8       // Slots one LOGD_DUMP may span (~1 KB of text)
+#define LOG_HISTORY_SIZE   8192    // Recent log bytes kept for remote upload
+#define LOG_UPLOAD_DEFAULT_KB 4    // "upload_logs" without a size ships this much
+#define LOG_DRAIN_IDLE_MS  20      // Drain task poll interval when queue is empty
+#define LOG_FLUSH_TIMEOUT_MS 500   // Max wait for queued lines before a restart
+#define LOG_TASK_PRIORITY  (tskIDLE_PRIORITY + 1)
+#define LOG_TASK_STACK     3072
+
+static void logWrite(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+static void logDump(const char* prefix, const char* text);
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOGE(...) logWrite(__VA_ARGS__)
+#else
+#define LOGE(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOGW(...) logWrite(__VA_ARGS__)
+#else
+#define LOGW(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOGI(...) logWrite(__VA_ARGS__)
+#else
+#define LOGI(...) do {} while (0)
+#endif
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOGD(...) logWrite(__VA_ARGS__)
+#define LOGD_DUMP(prefix, text) logDump(prefix, text)   // Long buffers, spread over slots
+#else
+#define LOGD(...) do {} while (0)
+#define LOGD_DUMP(prefix, text) do {} while (0)
+#endif
+
+// Bounded MPMC queue (Vyukov): each slot carries a sequence number that tells
+// producers and the consumer whose turn it is - no locks, safe from any task
+struct LogSlot {
+    std::atomic<uint32_t> seq;
+    uint8_t len;
+    char text[LOG_SLOT_SIZE];
+};
+static LogSlot g_logSlots[LOG_SLOT_COUNT];
+static std::atomic<uint32_t> g_logEnqueuePos(0);
+static std::atomic<uint32_t> g_logDequeuePos(0);
+static std::atomic<uint32_t> g_logDropped(0);   // Lines lost because the queue was full
+static std::atomic<uint32_t> g_logDrainedPos(0); // Lines fully written out by the drain task
+
+// History ring - written only by the drain task, frozen while an upload reads it
+static char g_logHistory[LOG_HISTORY_SIZE];
+static uint32_t g_logHistoryTotal = 0;          // Total bytes ever appended
+static volatile bool g_logHistoryFrozen = false;
+static portMUX_TYPE g_logHistoryMux = portMUX_INITIALIZER_UNLOCKED;
+
+static TaskHandle_t g_logTask = nullptr;
+
+static void logInitSlots() {
+    for (uint32_t i = 0; i < LOG_SLOT_COUNT; i++) {
+        g_logSlots[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+// Format and enqueue one log record. Never blocks; drops when the queue is full.
+static void logWrite(const char* fmt, ...) {
+    uint32_t pos = g_logEnqueuePos.load(std::memory_order_relaxed);
+    LogSlot* slot;
+    for (;;) {
+        slot = &g_logSlots[pos & (LOG_SLOT_COUNT - 1)];
+        uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (g_logEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            g_logDropped.fetch_add(1, std::memory_order_relaxed);
+            return;  // Queue full
+        } else {
+            pos = g_logEnqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    int n = vsnprintf(slot->text, LOG_SLOT_SIZE, fmt, args);
+    va_end(args);
+    if (n < 0) n = 0;
+    if (n >= LOG_SLOT_SIZE) {
+        n = LOG_SLOT_SIZE - 1;
+        slot->text[n - 1] = '\n';  // Keep line structure when truncated
+    }
+    slot->len = (uint8_t)n;
+    slot->seq.store(pos + 1, std::memory_order_release);
+}
+
+// Log a buffer longer than one slot (AT/HTTP responses): consecutive records
+// that the drain task writes back to back, prefix on the first, newline last
+static void logDump(const char* prefix, const char* text) {
+    size_t len = strlen(text);
+    size_t chunk = LOG_SLOT_SIZE - 1 - strlen(prefix);
+    logWrite("%s%.*s", prefix, (int)(len < chunk ? len : chunk), text);
+    size_t off = len < chunk ? len : chunk;
+    for (int slots = 1; off < len && slots < LOG_DUMP_MAX_SLOTS; slots++) {
+        chunk = len - off < LOG_SLOT_SIZE - 1 ? len - off : LOG_SLOT_SIZE - 1;
+        logWrite("%.*s", (int)chunk, text + off);
+        off += chunk;
+    }
+    if (off < len) {
+        logWrite("... (%u more bytes)\n", (unsigned)(len - off));
+    } else {
+        logWrite("\n");
+    }
+}
+
+// Dequeue one record into buf - returns length, or -1 if the queue is empty
+static int logDequeue(char* buf) {
+    uint32_t pos = g_logDequeuePos.load(std::memory_order_relaxed);
+    LogSlot* slot;
+    for (;;) {
+        slot = &g_logSlots[pos & (LOG_SLOT_COUNT - 1)];
+        uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        int32_t diff = (int32_t)(seq - (pos + 1));
+        if (diff == 0) {
+            if (g_logDequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return -1;  // Empty
+        } else {
+            pos = g_logDequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+    int len = slot->len;
+    memcpy(buf, slot->text, len);
+    slot->seq.store(pos + LOG_SLOT_COUNT, std::memory_order_release);
+    return len;
+}
+
+static void logHistoryAppend(const char* text, int len) {
+    portENTER_CRITICAL(&g_logHistoryMux);
+    if (!g_logHistoryFrozen) {
+        for (int i = 0; i < len; i++) {
+            g_logHistory[(g_logHistoryTotal + i) % LOG_HISTORY_SIZE] = text[i];
+        }
+        g_logHistoryTotal += len;
+    }
+    portEXIT_CRITICAL(&g_logHistoryMux);
+}
+
+// Drain task - the only place that touches Serial for log output
+static void logDrainTask(void* param) {
+    static char line[LOG_SLOT_SIZE];
+    for (;;) {
+        uint32_t dropped = g_logDropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            int n = snprintf(line, sizeof(line), "[LOG] %lu lines dropped (queue full)\n",
+                             (unsigned long)dropped);
+            if (Serial) Serial.write((const uint8_t*)line, n);
+            logHistoryAppend(line, n);
+        }
+
+        int len = logDequeue(line);
+        if (len < 0) {
+            vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_IDLE_MS));
+            continue;
+        }
+        // Skip Serial entirely when no USB host is attached
+        if (Serial) {
+            Serial.write((const uint8_t*)line, len);
+        }
+        logHistoryAppend(line, len);
+        g_logDrainedPos.fetch_add(1, std::memory_order_release);
+    }
+}
+
+static void logInit() {
+    logInitSlots();
+    xTaskCreatePinnedToCore(logDrainTask, "log_drain", LOG_TASK_STACK, nullptr,
+                            LOG_TASK_PRIORITY, &g_logTask, tskNO_AFFINITY);
+}
+
+// Wait (bounded) for queued lines to reach Serial - call before a restart
+static void logFlush(uint32_t timeoutMs) {
+    uint32_t start = millis();
+    while (g_logDrainedPos.load(std::memory_order_acquire) !=
+               g_logEnqueuePos.load(std::memory_order_relaxed) &&
+           (millis() - start) < timeoutMs) {
+        delay(5);
+    }
+}
+
 // =============================================================================
 // Global State
 // =============================================================================
@@ -231,30 +495,23 @@ enum LedStatus {
 // FastLED array
 CRGB g_leds[NUM_LEDS];
 
-// Current LED status
-static LedStatus g_ledStatus = LED_STATUS_SEARCHING;
-static uint32_t g_lastLedUpdate = 0;
-static bool g_ledBlinkState = false;
+// Current LED status - written by the loop task, rendered by the LED timer
+static volatile LedStatus g_ledStatus = LED_STATUS_SEARCHING;
+static volatile uint32_t g_ledStatusSince = 0;    // millis() when status was set
+static portMUX_TYPE g_ledMux = portMUX_INITIALIZER_UNLOCKED;
 
 // UART for modem
 HardwareSerial ModemSerial(1);
 
-// WiFi probe counting state
-static volatile uint32_t g_totalProbes = 0;
+// WiFi probe counting state - counters live in g_wifiCounter (see Counting Engine)
 static volatile uint32_t g_filteredStatic = 0;  // Count of rejected static MACs
-// Fixed arrays for MAC deduplication - prevents heap fragmentation in 24/7 operation
-static uint64_t g_uniqueMacs[MAX_UNIQUE_MACS];
-static uint16_t g_uniqueMacCount = 0;
-// Overflow counters - track when caps are hit (data quality indicator)
-static volatile uint16_t g_uniqueOverflow = 0;  // WiFi uniques dropped due to cap
-static volatile uint16_t g_bleOverflow = 0;     // BLE uniques dropped due to cap
 // Fixed array for access point BSSIDs
-static uint64_t g_uniqueAPs[MAX_UNIQUE_APS];
+static uint32_t g_uniqueAPs[MAX_UNIQUE_APS];
 static uint16_t g_uniqueAPCount = 0;
 static portMUX_TYPE g_probeMux = portMUX_INITIALIZER_UNLOCKED;
 
-// Helper: Check if MAC exists in array, add if not. Returns true if newly added.
-static bool addUniqueMac(uint64_t* array, uint16_t* count, uint16_t maxSize, uint64_t mac) {
+// Helper: Check if fingerprint exists in array, add if not. Returns true if newly added.
+static bool addUniqueMac(uint32_t* array, uint16_t* count, uint16_t maxSize, uint32_t mac) {
     // Linear search is O(n) but fast for 500 entries (~microseconds)
     for (uint16_t i = 0; i < *count; i++) {
         if (array[i] == mac) {
@@ -269,15 +526,7 @@ static bool addUniqueMac(uint64_t* array, uint16_t* count, uint16_t maxSize, uin
     return false;  // Array full, not added
 }
 
-// BLE counting state - Apple detection via manufacturer ID 0x004C
-static volatile uint32_t g_bleImpressions = 0;  // Total BLE advertisements
-static volatile uint32_t g_bleAppleCount = 0;   // Apple devices (0x004C) - reliable
-static volatile uint32_t g_bleOtherCount = 0;   // Everything else (Android, wearables, IoT)
-static volatile int32_t g_bleRssiSum = 0;       // Sum for average calculation
-static volatile uint32_t g_bleRssiCount = 0;    // Count for average
-// Fixed array for BLE MAC deduplication - prevents heap fragmentation
-static uint64_t g_bleUniqueMacs[MAX_UNIQUE_MACS];
-static uint16_t g_bleUniqueMacCount = 0;
+// BLE counting state - counters live in g_bleCounter (see Counting Engine)
 static portMUX_TYPE g_bleMux = portMUX_INITIALIZER_UNLOCKED;
 
 // Radio time-slicing state
@@ -286,58 +535,90 @@ static RadioMode g_radioMode = RADIO_WIFI;
 static uint32_t g_lastRadioSwitch = 0;
 static bool g_bleInitialized = false;
 
-// Probe RSSI tracking (WiFi signal strength from phones)
-static volatile int32_t g_probeRssiSum = 0;
-static volatile int32_t g_probeRssiMin = 0;      // Min RSSI (closest device)
-static volatile int32_t g_probeRssiMax = -999;   // Max RSSI (farthest device)
-static volatile uint32_t g_probeRssiCount = 0;
+// Radio schedule - how WiFi and BLE share the radio (payload "rm")
+enum RadioSchedule { RADIO_SCHEDULE_SLICED = 0, RADIO_SCHEDULE_COEX = 1 };
+#define RADIO_SCHEDULE_MIXED 2   // Payload only: a merged reading spans both schedules
+static RadioSchedule g_radioSchedule = RADIO_SCHEDULE_SLICED;
+static RadioSchedule g_radioScheduleNext = RADIO_SCHEDULE_SLICED;  // Applied when capture resumes
 
-// Dwell time tracking - tracks how long each device stays in range
-// Using parallel arrays instead of std::map to prevent heap fragmentation
-#define MAX_DWELL_ENTRIES 1000
-static uint64_t g_dwellMacs[MAX_DWELL_ENTRIES];
-static uint16_t g_dwellFirstSeen[MAX_DWELL_ENTRIES];
-static uint16_t g_dwellLastSeen[MAX_DWELL_ENTRIES];
-static uint16_t g_dwellCount = 0;
-
-// Helper: Find existing dwell entry or add new one. Returns index, or -1 if full.
-static int findOrAddDwellEntry(uint64_t mac) {
-    // Search for existing entry
-    for (uint16_t i = 0; i < g_dwellCount; i++) {
-        if (g_dwellMacs[i] == mac) {
-            return (int)i;  // Found existing
+// =============================================================================
+// Radio Time Accounting
+// =============================================================================
+// The WiFi radio is deaf during BLE slices, channel hops and report uplinks, and
+// only hears one channel at a time. We account listening time per WiFi channel
+// and for BLE so readings can carry duty-cycle-normalized counts.
+// All accounting calls come from the loop task, so no mutex is needed.
+
+// Listening slots: 0..WIFI_CHANNEL_COUNT-1 = WiFi channel index, then BLE
+#define LISTEN_SLOT_IDLE  -1
+#define LISTEN_SLOT_BLE   WIFI_CHANNEL_COUNT
+static uint64_t g_listenUs[WIFI_CHANNEL_COUNT + 1];  // Accumulated listen time this epoch
+static int8_t g_listenSlot = LISTEN_SLOT_IDLE;      // Slot currently listening
+static int64_t g_listenSegmentStart = 0;            // esp_timer time current slot started
+static int64_t g_epochStartUs = 0;                  // esp_timer time current epoch started
+static int64_t g_bleCoexSinceUs = 0;                // Concurrent BLE scan running since (0 = off)
+
+// Close the running listen segment and start a new one in the given slot
+static void radioAccountSwitch(int8_t slot) {
+    int64_t now = esp_timer_get_time();
+    if (g_listenSlot != LISTEN_SLOT_IDLE) {
+        uint64_t segmentUs = (uint64_t)(now - g_listenSegmentStart);
+        // NimBLE ends the scan by itself after BLE_SCAN_DURATION_MS
+        if (g_listenSlot == LISTEN_SLOT_BLE && segmentUs > BLE_SCAN_DURATION_MS * 1000ULL) {
+            segmentUs = BLE_SCAN_DURATION_MS * 1000ULL;
         }
+        g_listenUs[g_listenSlot] += segmentUs;
     }
-    // Add new entry if space available
-    if (g_dwellCount < MAX_DWELL_ENTRIES) {
-        int idx = g_dwellCount;
-        g_dwellMacs[idx] = mac;
-        g_dwellCount++;
-        return idx;
+    g_listenSlot = slot;
+    g_listenSegmentStart = now;
+}
+
+// Concurrent BLE scanning overlaps the WiFi slots, so it is accounted apart:
+// scan wall time times the window/interval duty. Flush before reading the
+// BLE slot; pass running=false when the scan stops.
+static void radioAccountCoexBle(bool running) {
+    int64_t now = esp_timer_get_time();
+    if (g_bleCoexSinceUs != 0) {
+        uint64_t scanUs = (uint64_t)(now - g_bleCoexSinceUs);
+        g_listenUs[LISTEN_SLOT_BLE] += scanUs * BLE_COEX_SCAN_WINDOW_MS / BLE_COEX_SCAN_INTERVAL_MS;
     }
-    return -1;  // Array full
+    g_bleCoexSinceUs = running ? now : 0;
 }
 
-// Dwell time bucket counters (calculated at report time)
-// These track engagement levels:
-// - 0-1 min: Drive-by traffic (saw device in only 1 minute)
-// - 1-5 min: Brief stop (2-5 distinct minutes)
-// - 5-10 min: Engaged visitor
-// - 10+ min: Highly engaged (lingered 10+ minutes)
-static volatile uint32_t g_dwell_0_1 = 0;
-static volatile uint32_t g_dwell_1_5 = 0;
-static volatile uint32_t g_dwell_5_10 = 0;
-static volatile uint32_t g_dwell_10plus = 0;
+// Capture per schedule since boot, to compare the two on the same site.
+// Compared on per-minute uniques: the sliced scan filters duplicates within
+// a slice and the coex scan does not, so their impressions don't compare.
+struct RadioScheduleStats {
+    uint64_t wifiUniques;
+    uint64_t bleUniques;
+    uint64_t epochMs;
+};
+static RadioScheduleStats g_radioScheduleStats[2];
+
+static void radioScheduleRecord(uint8_t schedule, uint32_t wifiUniques, uint32_t bleUniques, uint32_t epochMs) {
+    if (schedule > RADIO_SCHEDULE_COEX) return;
+    RadioScheduleStats* st = &g_radioScheduleStats[schedule];
+    st->wifiUniques += wifiUniques;
+    st->bleUniques += bleUniques;
+    st->epochMs += epochMs;
+    uint32_t rates[2][2] = {};
+    for (int m = 0; m < 2; m++) {
+        uint64_t ms = g_radioScheduleStats[m].epochMs;
+        if (ms == 0) continue;
+        rates[m][0] = (uint32_t)(g_radioScheduleStats[m].wifiUniques * 60000 / ms);
+        rates[m][1] = (uint32_t)(g_radioScheduleStats[m].bleUniques * 60000 / ms);
+    }
+    LOGI("[RADIO] Uniques per min - sliced: WiFi %lu BLE %lu | coex: WiFi %lu BLE %lu\n",
+         rates[0][0], rates[0][1], rates[1][0], rates[1][1]);
+}
 
-// RSSI distance zone counters (proves viewability)
-// - Immediate: > -50 dBm (within ~2m, very close)
-// - Near: -50 to -65 dBm (~2-5m, clearly visible)
-// - Far: -65 to -80 dBm (~5-15m, in vicinity)
-// - Remote: < -80 dBm (>15m, passing by)
-static volatile uint32_t g_rssi_immediate = 0;
-static volatile uint32_t g_rssi_near = 0;
-static volatile uint32_t g_rssi_far = 0;
-static volatile uint32_t g_rssi_remote = 0;
+// Scale a raw count to the whole epoch given how long the radio actually listened.
+// First-order estimate: assumes traffic is uniform over the epoch.
+static uint32_t normalizeCount(uint32_t raw, uint32_t listenMs, uint32_t epochMs) {
+    if (listenMs == 0 || epochMs == 0) return 0;
+    if (listenMs >= epochMs) return raw;
+    return (uint32_t)(((uint64_t)raw * epochMs + listenMs / 2) / listenMs);
+}
 
 // Timing
 static uint32_t g_lastReportTime = 0;
@@ -346,23 +627,28 @@ static uint32_t g_bootTimestamp = 0;  // Pseudo-timestamp from boot
 
 // Channel hopping state
 static uint8_t g_currentChannelIndex = 0;
-static uint32_t g_lastChannelHop = 0;
 
 // OTA rollback protection - confirms new firmware works after first successful send
 static bool g_otaConfirmed = false;
 
-// Cached reading structure for offline resilience
+// Reading structure - filled at report time, sent live or cached for offline resilience
 struct CachedReading {
     bool valid;
+    uint32_t seq;              // Reading sequence number (first one covered when merged)
+    uint32_t seqLast;          // Last sequence covered (== seq unless merged)
+    bool sentUnacked;          // A send went out but its response was lost - kept unmerged
     char timestamp[25];
     uint32_t cachedAtMillis;   // millis() when this was cached (for age calculation)
     uint16_t overflowCount;    // Overflow count when this reading was captured
     uint32_t impressions;
     uint32_t unique;
+    uint32_t uniqueCorrected;  // Unique with MAC rotations merged (same per-minute basis)
+    uint32_t rotationsLinked;  // MAC rotations merged this epoch
     int probeRssiAvg;
     int probeRssiMin;
     int probeRssiMax;
-    int cellRssi;
+    int cellRssi;              // -999 = unknown
+    uint16_t cellRssiCount;    // Readings averaged into cellRssi (unknown ones excluded)
     uint32_t dwell_0_1;
     uint32_t dwell_1_5;
     uint32_t dwell_5_10;
@@ -377,6 +663,33 @@ struct CachedReading {
     uint32_t bleApple;
     uint32_t bleOther;
     int bleRssiAvg;
+    uint32_t bleDwell[4];                           // BLE dwell buckets (same thresholds as WiFi)
+    uint32_t bleZones[4];                           // BLE RSSI zones, immediate..remote
+    // Radio time accounting - how long each radio listened this epoch
+    uint32_t epochMs;                               // Epoch length (wall time covered)
+    uint32_t wifiListenMs;                          // WiFi promiscuous time, all channels
+    uint32_t bleListenMs;                           // BLE scan time (duty-weighted when concurrent)
+    uint8_t radioSchedule;                          // RadioSchedule the epoch ran under
+    uint32_t channelListenMs[WIFI_CHANNEL_COUNT];   // WiFi time per hopped channel
+    // Capture quality - driver RX statistics for this epoch
+    uint32_t rxMgmtSeen[WIFI_CHANNEL_COUNT];        // Mgmt frames delivered per channel
+    uint32_t rxMgmtProcessed[WIFI_CHANNEL_COUNT];   // Of those, frames that reached counters
+    uint32_t rxErrors;                              // Driver-flagged RX errors
+    uint32_t rxCallbackMaxUs;                       // Slowest promiscuous callback (us)
+    uint32_t seqMissed;                             // Probes missed, estimated from seq gaps
+    uint8_t timeQuality;                            // TimeQuality of the timestamp
+    uint32_t intervalS;                             // Report interval scheduled for this epoch
+    uint32_t periodStart;                           // Unix time the epoch began (0 = clock not synced)
+    uint32_t periodEnd;                             // Unix time capture stopped for the report
+    bool periodPartial;                             // Start or end off the wall-clock grid
+    uint16_t anomalyFlags;                          // ANOMALY_FLAG_* raised during this epoch
+    uint16_t occupancy;                             // Live occupancy estimate at report time
+    uint16_t stableIds;                             // Distinct stable identifiers today so far
+    int16_t returningPermille;                      // Of those, seen on an earlier day (-1 = n/a)
+    // Cache compaction - merged records cover
+    // mergedCount consecutive readings and their uniques are upper bounds
+    uint8_t mergeLevel;                             // Merge depth (0 = original)
+    uint16_t mergedCount;                           // Original readings covered
 };
 
 // Circular buffer for cached readings (48hr at 30-min intervals, or 8hr at 5-min)
@@ -386,42 +699,182 @@ static uint8_t g_cacheHead = 0;   // Next write position
 static uint8_t g_cacheTail = 0;   // Next read position
 static uint8_t g_cacheCount = 0;  // Number of valid entries
 
-// Cache a reading for later retry (returns true if cached, false if full)
+// Weighted average of two RSSI values (weights are counts; 0/0 keeps a)
+static int mergeRssi(int a, uint32_t wa, int b, uint32_t wb) {
+    if (wa + wb == 0) return a;
+    return (int)(((int64_t)a * wa + (int64_t)b * wb) / (int64_t)(wa + wb));
+}
+
+// Fold reading b (newer) into a (older) - one coarser interval covering both.
+// Counts and listen times add, RSSI is count-weighted, uniques add (so they
+// become upper bounds - a device seen in both intervals counts twice).
+static void mergeReadings(CachedReading* a, const CachedReading& b) {
+    a->probeRssiAvg = mergeRssi(a->probeRssiAvg, a->impressions, b.probeRssiAvg, b.impressions);
+    if (b.impressions > 0) {
+        if (a->impressions == 0 || b.probeRssiMin < a->probeRssiMin) a->probeRssiMin = b.probeRssiMin;
+        if (a->impressions == 0 || b.probeRssiMax > a->probeRssiMax) a->probeRssiMax = b.probeRssiMax;
+    }
+    a->bleRssiAvg = mergeRssi(a->bleRssiAvg, a->bleImpressions, b.bleRssiAvg, b.bleImpressions);
+    // Unknown signal (-999) carries no weight, or it would drag the average
+    if (b.cellRssiCount > 0) {
+        a->cellRssi = mergeRssi(a->cellRssi, a->cellRssiCount, b.cellRssi, b.cellRssiCount);
+        a->cellRssiCount += b.cellRssiCount;
+    }
+
+    a->impressions += b.impressions;
+    a->unique += b.unique;
+    a->uniqueCorrected += b.uniqueCorrected;
+    a->rotationsLinked += b.rotationsLinked;
+    uint32_t overflows = (uint32_t)a->overflowCount + b.overflowCount;
+    a->overflowCount = overflows > 0xFFFF ? 0xFFFF : (uint16_t)overflows;
+    a->dwell_0_1 += b.dwell_0_1;
+    a->dwell_1_5 += b.dwell_1_5;
+    a->dwell_5_10 += b.dwell_5_10;
+    a->dwell_10plus += b.dwell_10plus;
+    a->rssi_immediate += b.rssi_immediate;
+    a->rssi_near += b.rssi_near;
+    a->rssi_far += b.rssi_far;
+    a->rssi_remote += b.rssi_remote;
+    a->bleImpressions += b.bleImpressions;
+    a->bleUnique += b.bleUnique;
+    a->bleApple += b.bleApple;
+    a->bleOther += b.bleOther;
+    for (int i = 0; i < 4; i++) {
+        a->bleDwell[i] += b.bleDwell[i];
+        a->bleZones[i] += b.bleZones[i];
+    }
+
+    a->epochMs += b.epochMs;
+    a->periodEnd = b.periodEnd;
+    a->seqLast = b.seqLast;
+    a->periodPartial = a->periodPartial || b.periodPartial || a->periodStart == 0;
+    a->intervalS += b.intervalS;
+    a->anomalyFlags |= b.anomalyFlags;
+    if (b.radioSchedule != a->radioSchedule) a->radioSchedule = RADIO_SCHEDULE_MIXED;
+    if (b.occupancy > a->occupancy) a->occupancy = b.occupancy;
+    if (b.stableIds > 0) {
+        // Running daily figures - the later snapshot supersedes
+        a->stableIds = b.stableIds;
+        a->returningPermille = b.returningPermille;
+    }
+    a->wifiListenMs += b.wifiListenMs;
+    a->bleListenMs += b.bleListenMs;
+    for (int i = 0; i < WIFI_CHANNEL_COUNT; i++) {
+        a->channelListenMs[i] += b.channelListenMs[i];
+        a->rxMgmtSeen[i] += b.rxMgmtSeen[i];
+        a->rxMgmtProcessed[i] += b.rxMgmtProcessed[i];
+    }
+    a->rxErrors += b.rxErrors;
+    a->seqMissed += b.seqMissed;
+    if (b.rxCallbackMaxUs > a->rxCallbackMaxUs) a->rxCallbackMaxUs = b.rxCallbackMaxUs;
+    if (b.timeQuality < a->timeQuality) a->timeQuality = b.timeQuality;
+
+    a->mergeLevel = (a->mergeLevel > b.mergeLevel ? a->mergeLevel : b.mergeLevel) + 1;
+    a->mergedCount += b.mergedCount;
+}
+
+// Remove the reading at position i (0 = oldest), shifting newer ones down
+static void cacheRemoveAt(int i) {
+    for (; i + 1 < g_cacheCount; i++) {
+        g_cacheBuffer[(g_cacheTail + i) % MAX_CACHED_READINGS] =
+            g_cacheBuffer[(g_cacheTail + i + 1) % MAX_CACHED_READINGS];
+    }
+    g_cacheHead = (g_cacheHead + MAX_CACHED_READINGS - 1) % MAX_CACHED_READINGS;
+    g_cacheBuffer[g_cacheHead].valid = false;
+    g_cacheCount--;
+}
+
+// Make room by merging the adjacent pair with the lowest merge level
+// (oldest pair on ties), so resolution degrades evenly instead of dropping
+// the oldest hours outright. Readings the server may already hold (response
+// lost) are never merged - their re-send must match what it stored. When no
+// pair is free of them, the oldest such reading goes: the server most
+// likely has it already.
+static void compactCache() {
+    int best = -1;
+    uint8_t bestLevel = 0xFF;
+    int oldestUnacked = -1;
+    for (int i = 0; i < g_cacheCount; i++) {
+        const CachedReading& x = g_cacheBuffer[(g_cacheTail + i) % MAX_CACHED_READINGS];
+        if (x.sentUnacked) {
+            if (oldestUnacked < 0) oldestUnacked = i;
+            continue;
+        }
+        if (i + 1 >= g_cacheCount) break;
+        const CachedReading& y = g_cacheBuffer[(g_cacheTail + i + 1) % MAX_CACHED_READINGS];
+        if (y.sentUnacked) continue;
+        // Cached oldest first, so sequences rise; a merge must keep seq..seqLast a
+        // contiguous range or the ack would skip (or strand) readings in between
+        if (x.seq != 0 && y.seq != 0 && y.seq <= x.seqLast) continue;
+        uint8_t level = x.mergeLevel > y.mergeLevel ? x.mergeLevel : y.mergeLevel;
+        if (best < 0 || level < bestLevel) {
+            bestLevel = level;
+            best = i;
+        }
+    }
+
+    if (best < 0) {
+        if (oldestUnacked < 0) return;
+        LOGW("[CACHE] Buffer full, dropping sent-unacknowledged reading #%lu\n",
+             g_cacheBuffer[(g_cacheTail + oldestUnacked) % MAX_CACHED_READINGS].seq);
+        cacheRemoveAt(oldestUnacked);
+        return;
+    }
+
+    CachedReading* a = &g_cacheBuffer[(g_cacheTail + best) % MAX_CACHED_READINGS];
+    mergeReadings(a, g_cacheBuffer[(g_cacheTail + best + 1) % MAX_CACHED_READINGS]);
+    cacheRemoveAt(best + 1);
+
+    LOGI("[CACHE] Buffer full, merged slot %d to level %u (%u readings)\n",
+         best, a->mergeLevel, a->mergedCount);
+}
+
+// Cache a reading for later retry (always succeeds - compacts when full)
 static bool cacheReading(const CachedReading& reading) {
     if (g_cacheCount >= MAX_CACHED_READINGS) {
-        Serial.println("[CACHE] Buffer full, dropping oldest reading");
-        // Drop oldest by advancing tail
-        g_cacheTail = (g_cacheTail + 1) % MAX_CACHED_READINGS;
-        g_cacheCount--;
+        compactCache();
     }
     g_cacheBuffer[g_cacheHead] = reading;
     g_cacheBuffer[g_cacheHead].valid = true;
+    if (g_cacheBuffer[g_cacheHead].mergedCount == 0) {
+        g_cacheBuffer[g_cacheHead].mergedCount = 1;
+    }
     g_cacheHead = (g_cacheHead + 1) % MAX_CACHED_READINGS;
     g_cacheCount++;
-    Serial.printf("[CACHE] Cached reading (%d/%d slots used)\n", g_cacheCount, MAX_CACHED_READINGS);
+    LOGI("[CACHE] Cached reading (%d/%d slots used)\n", g_cacheCount, MAX_CACHED_READINGS);
     return true;
 }
 
-// Pop oldest cached reading (returns true if found, false if empty)
-static bool popCachedReading(CachedReading* reading) {
+// Oldest cached reading (nullptr if empty). It stays cached until
+// dropCachedReading(), so a failed retry keeps its place in sequence order.
+static CachedReading* peekCachedReading() {
     if (g_cacheCount == 0) {
-        return false;
+        return nullptr;
     }
-    *reading = g_cacheBuffer[g_cacheTail];
+    return &g_cacheBuffer[g_cacheTail];
+}
+
+// Remove the oldest cached reading (sent or already acknowledged)
+static void dropCachedReading() {
+    if (g_cacheCount == 0) return;
     g_cacheBuffer[g_cacheTail].valid = false;
     g_cacheTail = (g_cacheTail + 1) % MAX_CACHED_READINGS;
     g_cacheCount--;
-    return true;
 }
 
 // Network state
 static bool g_networkReady = false;
-static int g_cellRssi = 0;          // Cellular signal strength (dBm)
+static int g_cellRssi = -999;       // Cellular signal strength (dBm, -999 = unknown)
 static bool g_lastSendSuccess = false;
 
 // Quality tracking for auditability
 static uint8_t g_sendFailures = 0;         // Consecutive send failures (reset on success)
 
+// Saturates: a long outage must not wrap back to the first back-off step
+static void sendFailureCount() {
+    if (g_sendFailures < 0xFF) g_sendFailures++;
+}
+
 // Geolocation state - flag to send once network connects
 static bool g_geolocationPending = false;
 
@@ -453,6 +906,18 @@ struct OtaDeltaInfo {
 
 static OtaDeltaInfo g_otaDelta = {};
 static Preferences g_otaNvs;       // NVS handle for persistence
+static TaskHandle_t g_otaTask = nullptr;
+
+// Hourly OTA throttle window (owned by the OTA task)
+static uint32_t g_otaBudgetWindowStart = 0;
+static uint32_t g_otaBudgetBytes = 0;      // Bytes sent+received this window
+static uint32_t g_otaBudgetModemMs = 0;    // Modem hold time this window
+static uint32_t g_otaChunkWireBytes = 0;   // Set by otaDownloadChunk()
+static uint32_t g_otaChunkModemMs = 0;     // Modem hold time of the last chunk
+
+// Resumable download progress - one bit per chunk, persisted with the state
+static OtaChunkProgress g_otaProgress;
+static uint32_t g_otaNvsWrites = 0;           // NVS state commits for this update
 static bool g_spiffsReady = false; // SPIFFS initialization status
 
 // Forward declarations for OTA functions (defined later, used in command handlers)
@@ -464,6 +929,18 @@ static bool g_forceSendRequested = false;
 // Remote configuration fetch flag (v5.4)
 static bool g_configFetchPending = false;
 
+// Remote log upload request - KB of recent log to ship, 0 = none pending
+static uint16_t g_logUploadPendingKb = 0;
+
+// Parse "upload_logs" or "upload_logs:<KB>" and schedule the upload
+static void scheduleLogUpload(const char* command) {
+    int kb = (command[11] == ':') ? atoi(command + 12) : LOG_UPLOAD_DEFAULT_KB;
+    if (kb < 1) kb = LOG_UPLOAD_DEFAULT_KB;
+    if (kb > LOG_HISTORY_SIZE / 1024) kb = LOG_HISTORY_SIZE / 1024;
+    g_logUploadPendingKb = (uint16_t)kb;
+    LOGI("[COMMAND] Log upload requested (%d KB)\n", kb);
+}
+
 // AT response buffer
 static char g_atBuffer[512];
 static size_t g_atBufferLen = 0;
@@ -472,539 +949,3041 @@ static size_t g_atBufferLen = 0;
 // LED Control Functions
 // =============================================================================
 
+// LED patterns described as data and rendered by an esp_timer callback, so
+// animations keep running while the loop blocks in AT calls and the loop
+// never sleeps for cosmetics.
+//
+// Each period starts with onMs of onColor, then offColor for the remainder.
+// periodMs = 0 means solid onColor. holdMs > 0 makes the status temporary:
+// after holdMs it reverts to CONNECTED (or SEARCHING without network).
+struct LedPattern {
+    CRGB onColor;
+    CRGB offColor;
+    uint16_t periodMs;
+    uint16_t onMs;
+    uint8_t offBrightness;  // Brightness during the off phase (on phase uses LED_BRIGHTNESS)
+    uint16_t holdMs;
+};
+
+#define LED_BRIGHTNESS   50   // Moderate brightness to save power
+#define LED_TICK_MS      25   // Render timer period
+
+// Indexed by LedStatus
+static const LedPattern LED_PATTERNS[] = {
+    /* BOOTING      */ { COLOR_PURPLE, COLOR_PURPLE, 0,    0,    LED_BRIGHTNESS, 0    },  // Solid purple
+    /* SEARCHING    */ { COLOR_RED,    COLOR_OFF,    1000, 500,  LED_BRIGHTNESS, 0    },  // Slow blink red
+    /* ERROR        */ { COLOR_RED,    COLOR_OFF,    200,  100,  LED_BRIGHTNESS, 0    },  // Fast blink red
+    /* CONNECTED    */ { COLOR_GREEN,  COLOR_GREEN,  2000, 1950, 20,             0    },  // Brief dim every 2s
+    /* TRANSMITTING */ { COLOR_CYAN,   COLOR_OFF,    300,  150,  LED_BRIGHTNESS, 0    },  // Fast pulse cyan
+    /* SEND_SUCCESS */ { COLOR_GREEN,  COLOR_GREEN,  0,    0,    LED_BRIGHTNESS, 3000 },  // Solid green 3s
+    /* SEND_FAILED  */ { COLOR_BLUE,   COLOR_OFF,    2000, 1000, LED_BRIGHTNESS, 0    },  // Slow blink blue
+    /* OTA_MODE     */ { COLOR_YELLOW, COLOR_ORANGE, 400,  200,  LED_BRIGHTNESS, 0    },  // Yellow/orange pulse
+    /* BUTTON_ACK   */ { COLOR_WHITE,  COLOR_WHITE,  0,    0,    LED_BRIGHTNESS, 200  },  // White flash
+};
+static_assert(sizeof(LED_PATTERNS) / sizeof(LED_PATTERNS[0]) == LED_STATUS_BUTTON_ACK + 1,
+              "LED_PATTERNS must have one entry per LedStatus");
+
+// One-shot overlay (e.g. OTA chunk progress) drawn on top of the pattern
+static CRGB g_ledPulseColor = COLOR_OFF;
+static volatile uint32_t g_ledPulseUntil = 0;     // millis() deadline, 0 = none
+
+static esp_timer_handle_t g_ledTimer = nullptr;
+static CRGB g_ledShownColor = COLOR_OFF;          // Last output, to skip redundant shows
+static uint8_t g_ledShownBrightness = 0;
+
+// Render the current pattern - runs in the esp_timer task every LED_TICK_MS
+static void ledRenderTick(void* arg) {
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&g_ledMux);
+    LedStatus status = g_ledStatus;
+    uint32_t elapsed = now - g_ledStatusSince;
+    const LedPattern& pattern = LED_PATTERNS[status];
+    if (pattern.holdMs > 0 && elapsed >= pattern.holdMs) {
+        // Temporary status expired - fall back to network state
+        status = g_networkReady ? LED_STATUS_CONNECTED : LED_STATUS_SEARCHING;
+        g_ledStatus = status;
+        g_ledStatusSince = now;
+        elapsed = 0;
+    }
+    bool pulsing = g_ledPulseUntil != 0 && (int32_t)(g_ledPulseUntil - now) > 0;
+    CRGB pulseColor = g_ledPulseColor;
+    portEXIT_CRITICAL(&g_ledMux);
+
+    const LedPattern& p = LED_PATTERNS[status];
+    CRGB color = p.onColor;
+    uint8_t brightness = LED_BRIGHTNESS;
+    if (pulsing) {
+        color = pulseColor;
+    } else if (p.periodMs > 0 && (elapsed % p.periodMs) >= p.onMs) {
+        color = p.offColor;
+        brightness = p.offBrightness;
+    }
+
+    if (color == g_ledShownColor && brightness == g_ledShownBrightness) return;
+    g_ledShownColor = color;
+    g_ledShownBrightness = brightness;
+    g_leds[0] = color;
+    FastLED.setBrightness(brightness);
+    FastLED.show();
+}
+
 static void ledInit() {
     FastLED.addLeds<WS2812, LED_PIN, GRB>(g_leds, NUM_LEDS);
-    FastLED.setBrightness(50);  // Moderate brightness to save power
+    FastLED.setBrightness(LED_BRIGHTNESS);
     g_leds[0] = COLOR_OFF;
     FastLED.show();
-}
 
-static void ledSetColor(CRGB color) {
-    g_leds[0] = color;
-    FastLED.show();
+    const esp_timer_create_args_t timerArgs = {
+        .callback = &ledRenderTick,
+        .arg = nullptr,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "led",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&timerArgs, &g_ledTimer);
+    esp_timer_start_periodic(g_ledTimer, LED_TICK_MS * 1000ULL);
 }
 
 static void ledSetStatus(LedStatus status) {
+    portENTER_CRITICAL(&g_ledMux);
     g_ledStatus = status;
-    g_lastLedUpdate = millis();
-    g_ledBlinkState = true;
-
-    // Set initial color based on status
-    switch (status) {
-        case LED_STATUS_BOOTING:
-            ledSetColor(COLOR_PURPLE);
-            break;
-        case LED_STATUS_SEARCHING:
-            ledSetColor(COLOR_RED);
-            break;
-        case LED_STATUS_ERROR:
-            ledSetColor(COLOR_RED);
-            break;
-        case LED_STATUS_CONNECTED:
-            ledSetColor(COLOR_GREEN);
-            break;
-        case LED_STATUS_TRANSMITTING:
-            ledSetColor(COLOR_CYAN);
-            break;
-        case LED_STATUS_SEND_SUCCESS:
-            ledSetColor(COLOR_GREEN);
-            break;
-        case LED_STATUS_SEND_FAILED:
-            ledSetColor(COLOR_BLUE);
-            break;
-        case LED_STATUS_OTA_MODE:
-            ledSetColor(COLOR_YELLOW);
-            break;
-        case LED_STATUS_BUTTON_ACK:
-            ledSetColor(COLOR_WHITE);
-            break;
-    }
+    g_ledStatusSince = millis();
+    portEXIT_CRITICAL(&g_ledMux);
 }
 
-// Update LED animation (call from loop)
-static void ledUpdate() {
-    uint32_t now = millis();
-    uint32_t elapsed = now - g_lastLedUpdate;
-
-    switch (g_ledStatus) {
-        case LED_STATUS_BOOTING:
-            // Solid purple - no animation
-            break;
-
-        case LED_STATUS_SEARCHING:
-            // Slow blink red (500ms on, 500ms off)
-            if (elapsed >= 500) {
-                g_lastLedUpdate = now;
-                g_ledBlinkState = !g_ledBlinkState;
-                ledSetColor(g_ledBlinkState ? COLOR_RED : COLOR_OFF);
-            }
-            break;
+// Show a color briefly on top of the current pattern (non-blocking)
+static void ledPulse(CRGB color, uint16_t ms) {
+    portENTER_CRITICAL(&g_ledMux);
+    g_ledPulseColor = color;
+    g_ledPulseUntil = (millis() + ms) | 1;  // Never 0 (0 = no pulse)
+    portEXIT_CRITICAL(&g_ledMux);
+}
 
-        case LED_STATUS_ERROR:
-            // Fast blink red (100ms on, 100ms off)
-            if (elapsed >= 100) {
-                g_lastLedUpdate = now;
-                g_ledBlinkState = !g_ledBlinkState;
-                ledSetColor(g_ledBlinkState ? COLOR_RED : COLOR_OFF);
-            }
-            break;
+// =============================================================================
+// Event Scheduler - timer wheel and event queue for the loop task
+// =============================================================================
+// Subsystems register one-shot or periodic timers instead of polling their own
+// g_last* timestamps every 10 ms. Timers sit in a three-level hierarchical
+// wheel (64 slots per level, 10 ms ticks: 640 ms / 41 s / 44 min spans;
+// longer deadlines park in the top level and are re-filed as it turns), so
+// arming, cancelling and expiring are O(1). Interrupts and other tasks post
+// events to a queue; the loop task sleeps until the next deadline or event.
+// Each timer keeps fire/miss counts: a timer dispatched more than
+// SCHED_LATE_TOLERANCE_MS after its deadline (typically behind a report
+// cycle) counts as missed, and periodic timers skip the periods they slept
+// through rather than firing in a burst. The wheel itself is in
+// include/sched_wheel.h; the tick source and event queue live here.
+
+#define SCHED_EVENT_QUEUE_LEN    16
+
+enum SchedEvent {
+    SCHED_EVENT_BUTTON = 1,     // A button pin changed level (ISR)
+    SCHED_EVENT_REPORT_NOW,     // Out-of-cycle report requested
+};
 
-        case LED_STATUS_CONNECTED:
-            // Solid cyan with brief dim every 2s to show alive
-            if (elapsed >= 2000) {
-                g_lastLedUpdate = now;
-                FastLED.setBrightness(20);
-                FastLED.show();
-                delay(50);
-                FastLED.setBrightness(50);
-                FastLED.show();
-            }
-            break;
+static QueueHandle_t g_schedEvents = nullptr;
 
-        case LED_STATUS_TRANSMITTING:
-            // Fast pulse cyan
-            if (elapsed >= 150) {
-                g_lastLedUpdate = now;
-                g_ledBlinkState = !g_ledBlinkState;
-                ledSetColor(g_ledBlinkState ? COLOR_CYAN : COLOR_OFF);
-            }
-            break;
+// Tick from the 64-bit microsecond clock, truncated: wraps at 2^32 ticks
+// (497 days) in step with the wheel, where millis() / 10 would wrap at
+// 429496729 after 49.7 days and strand every timer filed past it
+static inline uint32_t schedTickNow() {
+    return (uint32_t)(esp_timer_get_time() / (SCHED_TICK_MS * 1000));
+}
 
-        case LED_STATUS_SEND_SUCCESS:
-            // Solid green for 3 seconds, then return to connected
-            if (elapsed >= 3000) {
-                ledSetStatus(LED_STATUS_CONNECTED);
-            }
-            break;
+static void schedPost(uint8_t event) {
+    if (g_schedEvents) xQueueSend(g_schedEvents, &event, 0);
+}
 
-        case LED_STATUS_SEND_FAILED:
-            // Slow blink blue (1s on, 1s off)
-            if (elapsed >= 1000) {
-                g_lastLedUpdate = now;
-                g_ledBlinkState = !g_ledBlinkState;
-                ledSetColor(g_ledBlinkState ? COLOR_BLUE : COLOR_OFF);
-            }
-            break;
+static void IRAM_ATTR schedPostFromIsr(uint8_t event) {
+    BaseType_t woken = pdFALSE;
+    if (g_schedEvents) xQueueSendFromISR(g_schedEvents, &event, &woken);
+    portYIELD_FROM_ISR(woken);
+}
 
-        case LED_STATUS_OTA_MODE:
-            // Fast pulse yellow
-            if (elapsed >= 200) {
-                g_lastLedUpdate = now;
-                g_ledBlinkState = !g_ledBlinkState;
-                ledSetColor(g_ledBlinkState ? COLOR_YELLOW : COLOR_ORANGE);
-            }
-            break;
+static void schedInit() {
+    g_schedEvents = xQueueCreate(SCHED_EVENT_QUEUE_LEN, sizeof(uint8_t));
+    g_schedNow = schedTickNow();
+}
 
-        case LED_STATUS_BUTTON_ACK:
-            // White flash, then return to previous state
-            if (elapsed >= 200) {
-                ledSetStatus(g_networkReady ? LED_STATUS_CONNECTED : LED_STATUS_SEARCHING);
-            }
-            break;
+// One line of per-timer stats: name fired/missed/worst lateness
+static void schedLogStats() {
+    char line[256];
+    size_t n = snprintf(line, sizeof(line), "[SCHED]");
+    for (uint8_t i = 0; i < g_schedTimerCount && n < sizeof(line); i++) {
+        const SchedTimer* t = g_schedTimers[i];
+        n += snprintf(line + n, sizeof(line) - n, " %s:%lu/%lu/%lums",
+                      t->name, t->fired, t->missed, t->maxLateMs);
     }
+    LOGI("%s\n", line);
 }
 
-// Brief flash for activity indication (non-blocking setup)
-static void ledFlash(CRGB color, int count, int onMs) {
-    for (int i = 0; i < count; i++) {
-        ledSetColor(color);
-        delay(onMs);
-        ledSetColor(COLOR_OFF);
-        if (i < count - 1) delay(onMs);
-    }
-    // Restore status color
-    ledSetStatus(g_ledStatus);
+// Timers owned by the loop task (callbacks bound in setup)
+static SchedTimer g_reportTimer;
+static SchedTimer g_uplinkTimer;
+static SchedTimer g_heartbeatTimer;
+static SchedTimer g_statusTimer;
+static SchedTimer g_urcTimer;
+static SchedTimer g_radioSliceTimer;
+static SchedTimer g_channelHopTimer;
+static SchedTimer g_otaServerTimer;
+static SchedTimer g_otaTimeoutTimer;
+
+// Out-of-cycle report: the loop acts on the flag, the event wakes it up
+static void requestReportNow() {
+    g_forceSendRequested = true;
+    schedPost(SCHED_EVENT_REPORT_NOW);
 }
 
+// (Re)arm the report, uplink, heartbeat and status timers - boot and after AP OTA
+static void loopTimersStart();
+
 // =============================================================================
 // WiFi Promiscuous Mode - Probe Request Capture
 // =============================================================================
 
-// 802.11 frame type definitions
-#define WIFI_MGMT_FRAME     0
-#define WIFI_PROBE_REQUEST  4
-#define WIFI_BEACON         8
+// =============================================================================
+// Live Occupancy - sliding window of per-minute distinct-count sketches
+// =============================================================================
+// "Distinct devices seen in the last N minutes at or above zone Z" from one
+// small HyperLogLog per minute per RSSI zone. Sketches merge by register-wise
+// max, so a query folds at most OCC_WINDOW_SLOTS x OCC_ZONES sketches -
+// constant time and a fixed 7.5 KB regardless of traffic. With 64 registers
+// the standard error is ~13% (exact-ish below ~100 devices via linear counting).
+// Slots are written under g_probeMux by the capture callback.
+
+#define OCC_WINDOW_SLOTS    60      // One-minute slots kept
+#define OCC_REGISTERS       64      // HLL registers per sketch (4-bit, packed)
+#define OCC_ZONES           4       // Immediate, near, far, remote
+#define OCC_REPORT_WINDOW_MIN 15    // Window for the reading's "occupancy" field
+#define OCC_REPORT_MIN_ZONE   OCC_ZONE_NEAR  // ...counting near and closer ("in store")
+
+enum OccupancyZone { OCC_ZONE_IMMEDIATE = 0, OCC_ZONE_NEAR, OCC_ZONE_FAR, OCC_ZONE_REMOTE };
+
+struct OccupancySlot {
+    uint32_t minuteTag;                             // Minute + 1 the slot holds, 0 = empty
+    uint8_t regs[OCC_ZONES][OCC_REGISTERS / 2];     // Two 4-bit registers per byte
+};
 
-// Check if MAC address is randomized (locally administered)
-// Bit 1 of first byte: 0 = globally unique (static), 1 = locally administered (randomized)
-static inline bool isRandomizedMac(const uint8_t* mac) {
-    return (mac[0] & 0x02) != 0;
+static OccupancySlot g_occSlots[OCC_WINDOW_SLOTS];
+
+// Record a device in this minute's sketch for its zone (call under g_probeMux).
+// The fingerprint is a keyed hash already, so its bits feed the HLL directly.
+static void IRAM_ATTR occupancyAdd(uint32_t fp, uint8_t zone, uint32_t minute) {
+    OccupancySlot& slot = g_occSlots[minute % OCC_WINDOW_SLOTS];
+    if (slot.minuteTag != minute + 1) {
+        memset(slot.regs, 0, sizeof(slot.regs));
+        slot.minuteTag = minute + 1;
+    }
+    uint32_t h = fp;
+    uint8_t idx = h % OCC_REGISTERS;
+    uint32_t w = h / OCC_REGISTERS;
+    uint8_t rank = (uint8_t)(__builtin_ctz(w | 0x80000000u) + 1);
+    if (rank > 15) rank = 15;
+    uint8_t& cell = slot.regs[zone][idx / 2];
+    uint8_t shift = (idx & 1) ? 4 : 0;
+    if (((cell >> shift) & 0x0F) < rank) {
+        cell = (uint8_t)((cell & ~(0x0F << shift)) | (rank << shift));
+    }
 }
 
-// WiFi promiscuous callback - called from WiFi task context
-static void IRAM_ATTR wifiProbeCounterCallback(void* buf, wifi_promiscuous_pkt_type_t type) {
-    if (type != WIFI_PKT_MGMT) return;
-
-    const wifi_promiscuous_pkt_t* pkt = (wifi_promiscuous_pkt_t*)buf;
-    const uint8_t* frame = pkt->payload;
-    const int len = pkt->rx_ctrl.sig_len;
-
-    // Need at least frame control + duration + 3 addresses (24 bytes)
-    if (len < 24) return;
-
-    // Frame control field (first 2 bytes)
-    uint8_t frameType = (frame[0] >> 2) & 0x03;     // bits 2-3
-    uint8_t frameSubtype = (frame[0] >> 4) & 0x0F;  // bits 4-7
-
-    // Only process management frames
-    if (frameType != WIFI_MGMT_FRAME) return;
+// Distinct devices seen in the last windowMin minutes at minZone or closer
+static uint32_t occupancyEstimate(uint8_t windowMin, uint8_t minZone) {
+    if (windowMin > OCC_WINDOW_SLOTS) windowMin = OCC_WINDOW_SLOTS;
+    if (minZone >= OCC_ZONES) minZone = OCC_ZONES - 1;
+    uint32_t nowMinute = millis() / 60000;
+    uint8_t merged[OCC_REGISTERS] = {};
 
-    // Handle beacon frames (access point counting)
-    if (frameSubtype == WIFI_BEACON && g_countAccessPoints) {
-        // BSSID is at bytes 16-21 in beacon frame
-        const uint8_t* bssid = &frame[16];
-        uint64_t bssidVal = 0;
-        for (int i = 0; i < 6; i++) {
-            bssidVal = (bssidVal << 8) | bssid[i];
+    portENTER_CRITICAL(&g_probeMux);
+    for (uint8_t back = 0; back < windowMin && back <= nowMinute; back++) {
+        uint32_t minute = nowMinute - back;
+        const OccupancySlot& slot = g_occSlots[minute % OCC_WINDOW_SLOTS];
+        if (slot.minuteTag != minute + 1) continue;
+        for (uint8_t z = 0; z <= minZone; z++) {
+            for (uint8_t i = 0; i < OCC_REGISTERS; i++) {
+                uint8_t r = (slot.regs[z][i / 2] >> ((i & 1) ? 4 : 0)) & 0x0F;
+                if (r > merged[i]) merged[i] = r;
+            }
         }
+    }
+    portEXIT_CRITICAL(&g_probeMux);
 
-        portENTER_CRITICAL(&g_probeMux);
-        addUniqueMac(g_uniqueAPs, &g_uniqueAPCount, MAX_UNIQUE_APS, bssidVal);
-        portEXIT_CRITICAL(&g_probeMux);
-        return;
+    float sum = 0.0f;
+    uint8_t zeros = 0;
+    for (uint8_t i = 0; i < OCC_REGISTERS; i++) {
+        sum += 1.0f / (float)(1u << merged[i]);
+        if (merged[i] == 0) zeros++;
     }
+    const float m = OCC_REGISTERS;
+    float estimate = 0.709f * m * m / sum;      // alpha_64
+    if (estimate <= 2.5f * m && zeros > 0) {
+        estimate = m * logf(m / zeros);          // Linear counting for small counts
+    }
+    return (uint32_t)(estimate + 0.5f);
+}
 
-    // Filter for probe requests only (subtype=4)
-    if (frameSubtype != WIFI_PROBE_REQUEST) return;
+// =============================================================================
+// Presence Sessions
+// =============================================================================
+// Unlike the per-epoch dwell buckets, sessions survive report boundaries: a
+// device's session runs from the first probe until it has gone unheard for
+// SESSION_GAP_MIN minutes, then closes into a compact record (start minute,
+// duration, closest zone reached) in a bounded ring. Records ride along with
+// the next live reading and are dropped once the backend accepted it, so
+// arrival curves and visit lengths leave the device without any MAC.
+// Active sessions live in a linear-probing hash table keyed on the
+// fingerprint, searched at most SESSION_PROBE_MAX slots from home, so a
+// probe costs a few slots rather than a full-table scan under the lock.
+// Active sessions and the ring are protected by g_probeMux.
+
+#define SESSION_ACTIVE_SLOTS 256    // Devices tracked concurrently (power of two)
+#define SESSION_PROBE_MAX    8      // Slots searched from a device's home slot
+#define SESSION_RING_SIZE    64     // Closed sessions awaiting upload
+#define SESSION_GAP_MIN      5      // Unheard this long = left
+#define SESSION_UPLOAD_MAX   32     // Records per reading
+#define READING_SEND_CHUNK   1024   // Bytes per AT+CIPSEND for a reading
+
+struct ActiveSession {
+    uint32_t fp;                    // Device fingerprint, 0 = free slot
+    uint32_t firstMinute;           // millis() minute of first probe
+    uint32_t lastMinute;            // millis() minute of latest probe
+    uint8_t bestZone;               // Closest OccupancyZone seen
+};
 
-    // Extract source MAC address (bytes 10-15 in 802.11 header)
-    // Header: FC(2) + Duration(2) + DA(6) + SA(6) + BSSID(6) + SeqCtrl(2)
-    const uint8_t* srcMac = &frame[10];
+struct SessionRecord {
+    uint32_t startMinute;           // millis() minute the session started
+    uint16_t durationMin;           // Minutes from first to last probe, inclusive
+    uint8_t bestZone;
+};
 
-    // Privacy filter: Only count randomized MACs
-    // Static MACs are globally unique (PII) - we reject them
-#if PRIVACY_FILTER_ENABLED
-    if (!isRandomizedMac(srcMac)) {
-        portENTER_CRITICAL(&g_probeMux);
-        g_filteredStatic++;
-        portEXIT_CRITICAL(&g_probeMux);
-        return;
+static ActiveSession g_sessionActive[SESSION_ACTIVE_SLOTS];
+static SessionRecord g_sessionRing[SESSION_RING_SIZE];
+static uint32_t g_sessionHead = 0;      // Records ever closed (write position)
+static uint32_t g_sessionTail = 0;      // Records uploaded or dropped (read position)
+static uint32_t g_sessionDropped = 0;   // Lost to ring overflow since last upload
+static uint32_t g_sessionDroppedSent = 0;   // Of those, reported by the upload in flight
+
+static void IRAM_ATTR sessionClose(const ActiveSession& a) {
+    SessionRecord& rec = g_sessionRing[g_sessionHead % SESSION_RING_SIZE];
+    rec.startMinute = a.firstMinute;
+    uint32_t duration = a.lastMinute - a.firstMinute + 1;
+    rec.durationMin = duration > 0xFFFF ? 0xFFFF : (uint16_t)duration;
+    rec.bestZone = a.bestZone;
+    g_sessionHead++;
+    if (g_sessionHead - g_sessionTail > SESSION_RING_SIZE) {
+        g_sessionTail = g_sessionHead - SESSION_RING_SIZE;  // Oldest record lost
+        g_sessionDropped++;
     }
-#endif
+}
 
-    // Note: WiFi probe requests don't reliably indicate device type
-    // OS classification now done via BLE manufacturer IDs
+static_assert((SESSION_ACTIVE_SLOTS & (SESSION_ACTIVE_SLOTS - 1)) == 0,
+              "SESSION_ACTIVE_SLOTS must be a power of two");
+
+// Home slot from the fingerprint's high bits (occupancy uses the low ones)
+static inline uint32_t IRAM_ATTR sessionHome(uint32_t fp) {
+    return (fp >> 16) & (SESSION_ACTIVE_SLOTS - 1);
+}
 
-    // Convert MAC to uint64_t for set storage
-    uint64_t macVal = 0;
-    for (int i = 0; i < 6; i++) {
-        macVal = (macVal << 8) | srcMac[i];
+// Extend or open the session for a probing device (call under g_probeMux)
+static void IRAM_ATTR sessionTouch(uint32_t fp, uint8_t zone, uint32_t minute) {
+    uint32_t home = sessionHome(fp);
+    uint32_t stalest = home;
+    for (uint32_t k = 0; k < SESSION_PROBE_MAX; k++) {
+        uint32_t i = (home + k) & (SESSION_ACTIVE_SLOTS - 1);
+        ActiveSession& a = g_sessionActive[i];
+        if (a.fp == fp) {
+            a.lastMinute = minute;
+            if (zone < a.bestZone) a.bestZone = zone;
+            return;
+        }
+        if (a.fp == 0) {
+            stalest = i;    // End of the chain - fp is not in the table
+            break;
+        }
+        if (a.lastMinute < g_sessionActive[stalest].lastMinute) stalest = i;
     }
 
-    // Create dedup key: MAC (48 bits) + current minute (16 bits)
-    // This counts each device once per minute (MRC "opportunity to see" standard)
-    uint32_t currentMinute = millis() / 60000;
-    uint64_t dedupKey = macVal | ((uint64_t)(currentMinute & 0xFFFF) << 48);
+    ActiveSession& a = g_sessionActive[stalest];
+    if (a.fp != 0) {
+        sessionClose(a);    // Neighbourhood full - the stalest session makes room
+    }
+    a.fp = fp;
+    a.firstMinute = minute;
+    a.lastMinute = minute;
+    a.bestZone = zone;
+}
 
-    // Capture probe RSSI (WiFi signal strength from the phone)
-    int probeRssi = pkt->rx_ctrl.rssi;
+// Free slot i, pulling later chain members back so lookups never stop
+// early at the hole (backward-shift deletion; call under g_probeMux)
+static void sessionRemove(uint32_t i) {
+    const uint32_t mask = SESSION_ACTIVE_SLOTS - 1;
+    uint32_t hole = i;
+    for (uint32_t j = (i + 1) & mask; g_sessionActive[j].fp != 0; j = (j + 1) & mask) {
+        // Entry at j may fill the hole if its home is not in (hole, j]
+        uint32_t home = sessionHome(g_sessionActive[j].fp);
+        if (((j - home) & mask) >= ((j - hole) & mask)) {
+            g_sessionActive[hole] = g_sessionActive[j];
+            hole = j;
+        }
+        if (j == i) break;
+    }
+    g_sessionActive[hole].fp = 0;
+}
 
-    // Update counters with mutex protection
+// Minute tick: close sessions of devices unheard for SESSION_GAP_MIN
+static void sessionExpire() {
+    uint32_t nowMinute = millis() / 60000;
+    uint32_t closed = 0;
     portENTER_CRITICAL(&g_probeMux);
-    g_totalProbes++;
-    // Track overflow when cap is hit (data quality indicator)
-    if (!addUniqueMac(g_uniqueMacs, &g_uniqueMacCount, MAX_UNIQUE_MACS, dedupKey)) {
-        g_uniqueOverflow++;
-    }
-    // Track probe RSSI stats
-    g_probeRssiSum += probeRssi;
-    g_probeRssiCount++;
-    if (probeRssi < g_probeRssiMin || g_probeRssiMin == 0) {
-        g_probeRssiMin = probeRssi;
-    }
-    if (probeRssi > g_probeRssiMax) {
-        g_probeRssiMax = probeRssi;
-    }
-    // Categorize by RSSI distance zone (thresholds configurable via remote config)
-    if (probeRssi > g_rssiImmediateThreshold) {
-        g_rssi_immediate++;  // At Counter (very close, ~0-2m)
-    } else if (probeRssi > g_rssiNearThreshold) {
-        g_rssi_near++;       // In Store (near, ~2-5m)
-    } else if (probeRssi > g_rssiFarThreshold) {
-        g_rssi_far++;        // Window Shopping (far, ~5-15m)
-    } else {
-        g_rssi_remote++;     // Walking Past (remote, >15m)
-    }
-    // Track dwell time - record first and last minute each MAC was seen
-    uint16_t minuteVal = (uint16_t)(currentMinute & 0xFFFF);
-    int dwellIdx = findOrAddDwellEntry(macVal);
-    if (dwellIdx >= 0) {
-        if (g_dwellFirstSeen[dwellIdx] == 0 || g_dwellMacs[dwellIdx] != macVal) {
-            // New entry - first time seeing this MAC
-            g_dwellFirstSeen[dwellIdx] = minuteVal;
+    for (int i = 0; i < SESSION_ACTIVE_SLOTS; ) {
+        ActiveSession& a = g_sessionActive[i];
+        if (a.fp != 0 && nowMinute - a.lastMinute >= SESSION_GAP_MIN) {
+            sessionClose(a);
+            sessionRemove(i);   // May pull a later session into slot i - recheck it
+            closed++;
+        } else {
+            i++;
         }
-        g_dwellLastSeen[dwellIdx] = minuteVal;
     }
+    uint32_t pending = g_sessionHead - g_sessionTail;
     portEXIT_CRITICAL(&g_probeMux);
+    if (closed > 0) {
+        LOGD("[SESSION] Closed %lu, %lu awaiting upload\n", closed, pending);
+    }
 }
 
-static void startProbeCapture() {
-    Serial.println("[PROBE] Starting WiFi promiscuous mode...");
-
-    // Initialize WiFi in station mode first
-    WiFi.mode(WIFI_STA);
-    WiFi.disconnect();
-    delay(100);
+// Append ,"ss":[[start,dur,zone],...] with up to SESSION_UPLOAD_MAX pending
+// records (start in Unix minutes) and return the ring position to release
+// once the upload succeeded
+static uint32_t sessionFormat(char* out, size_t outSize, uint32_t unixNowMinute) {
+    SessionRecord batch[SESSION_UPLOAD_MAX];
+    uint32_t dropped;
+    portENTER_CRITICAL(&g_probeMux);
+    uint32_t from = g_sessionTail;
+    uint32_t count = g_sessionHead - from;
+    if (count > SESSION_UPLOAD_MAX) count = SESSION_UPLOAD_MAX;
+    for (uint32_t i = 0; i < count; i++) {
+        batch[i] = g_sessionRing[(from + i) % SESSION_RING_SIZE];
+    }
+    dropped = g_sessionDropped;
+    portEXIT_CRITICAL(&g_probeMux);
 
-    // Initialize channel hopping state
-    g_currentChannelIndex = 0;
-    g_lastChannelHop = millis();
-    esp_wifi_set_channel(WIFI_CHANNELS[g_currentChannelIndex], WIFI_SECOND_CHAN_NONE);
+    out[0] = '\0';
+    g_sessionDroppedSent = 0;
+    if (count == 0 && dropped == 0) return from;
+
+    uint32_t nowMinute = millis() / 60000;
+    size_t n = snprintf(out, outSize, ",\"ss\":[");
+    for (uint32_t i = 0; i < count && n < outSize; i++) {
+        uint32_t start = unixNowMinute - (nowMinute - batch[i].startMinute);
+        n += snprintf(out + n, outSize - n, "%s[%lu,%u,%u]", i ? "," : "",
+                      start, batch[i].durationMin, batch[i].bestZone);
+    }
+    if (n < outSize) n += snprintf(out + n, outSize - n, "]");
+    if (dropped > 0 && n < outSize) n += snprintf(out + n, outSize - n, ",\"sd\":%lu", dropped);
+    if (n >= outSize) {
+        out[0] = '\0';  // Doesn't fit - keep the records for the next reading
+        g_sessionDroppedSent = 0;
+        return from;
+    }
+    g_sessionDroppedSent = dropped;
+    return from + count;
+}
 
-    // Configure promiscuous filter for management frames only
-    wifi_promiscuous_filter_t filter = {
-        .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT
-    };
-    esp_wifi_set_promiscuous_filter(&filter);
-
-    // Register callback and enable promiscuous mode
-    esp_wifi_set_promiscuous_rx_cb(&wifiProbeCounterCallback);
-    esp_wifi_set_promiscuous(true);
+// Upload accepted - drop the records it carried
+static void sessionRelease(uint32_t upTo) {
+    portENTER_CRITICAL(&g_probeMux);
+    if ((int32_t)(upTo - g_sessionTail) > 0) g_sessionTail = upTo;
+    g_sessionDropped -= g_sessionDroppedSent;
+    g_sessionDroppedSent = 0;
+    portEXIT_CRITICAL(&g_probeMux);
+}
 
-    Serial.printf("[PROBE] Channel hopping enabled: 1, 6, 11 (3s interval)\n");
-    Serial.printf("[PROBE] Starting on channel %d\n", WIFI_CHANNELS[g_currentChannelIndex]);
+// =============================================================================
+// Device Fingerprints - salted 32-bit keys instead of raw MACs
+// =============================================================================
+// Dedup, dwell, session and sequence tables key devices by HalfSipHash-2-4 of
+// the address under a random 64-bit salt that never leaves RAM and rotates
+// daily, so tables hold no raw identifiers and a fingerprint can't be linked
+// across days. At 32 bits the tables are half the size of 64-bit MAC keys.
+// Collisions: with n keys in a table the expected number of colliding pairs
+// is n^2 / 2^33 - about 0.001 for a full 3000-entry epoch, i.e. a one-device
+// undercount roughly once every 1000 saturated epochs.
+
+#define FP_ROTATE_DAILY true
+
+static uint32_t g_fpKey[2];             // HalfSipHash key (the salt)
+static uint32_t g_fpKeyDay = 0;         // Day index the salt was drawn for
+static bool g_fpKeyDayKnown = false;    // Boot salt not yet tied to a day
+static bool g_fpKeyDayCalendar = false; // g_fpKeyDay is a Unix day, not an uptime day
+
+// Fingerprint of a 6-byte address, optionally bound to a minute (per-minute
+// dedup keys). Never 0 - tables use 0 for a free slot.
+static uint32_t IRAM_ATTR fingerprintOf(const uint8_t* mac, bool withMinute, uint16_t minute) {
+    uint8_t buf[8];
+    memcpy(buf, mac, 6);
+    buf[6] = (uint8_t)minute;
+    buf[7] = (uint8_t)(minute >> 8);
+    uint32_t fp = halfSipHash24(g_fpKey, buf, withMinute ? 8 : 6);
+    return fp ? fp : 1;
 }
 
-static void stopProbeCapture() {
-    esp_wifi_set_promiscuous(false);
-    Serial.println("[PROBE] Promiscuous mode stopped");
+static void fingerprintNewSalt(uint32_t day) {
+    g_fpKey[0] = esp_random();
+    g_fpKey[1] = esp_random();
+    g_fpKeyDay = day;
 }
 
-// Channel hopping - call from main loop
-static void updateChannelHop() {
-    uint32_t now = millis();
-    if ((now - g_lastChannelHop) >= CHANNEL_HOP_INTERVAL_MS) {
-        g_lastChannelHop = now;
-        g_currentChannelIndex = (g_currentChannelIndex + 1) % WIFI_CHANNEL_COUNT;
-        esp_wifi_set_channel(WIFI_CHANNELS[g_currentChannelIndex], WIFI_SECOND_CHAN_NONE);
+// Draw a new salt when the day changes. Call between epochs (capture stopped):
+// fingerprints in the session and occupancy tables become meaningless, so
+// open sessions are closed and the occupancy window restarts. calendar says
+// whether day is a Unix day or, before the clock syncs, an uptime day.
+static void fingerprintMaybeRotate(uint32_t day, bool calendar) {
+    if (!g_fpKeyDayKnown || calendar != g_fpKeyDayCalendar) {
+        // Boot salt is fresh, or the same day renumbered by a clock sync - adopt it
+        g_fpKeyDay = day;
+        g_fpKeyDayKnown = true;
+        g_fpKeyDayCalendar = calendar;
+        return;
     }
+    if (!FP_ROTATE_DAILY || day == g_fpKeyDay) return;
+    portENTER_CRITICAL(&g_probeMux);
+    fingerprintNewSalt(day);
+    for (int i = 0; i < SESSION_ACTIVE_SLOTS; i++) {
+        if (g_sessionActive[i].fp != 0) {
+            sessionClose(g_sessionActive[i]);
+            g_sessionActive[i].fp = 0;
+        }
+    }
+    memset(g_occSlots, 0, sizeof(g_occSlots));
+    portEXIT_CRITICAL(&g_probeMux);
+    LOGI("[FP] Fingerprint salt rotated (day %lu)\n", day);
 }
 
 // =============================================================================
-// BLE Passive Scanning - Accurate OS Detection via Manufacturer IDs
+// Counting Engine - one counter template for WiFi and BLE
 // =============================================================================
+// Impressions, per-minute uniques and RSSI stats are common to both radios;
+// RSSI zones, dwell buckets and device classification are opt-in features
+// picked at compile time. Features an instantiation leaves out cost neither
+// code nor RAM: each maps to a storage block that is empty when disabled.
+// KeyPolicy turns a raw address into the device/dedup keys (hashed before
+// the caller takes its mutex). The engine does no locking itself - WiFi and
+// BLE instances are guarded by g_probeMux and g_bleMux as before.
+
+struct FeatureZones {};                                      // RSSI distance zones
+template <uint16_t Entries> struct FeatureDwell {};          // Dwell buckets, Entries devices
+struct FeatureClassify {};                                   // Apple / Other per new device
+
+#define MAX_DWELL_ENTRIES 2000      // WiFi devices tracked for dwell per epoch
+#define BLE_DWELL_ENTRIES 1000      // BLE devices tracked for dwell per epoch
+
+template <typename F, typename... Fs> struct HasFeature { static const bool value = false; };
+template <typename F, typename... Rest> struct HasFeature<F, F, Rest...> { static const bool value = true; };
+template <typename F, typename G, typename... Rest>
+struct HasFeature<F, G, Rest...> { static const bool value = HasFeature<F, Rest...>::value; };
+
+template <typename... Fs> struct DwellEntriesOf { static const uint16_t value = 0; };
+template <uint16_t N, typename... Rest>
+struct DwellEntriesOf<FeatureDwell<N>, Rest...> { static const uint16_t value = N; };
+template <typename F, typename... Rest>
+struct DwellEntriesOf<F, Rest...> { static const uint16_t value = DwellEntriesOf<Rest...>::value; };
+
+struct DeviceKeys {
+    uint32_t device;   // Stable for the day (dwell, sessions, occupancy)
+    uint32_t dedup;    // Device-minute key for per-minute uniques
+};
 
-// NimBLE advertised device callback
-class BleAdvertisedDeviceCallbacks : public NimBLEAdvertisedDeviceCallbacks {
-    void onResult(NimBLEAdvertisedDevice* advertisedDevice) override {
-        // Get address (check for randomized MAC)
-        NimBLEAddress addr = advertisedDevice->getAddress();
-        uint8_t addrType = addr.getType();
+// Salted fingerprints of the address (see Device Fingerprints)
+struct SaltedFingerprintKeys {
+    static DeviceKeys of(const uint8_t* addr, uint32_t minute) {
+        DeviceKeys k;
+        k.device = fingerprintOf(addr, false, 0);
+        k.dedup = fingerprintOf(addr, true, (uint16_t)minute);
+        return k;
+    }
+};
 
-        // Only count randomized addresses (privacy filter)
-        // Type 1 = Random Address, Type 0 = Public Address
-        if (addrType == 0) {
-            // Public (static) address - skip for privacy
-            return;
+// Epoch totals handed over by takeAndReset; disabled features read as 0
+struct CountSnapshot {
+    uint32_t impressions;
+    uint32_t unique;
+    uint16_t overflow;      // New devices dropped because the table was full
+    int rssiAvg;
+    int rssiMin;
+    int rssiMax;
+    uint32_t zones[4];      // Indexed by OccupancyZone
+    uint32_t dwell[4];      // Short, medium, long, loyal (configurable thresholds)
+    uint32_t apple;
+    uint32_t other;
+};
+
+// Feature storage - primary templates are the disabled (empty) variants
+
+// RSSI distance zones (proves viewability), default thresholds:
+// - Immediate: > -50 dBm (within ~2m, very close)
+// - Near: -50 to -65 dBm (~2-5m, clearly visible)
+// - Far: -65 to -80 dBm (~5-15m, in vicinity)
+// - Remote: < -80 dBm (>15m, passing by)
+template <bool Enabled> struct EngineZones {
+    void add(uint8_t) {}
+    void take(CountSnapshot*) {}
+};
+template <> struct EngineZones<true> {
+    uint32_t counts[4];
+    void add(uint8_t zone) { counts[zone]++; }
+    void take(CountSnapshot* s) {
+        memcpy(s->zones, counts, sizeof(counts));
+        memset(counts, 0, sizeof(counts));
+    }
+};
+
+// Dwell buckets - engagement levels by distinct minutes seen, default thresholds:
+// - 0-1 min: Drive-by traffic (saw device in only 1 minute)
+// - 1-5 min: Brief stop (2-5 distinct minutes)
+// - 5-10 min: Engaged visitor
+// - 10+ min: Highly engaged (lingered 10+ minutes)
+template <uint16_t Entries> struct EngineDwell {
+    // Parallel arrays instead of std::map to prevent heap fragmentation
+    uint32_t keys[Entries];
+    uint16_t firstSeen[Entries];
+    uint16_t lastSeen[Entries];
+    uint16_t count;
+
+    void add(uint32_t key, uint32_t minute) {
+        uint16_t minuteVal = (uint16_t)(minute & 0xFFFF);
+        for (uint16_t i = 0; i < count; i++) {
+            if (keys[i] == key) {
+                lastSeen[i] = minuteVal;
+                return;
+            }
         }
+        if (count < Entries) {
+            keys[count] = key;
+            firstSeen[count] = minuteVal;
+            lastSeen[count] = minuteVal;
+            count++;
+        }
+    }
 
-        // Get MAC as bytes
-        const uint8_t* macBytes = addr.getNative();
-        uint64_t macVal = 0;
-        for (int i = 0; i < 6; i++) {
-            macVal = (macVal << 8) | macBytes[i];
+    // Bucket each device by the minutes it was seen (lastSeen - firstSeen + 1)
+    void take(CountSnapshot* s) {
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t firstMin = firstSeen[i];
+            uint16_t lastMin = lastSeen[i];
+            // Handle minute wrap-around (unlikely in one epoch but safe)
+            int duration = (lastMin >= firstMin) ? (lastMin - firstMin + 1) : 1;
+            if (duration <= g_dwellShortThreshold) {
+                s->dwell[0]++;      // Quick Glance
+            } else if (duration <= g_dwellMediumThreshold) {
+                s->dwell[1]++;      // Browsing
+            } else if (duration <= g_dwellLongThreshold) {
+                s->dwell[2]++;      // Shopping
+            } else {
+                s->dwell[3]++;      // Loyal Customer
+            }
         }
+        count = 0;  // Reset array count (no heap ops)
+    }
+};
+template <> struct EngineDwell<0> {
+    void add(uint32_t, uint32_t) {}
+    void take(CountSnapshot*) {}
+};
 
-        // Per-minute deduplication (same as WiFi probes)
-        uint32_t currentMinute = millis() / 60000;
-        uint64_t dedupKey = macVal | ((uint64_t)(currentMinute & 0xFFFF) << 48);
+template <bool Enabled> struct EngineClassify {
+    void add(DeviceType) {}
+    void take(CountSnapshot*) {}
+};
+template <> struct EngineClassify<true> {
+    uint32_t apple;
+    uint32_t other;
+    void add(DeviceType type) {
+        if (type == DEVICE_APPLE) {
+            apple++;
+        } else {
+            other++;
+        }
+    }
+    void take(CountSnapshot* s) {
+        s->apple = apple;
+        s->other = other;
+        apple = 0;
+        other = 0;
+    }
+};
 
-        // Get signal strength
-        int rssi = advertisedDevice->getRSSI();
+template <uint16_t Capacity, typename KeyPolicy, typename... Features>
+class CountingEngine {
+public:
+    struct Observation {
+        uint8_t zone;   // OccupancyZone of this sighting
+        bool isNew;     // First sighting of the device this minute
+    };
 
-        // Classify by manufacturer ID
-        DeviceType deviceType = DEVICE_OTHER;
-        if (advertisedDevice->haveManufacturerData()) {
-            std::string mfgData = advertisedDevice->getManufacturerData();
-            if (mfgData.length() >= 2) {
-                // Manufacturer ID is little-endian first 2 bytes
-                uint16_t mfgId = ((uint8_t)mfgData[1] << 8) | (uint8_t)mfgData[0];
-                deviceType = classifyBleDevice(mfgId);
-            }
+    // Hash outside the critical section
+    static DeviceKeys keysFor(const uint8_t* addr, uint32_t minute) {
+        return KeyPolicy::of(addr, minute);
+    }
+
+    // Count one frame/advertisement (caller holds the instance's mutex)
+    Observation observe(const DeviceKeys& keys, int rssi, uint32_t minute,
+                        DeviceType type = DEVICE_OTHER) {
+        Observation obs;
+        m_impressions++;
+        obs.isNew = addUnique(keys.dedup);
+        if (obs.isNew) m_classify.add(type);
+
+        if (m_rssiCount == 0 || rssi < m_rssiMin) m_rssiMin = rssi;
+        if (m_rssiCount == 0 || rssi > m_rssiMax) m_rssiMax = rssi;
+        m_rssiSum += rssi;
+        m_rssiCount++;
+
+        // Distance zone (thresholds configurable via remote config)
+        if (rssi > g_rssiImmediateThreshold) {
+            obs.zone = OCC_ZONE_IMMEDIATE;  // At Counter (very close, ~0-2m)
+        } else if (rssi > g_rssiNearThreshold) {
+            obs.zone = OCC_ZONE_NEAR;       // In Store (near, ~2-5m)
+        } else if (rssi > g_rssiFarThreshold) {
+            obs.zone = OCC_ZONE_FAR;        // Window Shopping (far, ~5-15m)
+        } else {
+            obs.zone = OCC_ZONE_REMOTE;     // Walking Past (remote, >15m)
+        }
+        m_zones.add(obs.zone);
+        m_dwell.add(keys.device, minute);
+        return obs;
+    }
+
+    // Hand over the epoch and start a new one (caller holds the mutex)
+    void takeAndReset(CountSnapshot* s) {
+        memset(s, 0, sizeof(*s));
+        s->impressions = m_impressions;
+        s->unique = m_uniqueCount;
+        s->overflow = m_overflow;
+        if (m_rssiCount > 0) {
+            s->rssiAvg = m_rssiSum / (int32_t)m_rssiCount;
+            s->rssiMin = m_rssiMin;
+            s->rssiMax = m_rssiMax;
         }
+        m_zones.take(s);
+        m_dwell.take(s);
+        m_classify.take(s);
+        m_impressions = 0;
+        memset(m_uniques, 0, sizeof(m_uniques));  // Empty the set (no heap ops)
+        m_uniqueCount = 0;
+        m_overflow = 0;
+        m_rssiSum = 0;
+        m_rssiCount = 0;
+    }
+
+    // Running epoch values for status and anomaly sampling (caller holds the mutex)
+    uint32_t impressions() const { return m_impressions; }
+    uint32_t uniques() const { return m_uniqueCount; }
+    int32_t rssiSum() const { return m_rssiSum; }
+    uint32_t rssiCount() const { return m_rssiCount; }
+
+private:
+    // Open-addressed set, at most 3/4 full: a lookup touches a few slots
+    // instead of scanning every unique so far under the mutex
+    static constexpr uint32_t slotsAtLeast(uint32_t n, uint32_t p = 1) {
+        return p >= n ? p : slotsAtLeast(n, p * 2);
+    }
+    static const uint32_t kSlots = slotsAtLeast(Capacity + Capacity / 3);
+
+    // Keys are keyed hashes already and never 0 (0 marks a free slot)
+    bool addUnique(uint32_t key) {
+        uint32_t i = key & (kSlots - 1);
+        while (m_uniques[i] != 0) {
+            if (m_uniques[i] == key) return false;
+            i = (i + 1) & (kSlots - 1);
+        }
+        if (m_uniqueCount < Capacity) {
+            m_uniques[i] = key;
+            m_uniqueCount++;
+            return true;
+        }
+        m_overflow++;  // New device, but the table is full (data quality indicator)
+        return false;
+    }
 
-        // Update counters with mutex protection
-        portENTER_CRITICAL(&g_bleMux);
-        g_bleImpressions++;  // Raw count: every advertisement
-
-        // Track unique per minute - only count OS type for NEW devices
-        // addUniqueMac returns true if this is a new device (not seen before)
-        bool isNewDevice = addUniqueMac(g_bleUniqueMacs, &g_bleUniqueMacCount, MAX_UNIQUE_MACS, dedupKey);
-        if (isNewDevice) {
-            if (deviceType == DEVICE_APPLE) {
-                g_bleAppleCount++;
+    // Fixed arrays for deduplication - prevents heap fragmentation in 24/7 operation
+    uint32_t m_uniques[kSlots];
+    uint16_t m_uniqueCount;
+    uint16_t m_overflow;
+    uint32_t m_impressions;
+    int32_t m_rssiSum;
+    uint32_t m_rssiCount;
+    int32_t m_rssiMin;
+    int32_t m_rssiMax;
+    EngineZones<HasFeature<FeatureZones, Features...>::value> m_zones;
+    EngineDwell<DwellEntriesOf<Features...>::value> m_dwell;
+    EngineClassify<HasFeature<FeatureClassify, Features...>::value> m_classify;
+};
+
+// WiFi probes: no classification (probe requests don't reveal the OS)
+typedef CountingEngine<MAX_UNIQUE_MACS, SaltedFingerprintKeys,
+                       FeatureZones, FeatureDwell<MAX_DWELL_ENTRIES>> WifiCounter;
+// BLE advertisements: Apple vs Other via manufacturer ID
+typedef CountingEngine<MAX_UNIQUE_MACS, SaltedFingerprintKeys,
+                       FeatureZones, FeatureDwell<BLE_DWELL_ENTRIES>, FeatureClassify> BleCounter;
+
+// Static storage: zero-initialized, no constructors run
+static WifiCounter g_wifiCounter;   // Guarded by g_probeMux
+static BleCounter g_bleCounter;     // Guarded by g_bleMux
+
+// =============================================================================
+// Returning Visitors - per-day Bloom filters of stable identifiers
+// =============================================================================
+// Some identifiers survive MAC randomization: BLE public addresses, globally
+// administered WiFi MACs and the WPS UUID-E many Android builds put in every
+// probe request. Each is hashed under a device-secret salt (drawn once, kept
+// in NVS, never sent and never rotated - unlike the daily fingerprint salt)
+// into today's Bloom filter. Past days live on SPIFFS, one fixed-size file per
+// day in a VISITOR_DAYS ring. An identifier first seen today counts as
+// returning when any past-day filter holds it. These identifiers only feed
+// the filters - they are never counted as uniques and never stored raw.
+// Sizing: 4 KB per filter (32768 bits, k=3) keeps false positives under 0.5%
+// up to ~2000 stable identifiers a day, and the reported fraction is corrected
+// for the past filters' measured fill. RAM: one filter plus a small pending
+// queue; flash: VISITOR_DAYS files of 4 KB + header.
+
+#define VISITOR_TRACKING_ENABLED true
+#define VISITOR_DAYS 7                      // Today + 6 past days on flash
+#define VISITOR_BLOOM_BYTES 4096            // Per-day filter size
+#define VISITOR_BLOOM_BITS (VISITOR_BLOOM_BYTES * 8)
+#define VISITOR_BLOOM_HASHES 3              // k - bit positions per identifier
+#define VISITOR_PENDING_SIZE 64             // Sightings queued by capture callbacks
+#define VISITOR_SAVE_INTERVAL_MS (60UL * 60 * 1000)  // Checkpoint today's filter hourly
+#define VISITOR_NVS_NAMESPACE "visitor"
+#define VISITOR_FILE_MAGIC 0x31534956       // "VIS1"
+
+static_assert((VISITOR_BLOOM_BITS & (VISITOR_BLOOM_BITS - 1)) == 0,
+              "visitor filter size must be a power of two");
+
+struct VisitorFileHeader {
+    uint32_t magic;
+    uint32_t day;           // Day index (Unix days) the filter covers
+    uint16_t count;         // Distinct stable identifiers that day
+    uint16_t returning;     // Of those, found in an earlier day's filter
+    uint16_t fillPermille;  // Share of bits set - false-positive correction
+    uint16_t reserved;
+};
+
+static uint32_t g_visitKey[2];                          // Persistent secret salt
+static uint8_t g_visitToday[VISITOR_BLOOM_BYTES];       // Today's filter
+static uint32_t g_visitDay = 0;                         // Day index of g_visitToday
+static bool g_visitDayKnown = false;                    // Waits for a synced clock
+static uint16_t g_visitTodayCount = 0;                  // Distinct stable IDs today
+static uint16_t g_visitReturning = 0;                   // Of those, seen on an earlier day
+static uint8_t g_visitPastDays = 0;                     // Past-day filters on flash
+static float g_visitPastFp = 0.0f;                      // P(false hit in any past filter)
+static bool g_visitDirty = false;                       // Today changed since last save
+static uint32_t g_visitLastSave = 0;
+static uint32_t g_visitPending[VISITOR_PENDING_SIZE];   // Fingerprints awaiting lookup
+static uint8_t g_visitPendingCount = 0;
+static uint32_t g_visitPendingDropped = 0;              // Queue full - sighting lost
+static portMUX_TYPE g_visitMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Bit i of an identifier's k positions (double hashing on the 32-bit fingerprint)
+static inline uint32_t IRAM_ATTR visitorBit(uint32_t fp, uint8_t i) {
+    return (fp + i * ((fp >> 15) | 1)) & (VISITOR_BLOOM_BITS - 1);
+}
+
+static bool IRAM_ATTR visitorTestToday(uint32_t fp) {
+    for (uint8_t i = 0; i < VISITOR_BLOOM_HASHES; i++) {
+        uint32_t bit = visitorBit(fp, i);
+        if (!(g_visitToday[bit >> 3] & (1 << (bit & 7)))) return false;
+    }
+    return true;
+}
+
+// Queue a stable identifier from a capture callback. Identifiers already in
+// today's filter are dropped here, so a chatty device costs one hash per frame.
+static void IRAM_ATTR visitorNote(const uint8_t* id, size_t len) {
+#if VISITOR_TRACKING_ENABLED
+    uint32_t fp = halfSipHash24(g_visitKey, id, len);
+    portENTER_CRITICAL(&g_visitMux);
+    if (!visitorTestToday(fp)) {
+        bool queued = false;
+        for (uint8_t i = 0; i < g_visitPendingCount; i++) {
+            if (g_visitPending[i] == fp) { queued = true; break; }
+        }
+        if (!queued) {
+            if (g_visitPendingCount < VISITOR_PENDING_SIZE) {
+                g_visitPending[g_visitPendingCount++] = fp;
             } else {
-                g_bleOtherCount++;
+                g_visitPendingDropped++;
             }
-        } else if (g_bleUniqueMacCount >= MAX_UNIQUE_MACS) {
-            // Track BLE overflow separately (cap was hit)
-            g_bleOverflow++;
         }
+    }
+    portEXIT_CRITICAL(&g_visitMux);
+#endif
+}
 
-        // Track RSSI (still count every advertisement for signal averaging)
-        g_bleRssiSum += rssi;
-        g_bleRssiCount++;
-        portEXIT_CRITICAL(&g_bleMux);
+// WPS UUID-E (attribute 0x1047) from a probe request's WPS vendor IE body
+// (OUI 00:50:F2 type 4, checked by the caller). Stays the same when the MAC
+// is randomized; all-zero UUIDs are placeholders some stacks send.
+static void IRAM_ATTR visitorNoteWps(const uint8_t* body, uint8_t ieLen) {
+    // WPS attributes: type(2) length(2) value, big-endian
+    int a = 4;
+    while (a + 4 <= ieLen) {
+        uint16_t type = ((uint16_t)body[a] << 8) | body[a + 1];
+        uint16_t attrLen = ((uint16_t)body[a + 2] << 8) | body[a + 3];
+        if (a + 4 + attrLen > ieLen) return;
+        if (type == 0x1047 && attrLen == 16) {
+            const uint8_t* uuid = body + a + 4;
+            uint8_t any = 0;
+            for (int i = 0; i < 16; i++) any |= uuid[i];
+            if (any) visitorNote(uuid, 16);
+            return;
+        }
+        a += 4 + attrLen;
+    }
+}
+
+// Load the secret salt, drawing and persisting one on first boot
+static void visitorLoadKey() {
+    Preferences nvs;
+    nvs.begin(VISITOR_NVS_NAMESPACE, false);
+    if (nvs.getBytes("salt", g_visitKey, sizeof(g_visitKey)) != sizeof(g_visitKey)) {
+        g_visitKey[0] = esp_random();
+        g_visitKey[1] = esp_random();
+        nvs.putBytes("salt", g_visitKey, sizeof(g_visitKey));
+        LOGI("[VISIT] New visitor salt drawn\n");
+    }
+    nvs.end();
+}
+
+static void visitorFilePath(uint32_t day, char* out, size_t size) {
+    snprintf(out, size, "/visit%lu.bf", (unsigned long)(day % VISITOR_DAYS));
+}
+
+// Open a day's filter file if its slot still holds that day
+static File visitorOpenDay(uint32_t day, VisitorFileHeader* hdr) {
+    char path[20];
+    visitorFilePath(day, path, sizeof(path));
+    if (!g_spiffsReady || !SPIFFS.exists(path)) return File();
+    File f = SPIFFS.open(path, "r");
+    if (f && (f.read((uint8_t*)hdr, sizeof(*hdr)) != sizeof(*hdr) ||
+              hdr->magic != VISITOR_FILE_MAGIC || hdr->day != day ||
+              f.size() != sizeof(*hdr) + VISITOR_BLOOM_BYTES)) {
+        f.close();
+        return File();
+    }
+    return f;
+}
+
+static bool visitorFileTest(File& f, uint32_t fp) {
+    for (uint8_t i = 0; i < VISITOR_BLOOM_HASHES; i++) {
+        uint32_t bit = visitorBit(fp, i);
+        uint8_t b = 0;
+        if (!f.seek(sizeof(VisitorFileHeader) + (bit >> 3)) || f.read(&b, 1) != 1) return false;
+        if (!(b & (1 << (bit & 7)))) return false;
+    }
+    return true;
+}
+
+static void visitorSave() {
+    if (!g_spiffsReady) return;
+    uint32_t setBits = 0;
+    for (int i = 0; i < VISITOR_BLOOM_BYTES; i++) setBits += __builtin_popcount(g_visitToday[i]);
+    VisitorFileHeader hdr = {};
+    hdr.magic = VISITOR_FILE_MAGIC;
+    hdr.day = g_visitDay;
+    hdr.count = g_visitTodayCount;
+    hdr.returning = g_visitReturning;
+    hdr.fillPermille = (uint16_t)((uint64_t)setBits * 1000 / VISITOR_BLOOM_BITS);
+    char path[20];
+    visitorFilePath(g_visitDay, path, sizeof(path));
+    File f = SPIFFS.open(path, "w");
+    if (!f) {
+        LOGW("[VISIT] Cannot write %s\n", path);
+        return;
+    }
+    f.write((const uint8_t*)&hdr, sizeof(hdr));
+    f.write(g_visitToday, sizeof(g_visitToday));
+    f.close();
+    g_visitDirty = false;
+    g_visitLastSave = millis();
+}
+
+// Past filters present on flash and the chance an unseen identifier hits one
+static void visitorScanPast() {
+    float miss = 1.0f;
+    g_visitPastDays = 0;
+    for (uint32_t d = 1; d < VISITOR_DAYS && d <= g_visitDay; d++) {
+        VisitorFileHeader hdr;
+        File f = visitorOpenDay(g_visitDay - d, &hdr);
+        if (!f) continue;
+        f.close();
+        float fill = hdr.fillPermille / 1000.0f;
+        miss *= 1.0f - fill * fill * fill;  // fill^k, k = VISITOR_BLOOM_HASHES
+        g_visitPastDays++;
+    }
+    g_visitPastFp = 1.0f - miss;
+}
+
+// Tie the filters to the calendar day. Call between epochs once the clock is
+// synced; the first call resumes today's checkpoint, a day change files
+// today's filter into the ring and starts an empty one.
+static void visitorSetDay(uint32_t day) {
+    if (g_visitDayKnown && day == g_visitDay) return;
+    if (g_visitDayKnown) visitorSave();
+
+    VisitorFileHeader hdr;
+    File f = visitorOpenDay(day, &hdr);
+    portENTER_CRITICAL(&g_visitMux);
+    memset(g_visitToday, 0, sizeof(g_visitToday));
+    portEXIT_CRITICAL(&g_visitMux);
+    g_visitTodayCount = 0;
+    g_visitReturning = 0;
+    if (f) {
+        // Reading straight into the live filter is fine - it only gains bits
+        f.read(g_visitToday, sizeof(g_visitToday));
+        g_visitTodayCount = hdr.count;
+        g_visitReturning = hdr.returning;
+        f.close();
+    }
+    g_visitDay = day;
+    g_visitDayKnown = true;
+    g_visitLastSave = millis();
+    visitorScanPast();
+    LOGI("[VISIT] Day %lu: %u stable IDs restored, %u past days on flash\n",
+         day, g_visitTodayCount, g_visitPastDays);
+}
+
+// Drain the pending queue: add new identifiers to today's filter and look
+// them up in the past days. Runs from the loop (SPIFFS I/O), once a minute.
+static void visitorProcessPending() {
+    if (!g_visitDayKnown) return;  // Keep queued sightings until the day is known
+
+    uint32_t batch[VISITOR_PENDING_SIZE];
+    uint8_t count;
+    portENTER_CRITICAL(&g_visitMux);
+    count = g_visitPendingCount;
+    memcpy(batch, g_visitPending, count * sizeof(uint32_t));
+    g_visitPendingCount = 0;
+    portEXIT_CRITICAL(&g_visitMux);
+
+    if (count > 0) {
+        File past[VISITOR_DAYS - 1];
+        uint8_t pastCount = 0;
+        for (uint32_t d = 1; d < VISITOR_DAYS && d <= g_visitDay; d++) {
+            VisitorFileHeader hdr;
+            File f = visitorOpenDay(g_visitDay - d, &hdr);
+            if (f) past[pastCount++] = f;
+        }
+        for (uint8_t n = 0; n < count; n++) {
+            uint32_t fp = batch[n];
+            if (visitorTestToday(fp)) continue;
+            portENTER_CRITICAL(&g_visitMux);
+            for (uint8_t i = 0; i < VISITOR_BLOOM_HASHES; i++) {
+                uint32_t bit = visitorBit(fp, i);
+                g_visitToday[bit >> 3] |= (1 << (bit & 7));
+            }
+            portEXIT_CRITICAL(&g_visitMux);
+            if (g_visitTodayCount < 0xFFFF) g_visitTodayCount++;
+            for (uint8_t p = 0; p < pastCount; p++) {
+                if (visitorFileTest(past[p], fp)) {
+                    g_visitReturning++;
+                    break;
+                }
+            }
+            g_visitDirty = true;
+        }
+        for (uint8_t p = 0; p < pastCount; p++) past[p].close();
+    }
+
+    if (g_visitDirty && millis() - g_visitLastSave >= VISITOR_SAVE_INTERVAL_MS) {
+        visitorSave();
+    }
+}
+
+// Share of today's stable identifiers seen on an earlier day, in permille,
+// corrected for past-filter false positives: observed = r + (1 - r) * p.
+// -1 until there is something to compare against.
+static int16_t visitorReturningPermille() {
+    if (g_visitTodayCount == 0 || g_visitPastDays == 0 || g_visitPastFp >= 1.0f) return -1;
+    float observed = (float)g_visitReturning / g_visitTodayCount;
+    float r = (observed - g_visitPastFp) / (1.0f - g_visitPastFp);
+    if (r < 0.0f) r = 0.0f;
+    if (r > 1.0f) r = 1.0f;
+    return (int16_t)(r * 1000.0f + 0.5f);
+}
+
+// =============================================================================
+// Capture Quality - driver RX statistics and sequence gap estimation
+// =============================================================================
+// ESP-IDF does not expose a counter for frames dropped from the promiscuous RX
+// queue, so capture loss is inferred: per-channel frames delivered vs counted,
+// driver-flagged RX errors, worst-case callback time (a slow callback is what
+// makes the driver drop), and 802.11 sequence-number gaps per source MAC.
+// All counters are protected by g_probeMux and reset each report period.
+
+static volatile uint32_t g_rxMgmtSeen[WIFI_CHANNEL_COUNT];       // Mgmt frames delivered by driver
+static volatile uint32_t g_rxMgmtProcessed[WIFI_CHANNEL_COUNT];  // Frames that reached the counters
+static volatile uint32_t g_rxErrors = 0;                         // Frames with rx_state != 0
+static volatile uint32_t g_rxCallbackMaxUs = 0;                  // Slowest callback this period
+
+// Sequence gap tracking - small recent-source table, replaced round-robin.
+// A phone sends a burst of probes on one channel with consecutive sequence
+// numbers; a gap inside a short burst window means we missed frames we were
+// listening for. Larger jumps or longer pauses are a new scan, not loss.
+#define SEQ_TRACK_SLOTS     64
+#define SEQ_GAP_WINDOW_MS   100   // Max spacing between frames of one burst
+#define SEQ_GAP_MAX         8     // Larger jumps are treated as a new scan
+static uint32_t g_seqMacs[SEQ_TRACK_SLOTS];     // Device fingerprints
+static uint16_t g_seqLast[SEQ_TRACK_SLOTS];
+static uint32_t g_seqLastMs[SEQ_TRACK_SLOTS];
+static uint8_t g_seqLastChannel[SEQ_TRACK_SLOTS];
+static uint8_t g_seqNextSlot = 0;
+static volatile uint32_t g_seqMissed = 0;  // Estimated probes missed (sum of gaps)
+
+// Map a WiFi channel number to its index in WIFI_CHANNELS, -1 if not hopped
+static inline int wifiChannelIndex(uint8_t channel) {
+    for (int i = 0; i < WIFI_CHANNEL_COUNT; i++) {
+        if (WIFI_CHANNELS[i] == channel) return i;
+    }
+    return -1;
+}
+
+// Record a probe's sequence number and accumulate gaps (call under g_probeMux)
+static void IRAM_ATTR trackSeqGap(uint32_t mac, uint16_t seq, uint8_t channel, uint32_t nowMs) {
+    for (uint8_t i = 0; i < SEQ_TRACK_SLOTS; i++) {
+        if (g_seqMacs[i] == mac) {
+            if (g_seqLastChannel[i] == channel && (nowMs - g_seqLastMs[i]) <= SEQ_GAP_WINDOW_MS) {
+                uint16_t gap = (uint16_t)((seq - g_seqLast[i]) & 0x0FFF);
+                if (gap > 1 && gap <= SEQ_GAP_MAX) {
+                    g_seqMissed += gap - 1;
+                }
+            }
+            g_seqLast[i] = seq;
+            g_seqLastMs[i] = nowMs;
+            g_seqLastChannel[i] = channel;
+            return;
+        }
     }
+    uint8_t slot = g_seqNextSlot;
+    g_seqNextSlot = (g_seqNextSlot + 1) % SEQ_TRACK_SLOTS;
+    g_seqMacs[slot] = mac;
+    g_seqLast[slot] = seq;
+    g_seqLastMs[slot] = nowMs;
+    g_seqLastChannel[slot] = channel;
+}
+
+// =============================================================================
+// Probe Fingerprinting - counting devices across MAC rotations
+// =============================================================================
+// A phone that rotates its randomized MAC shows up as a new device in the
+// uniques table. The rest of its probe request changes far less: supported
+// rates, HT/VHT/HE and extended capabilities, and which vendor IEs it sends
+// in what order. probeIeSignature hashes those parts in one pass over the
+// frame body (FNV-1a, in place). Sources are grouped into clusters keyed by
+// signature. A new MAC joins an existing cluster (a rotation) when its
+// signature matches, its sequence number continues the cluster's last one,
+// its RSSI is close, and the old MAC fell silent within the link window.
+// The old MAC must then stay silent: a frame from it after the link proves
+// two devices, and the new MAC is split back out into its own cluster.
+// Counting clusters once per minute gives a rotation-corrected unique count
+// with the same per-minute semantics as "u". It is never higher than "u":
+// when no rotation can be proven, nothing is merged, and a MAC whose cluster
+// was evicted is not counted again in a minute it was already seen in.
+// Lookups run in the capture callback under g_probeMux, so they are O(1):
+// clusters are filed set-associatively by signature (link candidates and
+// the eviction victim come from one 8-way set), and a direct-mapped hint
+// from MAC fingerprint to slot finds the cluster a MAC is current or
+// previous in. A hint overwritten by another MAC only loses that lookup -
+// the MAC then starts a cluster of its own, as after an eviction.
+
+#define ROTATION_CLUSTER_WAYS    8      // Clusters per signature set
+#define ROTATION_CLUSTER_SETS    16
+#define ROTATION_CLUSTER_SLOTS   (ROTATION_CLUSTER_WAYS * ROTATION_CLUSTER_SETS)
+#define ROTATION_MAC_HINTS       256    // MAC fingerprint -> slot hints
+#define ROTATION_LINK_WINDOW_MS  30000  // New MAC must follow the old one's last frame within this
+#define ROTATION_SEQ_MAX         64     // Max forward sequence jump across a rotation
+#define ROTATION_RSSI_DELTA      10     // Max RSSI difference (dB) across a rotation
+#define ROTATION_MINUTE_NONE     0xFFFFFFFF
+
+struct ProbeCluster {
+    uint32_t sig;            // IE signature (0 = free slot)
+    uint32_t macFp;          // Fingerprint of the cluster's current MAC
+    uint32_t prevFp;         // MAC it rotated away from, must stay silent (0 = none)
+    uint32_t lastMs;         // millis() of the latest frame
+    uint32_t countedMinute;  // Minute the cluster was last counted in
+    uint16_t lastSeq;        // Latest 802.11 sequence number
+    int8_t rssi;             // Smoothed RSSI
 };
 
-static NimBLEScan* g_pBleScan = nullptr;
-static BleAdvertisedDeviceCallbacks g_bleCallbacks;
+static ProbeCluster g_probeClusters[ROTATION_CLUSTER_SLOTS];
+static uint8_t g_clusterByMac[ROTATION_MAC_HINTS];  // Slot + 1 of a cluster holding the MAC (0 = none)
+static volatile uint32_t g_rotationUniques = 0;   // Cluster-minutes this period
+static volatile uint32_t g_rotationsLinked = 0;   // MAC changes merged into a cluster
 
-static void initBle() {
-    if (g_bleInitialized) return;
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME  16777619u
 
-    Serial.println("[BLE] Initializing NimBLE...");
+static inline uint32_t IRAM_ATTR fnvByte(uint32_t h, uint8_t b) {
+    return (h ^ b) * FNV_PRIME;
+}
 
-    // Initialize NimBLE in passive mode (no transmit)
-    NimBLEDevice::init("");
+// Hash the stable IEs of a probe request body; WPS vendor IEs are handed to
+// the returning-visitor filter on the way. The SSID and DS parameter bodies
+// vary from frame to frame, so only their position in the IE order counts.
+// Returns 0 if the body holds no IEs.
+static uint32_t IRAM_ATTR probeIeSignature(const uint8_t* ies, int len) {
+    uint32_t h = FNV_OFFSET;
+    int pos = 0;
+    bool any = false;
+    while (pos + 2 <= len) {
+        uint8_t id = ies[pos];
+        uint8_t ieLen = ies[pos + 1];
+        if (pos + 2 + ieLen > len) break;  // Truncated, or the FCS
+        const uint8_t* body = ies + pos + 2;
+        any = true;
+        h = fnvByte(h, id);
+        switch (id) {
+            case 1:     // Supported rates
+            case 45:    // HT capabilities
+            case 50:    // Extended supported rates
+            case 59:    // Supported operating classes
+            case 70:    // RM enabled capabilities
+            case 127:   // Extended capabilities
+            case 191:   // VHT capabilities
+            case 255:   // Extension (HE capabilities etc.)
+                h = fnvByte(h, ieLen);
+                for (uint8_t i = 0; i < ieLen; i++) h = fnvByte(h, body[i]);
+                break;
+            case 221:   // Vendor specific - OUI and type only, bodies carry per-scan data
+                for (uint8_t i = 0; i < ieLen && i < 4; i++) h = fnvByte(h, body[i]);
+                if (ieLen >= 4 && body[0] == 0x00 && body[1] == 0x50 &&
+                    body[2] == 0xF2 && body[3] == 0x04) {
+                    visitorNoteWps(body, ieLen);
+                }
+                break;
+            default:
+                break;
+        }
+        pos += 2 + ieLen;
+    }
+    if (!any) return 0;
+    return h ? h : 1;
+}
 
-    // Get scan object
-    g_pBleScan = NimBLEDevice::getScan();
-    g_pBleScan->setAdvertisedDeviceCallbacks(&g_bleCallbacks, false);
-    g_pBleScan->setActiveScan(false);  // Passive scan - no scan requests
-    g_pBleScan->setInterval(100);      // 100ms scan interval
-    g_pBleScan->setWindow(99);         // 99ms scan window (nearly continuous)
-    g_pBleScan->setMaxResults(0);      // Don't store results, use callback
+// First slot of the set a signature files into
+static inline ProbeCluster* IRAM_ATTR rotationSet(uint32_t sig) {
+    return &g_probeClusters[((sig ^ (sig >> 16)) & (ROTATION_CLUSTER_SETS - 1)) * ROTATION_CLUSTER_WAYS];
+}
 
-    g_bleInitialized = true;
-    Serial.println("[BLE] NimBLE initialized (passive scan mode)");
+static inline uint8_t* IRAM_ATTR rotationMacHint(uint32_t macFp) {
+    return &g_clusterByMac[(macFp >> 8) & (ROTATION_MAC_HINTS - 1)];
 }
 
-static void startBleScan() {
-    if (!g_bleInitialized) {
-        initBle();
+static inline void IRAM_ATTR rotationHintSet(uint32_t macFp, const ProbeCluster* c) {
+    *rotationMacHint(macFp) = (uint8_t)(c - g_probeClusters + 1);
+}
+
+// Assign a probe to a cluster and count the cluster once per minute.
+// seenThisMinute: the raw uniques table already had this MAC this minute.
+// (call under g_probeMux)
+static void IRAM_ATTR rotationTrack(uint32_t sig, uint32_t macFp, uint16_t seq, int rssi,
+                                    uint32_t minute, uint32_t nowMs, bool seenThisMinute) {
+    // No IEs to link on - a per-MAC key keeps the cluster to this MAC alone
+    if (sig == 0) sig = macFp;
+    ProbeCluster* hit = nullptr;
+    ProbeCluster* link = nullptr;
+    ProbeCluster* revived = nullptr;
+    ProbeCluster* victim = nullptr;
+
+    // The cluster this MAC is current in, or rotated away from
+    uint8_t hint = *rotationMacHint(macFp);
+    if (hint != 0) {
+        ProbeCluster* c = &g_probeClusters[hint - 1];
+        if (c->sig != 0 && c->macFp == macFp) hit = c;
+        else if (c->sig != 0 && c->prevFp == macFp) revived = c;
+    }
+
+    if (!hit) {
+        // Victim (free, else stalest) from the set the new cluster files
+        // into; link candidates from the same set
+        ProbeCluster* set = rotationSet(revived ? revived->sig : sig);
+        uint16_t bestGap = ROTATION_SEQ_MAX + 1;
+        for (int i = 0; i < ROTATION_CLUSTER_WAYS; i++) {
+            ProbeCluster* c = &set[i];
+            if (c == revived) continue;
+            if (c->sig == 0) {
+                if (!victim || victim->sig != 0) victim = c;
+                continue;
+            }
+            if (!victim || (victim->sig != 0 && (int32_t)(c->lastMs - victim->lastMs) < 0)) victim = c;
+            if (revived || c->sig != sig || nowMs - c->lastMs > ROTATION_LINK_WINDOW_MS) continue;
+            uint16_t gap = (uint16_t)((seq - c->lastSeq) & 0x0FFF);
+            int drssi = rssi - c->rssi;
+            if (gap == 0 || gap >= bestGap || drssi > ROTATION_RSSI_DELTA || drssi < -ROTATION_RSSI_DELTA) continue;
+            bestGap = gap;
+            link = c;
+        }
+    }
+    if (!hit && revived) {
+        // The MAC a cluster rotated away from is back - not a rotation. The
+        // newer MAC moves to its own cluster, keeping the minutes it was
+        // counted in, and the revived one counts afresh.
+        *victim = *revived;
+        victim->prevFp = 0;
+        rotationHintSet(victim->macFp, victim);
+        if (g_rotationsLinked > 0) g_rotationsLinked--;
+        hit = revived;
+        hit->macFp = macFp;
+        hit->prevFp = 0;
+        hit->countedMinute = seenThisMinute ? minute : ROTATION_MINUTE_NONE;
+    }
+    if (!hit && link) {
+        hit = link;
+        hit->prevFp = hit->macFp;
+        hit->macFp = macFp;
+        rotationHintSet(macFp, hit);
+        g_rotationsLinked++;
+    }
+    if (!hit) {
+        hit = victim;
+        hit->sig = sig;
+        hit->macFp = macFp;
+        hit->prevFp = 0;
+        // Evicted and back within the minute - it was counted already
+        hit->countedMinute = seenThisMinute ? minute : ROTATION_MINUTE_NONE;
+        hit->rssi = (int8_t)rssi;
+        rotationHintSet(macFp, hit);
+    }
+    hit->lastMs = nowMs;
+    hit->lastSeq = seq;
+    hit->rssi = (int8_t)((3 * hit->rssi + rssi) / 4);
+    if (hit->countedMinute != minute) {
+        hit->countedMinute = minute;
+        g_rotationUniques++;
+    }
+}
+
+// New report period: clusters persist (a rotation can straddle the boundary)
+// but are counted afresh, as the raw uniques table is (call under g_probeMux)
+static void rotationResetPeriod() {
+    for (int i = 0; i < ROTATION_CLUSTER_SLOTS; i++) {
+        g_probeClusters[i].countedMinute = ROTATION_MINUTE_NONE;
+    }
+    g_rotationUniques = 0;
+    g_rotationsLinked = 0;
+}
+
+// 802.11 frame type definitions
+#define WIFI_MGMT_FRAME     0
+#define WIFI_PROBE_REQUEST  4
+#define WIFI_BEACON         8
+
+// Check if MAC address is randomized (locally administered)
+// Bit 1 of first byte: 0 = globally unique (static), 1 = locally administered (randomized)
+static inline bool isRandomizedMac(const uint8_t* mac) {
+    return (mac[0] & 0x02) != 0;
+}
+
+// Process one management frame - returns true if it reached the probe/AP counters
+static bool IRAM_ATTR wifiProcessMgmtFrame(const wifi_promiscuous_pkt_t* pkt) {
+    const uint8_t* frame = pkt->payload;
+    const int len = pkt->rx_ctrl.sig_len;
+
+    // Need at least frame control + duration + 3 addresses (24 bytes)
+    if (len < 24) return false;
+
+    // Frame control field (first 2 bytes)
+    uint8_t frameType = (frame[0] >> 2) & 0x03;     // bits 2-3
+    uint8_t frameSubtype = (frame[0] >> 4) & 0x0F;  // bits 4-7
+
+    // Only process management frames
+    if (frameType != WIFI_MGMT_FRAME) return false;
+
+    // Handle beacon frames (access point counting)
+    if (frameSubtype == WIFI_BEACON && g_countAccessPoints) {
+        // BSSID is at bytes 16-21 in beacon frame
+        const uint8_t* bssid = &frame[16];
+        uint32_t bssidVal = fingerprintOf(bssid, false, 0);
+
+        portENTER_CRITICAL(&g_probeMux);
+        addUniqueMac(g_uniqueAPs, &g_uniqueAPCount, MAX_UNIQUE_APS, bssidVal);
+        portEXIT_CRITICAL(&g_probeMux);
+        return true;
+    }
+
+    // Filter for probe requests only (subtype=4)
+    if (frameSubtype != WIFI_PROBE_REQUEST) return false;
+
+    // Extract source MAC address (bytes 10-15 in 802.11 header)
+    // Header: FC(2) + Duration(2) + DA(6) + SA(6) + BSSID(6) + SeqCtrl(2)
+    const uint8_t* srcMac = &frame[10];
+
+    // Privacy filter: Only count randomized MACs
+    // Static MACs are globally unique (PII) - we reject them; only their
+    // secret-salted hash reaches the returning-visitor filter
+#if PRIVACY_FILTER_ENABLED
+    if (!isRandomizedMac(srcMac)) {
+        visitorNote(srcMac, 6);
+        portENTER_CRITICAL(&g_probeMux);
+        g_filteredStatic++;
+        portEXIT_CRITICAL(&g_probeMux);
+        return false;
+    }
+#endif
+
+    // Stable parts of the body, read in place (also passes any WPS UUID-E,
+    // stable across days, to the returning-visitor filter)
+    uint32_t ieSig = probeIeSignature(frame + 24, len - 24);
+
+    // Note: WiFi probe requests don't reliably indicate device type
+    // OS classification now done via BLE manufacturer IDs
+
+    // Salted fingerprints instead of the MAC: one per device (dwell, sessions,
+    // occupancy) and one per device-minute as the dedup key - this counts each
+    // device once per minute (MRC "opportunity to see" standard)
+    uint32_t currentMinute = millis() / 60000;
+    DeviceKeys keys = WifiCounter::keysFor(srcMac, currentMinute);
+    uint32_t macVal = keys.device;
+
+    // Capture probe RSSI (WiFi signal strength from the phone)
+    int probeRssi = pkt->rx_ctrl.rssi;
+
+    // 802.11 sequence number (upper 12 bits of SeqCtrl at bytes 22-23)
+    uint16_t seqNum = (uint16_t)((frame[22] | (frame[23] << 8)) >> 4);
+
+    // Update counters with mutex protection
+    portENTER_CRITICAL(&g_probeMux);
+    WifiCounter::Observation obs = g_wifiCounter.observe(keys, probeRssi, currentMinute);
+    occupancyAdd(macVal, obs.zone, currentMinute);
+    sessionTouch(macVal, obs.zone, currentMinute);
+    trackSeqGap(macVal, seqNum, pkt->rx_ctrl.channel, millis());
+    rotationTrack(ieSig, macVal, seqNum, probeRssi, currentMinute, millis(), !obs.isNew);
+    portEXIT_CRITICAL(&g_probeMux);
+    return true;
+}
+
+// WiFi promiscuous callback - called from WiFi task context
+// Wraps frame processing with driver-level RX quality accounting
+static void IRAM_ATTR wifiProbeCounterCallback(void* buf, wifi_promiscuous_pkt_type_t type) {
+    const wifi_promiscuous_pkt_t* pkt = (wifi_promiscuous_pkt_t*)buf;
+
+    // Driver-flagged frames (FCS/PHY error, any type) are counted, never parsed
+    if (pkt->rx_ctrl.rx_state != 0) {
+        portENTER_CRITICAL(&g_probeMux);
+        g_rxErrors++;
+        portEXIT_CRITICAL(&g_probeMux);
+        return;
+    }
+    if (type != WIFI_PKT_MGMT) return;
+
+    int64_t startUs = esp_timer_get_time();
+    bool processed = wifiProcessMgmtFrame(pkt);
+    uint32_t elapsedUs = (uint32_t)(esp_timer_get_time() - startUs);
+
+    int chIdx = wifiChannelIndex(pkt->rx_ctrl.channel);
+
+    portENTER_CRITICAL(&g_probeMux);
+    if (chIdx >= 0) {
+        g_rxMgmtSeen[chIdx]++;
+        if (processed) g_rxMgmtProcessed[chIdx]++;
+    }
+    if (elapsedUs > g_rxCallbackMaxUs) {
+        g_rxCallbackMaxUs = elapsedUs;
+    }
+    portEXIT_CRITICAL(&g_probeMux);
+}
+
+static void startProbeCapture() {
+    LOGI("[PROBE] Starting WiFi promiscuous mode...\n");
+
+    // Initialize WiFi in station mode first
+    WiFi.mode(WIFI_STA);
+    WiFi.disconnect();
+    delay(100);
+
+    // Initialize channel hopping state (g_channelHopTimer moves it on)
+    g_currentChannelIndex = 0;
+    esp_wifi_set_channel(WIFI_CHANNELS[g_currentChannelIndex], WIFI_SECOND_CHAN_NONE);
+
+    // Configure promiscuous filter for management frames, plus frames that
+    // failed FCS so rxe counts them (the driver drops those otherwise)
+    wifi_promiscuous_filter_t filter = {
+        .filter_mask = WIFI_PROMIS_FILTER_MASK_MGMT | WIFI_PROMIS_FILTER_MASK_FCSFAIL
+    };
+    esp_wifi_set_promiscuous_filter(&filter);
+
+    // Register callback and enable promiscuous mode
+    esp_wifi_set_promiscuous_rx_cb(&wifiProbeCounterCallback);
+    esp_wifi_set_promiscuous(true);
+    radioAccountSwitch(g_currentChannelIndex);
+
+    LOGI("[PROBE] Channel hopping enabled: 1, 6, 11 (3s interval)\n");
+    LOGI("[PROBE] Starting on channel %d\n", WIFI_CHANNELS[g_currentChannelIndex]);
+}
+
+static void stopProbeCapture() {
+    esp_wifi_set_promiscuous(false);
+    radioAccountSwitch(LISTEN_SLOT_IDLE);
+    LOGI("[PROBE] Promiscuous mode stopped\n");
+}
+
+// Channel hopping - next channel in WIFI_CHANNELS
+static void hopChannel() {
+    g_currentChannelIndex = (g_currentChannelIndex + 1) % WIFI_CHANNEL_COUNT;
+    // Deaf while retuning - account the hop as idle time
+    radioAccountSwitch(LISTEN_SLOT_IDLE);
+    esp_wifi_set_channel(WIFI_CHANNELS[g_currentChannelIndex], WIFI_SECOND_CHAN_NONE);
+    radioAccountSwitch(g_currentChannelIndex);
+}
+
+// =============================================================================
+// BLE Passive Scanning - Accurate OS Detection via Manufacturer IDs
+// =============================================================================
+
+// NimBLE advertised device callback
+class BleAdvertisedDeviceCallbacks : public NimBLEAdvertisedDeviceCallbacks {
+    void onResult(NimBLEAdvertisedDevice* advertisedDevice) override {
+        // Get address (check for randomized MAC)
+        NimBLEAddress addr = advertisedDevice->getAddress();
+        uint8_t addrType = addr.getType();
+
+        // Only count randomized addresses (privacy filter)
+        // Type 1 = Random Address, Type 0 = Public Address
+        if (addrType == 0) {
+            // Public (static) address - not counted for privacy; its
+            // secret-salted hash only feeds the returning-visitor filter
+            visitorNote(addr.getNative(), 6);
+            return;
+        }
+
+        // Per-minute deduplication on a salted fingerprint (same as WiFi probes)
+        uint32_t currentMinute = millis() / 60000;
+        DeviceKeys keys = BleCounter::keysFor(addr.getNative(), currentMinute);
+
+        // Get signal strength
+        int rssi = advertisedDevice->getRSSI();
+
+        // Classify by manufacturer ID
+        DeviceType deviceType = DEVICE_OTHER;
+        if (advertisedDevice->haveManufacturerData()) {
+            std::string mfgData = advertisedDevice->getManufacturerData();
+            if (mfgData.length() >= 2) {
+                // Manufacturer ID is little-endian first 2 bytes
+                uint16_t mfgId = ((uint8_t)mfgData[1] << 8) | (uint8_t)mfgData[0];
+                deviceType = classifyBleDevice(mfgId);
+            }
+        }
+
+        // Every advertisement counts toward impressions and RSSI; the OS type
+        // only for devices new this minute
+        portENTER_CRITICAL(&g_bleMux);
+        g_bleCounter.observe(keys, rssi, currentMinute, deviceType);
+        portEXIT_CRITICAL(&g_bleMux);
+    }
+};
+
+static NimBLEScan* g_pBleScan = nullptr;
+static BleAdvertisedDeviceCallbacks g_bleCallbacks;
+
+static void initBle() {
+    if (g_bleInitialized) return;
+
+    LOGI("[BLE] Initializing NimBLE...\n");
+
+    // Initialize NimBLE in passive mode (no transmit)
+    NimBLEDevice::init("");
+
+    // Get scan object
+    g_pBleScan = NimBLEDevice::getScan();
+    g_pBleScan->setAdvertisedDeviceCallbacks(&g_bleCallbacks, false);
+    g_pBleScan->setActiveScan(false);  // Passive scan - no scan requests
+    g_pBleScan->setInterval(100);      // 100ms scan interval
+    g_pBleScan->setWindow(99);         // 99ms scan window (nearly continuous)
+    g_pBleScan->setMaxResults(0);      // Don't store results, use callback
+
+    g_bleInitialized = true;
+    LOGI("[BLE] NimBLE initialized (passive scan mode)\n");
+}
+
+static void startBleScan() {
+    if (!g_bleInitialized) {
+        initBle();
+    }
+
+    if (g_pBleScan && !g_pBleScan->isScanning()) {
+        g_pBleScan->setInterval(100);
+        g_pBleScan->setWindow(99);
+        g_pBleScan->setDuplicateFilter(true);
+        // Start scanning for BLE_SCAN_DURATION_MS (non-blocking)
+        g_pBleScan->start(BLE_SCAN_DURATION_MS / 1000, false);
+        radioAccountSwitch(LISTEN_SLOT_BLE);
+        LOGI("[BLE] Scanning started\n");
+    }
+}
+
+// Open-ended low-duty scan next to promiscuous capture (coexistence mode).
+// Duplicate filtering is off: a scan that never restarts would otherwise
+// report each device once, losing impressions and later minutes' uniques.
+static void startBleScanConcurrent() {
+    if (!g_bleInitialized) {
+        initBle();
+    }
+
+    if (g_pBleScan && !g_pBleScan->isScanning()) {
+        g_pBleScan->setInterval(BLE_COEX_SCAN_INTERVAL_MS);
+        g_pBleScan->setWindow(BLE_COEX_SCAN_WINDOW_MS);
+        g_pBleScan->setDuplicateFilter(false);
+        g_pBleScan->start(0, nullptr, false);  // 0 = until stopped
+        radioAccountCoexBle(true);
+        LOGI("[BLE] Concurrent scanning started (%u/%u ms)\n",
+             BLE_COEX_SCAN_WINDOW_MS, BLE_COEX_SCAN_INTERVAL_MS);
+    }
+}
+
+static void stopBleScan() {
+    if (g_pBleScan && g_pBleScan->isScanning()) {
+        g_pBleScan->stop();
+        LOGI("[BLE] Scanning stopped\n");
+    }
+    if (g_listenSlot == LISTEN_SLOT_BLE) {
+        radioAccountSwitch(LISTEN_SLOT_IDLE);
+    }
+    if (g_bleCoexSinceUs != 0) {
+        radioAccountCoexBle(false);
+    }
+}
+
+// Stop all capture (report uplink, OTA)
+static void radioCaptureStop() {
+    timerStop(&g_radioSliceTimer);
+    timerStop(&g_channelHopTimer);
+    if (g_radioSchedule == RADIO_SCHEDULE_COEX) {
+        stopBleScan();
+        stopProbeCapture();
+    } else if (g_radioMode == RADIO_WIFI) {
+        stopProbeCapture();
+    } else {
+        stopBleScan();
+    }
+}
+
+// Resume capture, switching schedule if one was requested meanwhile
+// (always starts in the WiFi slice when time-slicing)
+static void radioCaptureStart() {
+    if (g_radioScheduleNext != g_radioSchedule) {
+        g_radioSchedule = g_radioScheduleNext;
+        LOGI("[RADIO] Schedule: %s\n", g_radioSchedule == RADIO_SCHEDULE_COEX ? "coex" : "sliced");
+    }
+    g_radioMode = RADIO_WIFI;
+    g_lastRadioSwitch = millis();
+    startProbeCapture();
+    if (g_radioSchedule == RADIO_SCHEDULE_COEX) {
+        startBleScanConcurrent();
+    } else {
+        timerStart(&g_radioSliceTimer, WIFI_SCAN_DURATION_MS, 0);
+    }
+    timerStart(&g_channelHopTimer, CHANNEL_HOP_INTERVAL_MS, CHANNEL_HOP_INTERVAL_MS);
+}
+
+// Radio time-slicing: g_radioSliceTimer fired - switch between WiFi and BLE
+static void radioSliceExpired() {
+    g_lastRadioSwitch = millis();
+    if (g_radioMode == RADIO_WIFI) {
+        g_radioMode = RADIO_BLE;
+        timerStop(&g_channelHopTimer);
+        stopProbeCapture();
+        startBleScan();
+        timerStart(&g_radioSliceTimer, BLE_SCAN_DURATION_MS, 0);
+    } else {
+        g_radioMode = RADIO_WIFI;
+        stopBleScan();
+        startProbeCapture();
+        timerStart(&g_channelHopTimer, CHANNEL_HOP_INTERVAL_MS, CHANNEL_HOP_INTERVAL_MS);
+        timerStart(&g_radioSliceTimer, WIFI_SCAN_DURATION_MS, 0);
+    }
+}
+
+// g_channelHopTimer fired - runs only while WiFi is capturing
+static void channelHopExpired() {
+    hopChannel();
+    if (g_radioSchedule == RADIO_SCHEDULE_COEX && g_pBleScan && !g_pBleScan->isScanning()) {
+        // The BLE host ended the concurrent scan on its own - restart it
+        radioAccountCoexBle(false);
+        startBleScanConcurrent();
+    }
+}
+
+// =============================================================================
+// Modem Arbiter
+// =============================================================================
+// The modem UART and g_atBuffer are shared by the loop task (readings,
+// heartbeats, config, logs) and the delta OTA task. Every multi-command
+// transaction runs with the modem held. Recursive so a holder can call
+// helpers that also acquire.
+
+#define MODEM_WAIT_SLICE_MS  1000
+#define MODEM_UPLINK_WAIT_MS 120000   // Longest a report waits behind OTA
+
+static SemaphoreHandle_t g_modemMutex = nullptr;
+static const char* volatile g_modemOwner = "none";
+
+static void modemArbiterInit() {
+    g_modemMutex = xSemaphoreCreateRecursiveMutex();
+}
+
+// Take the modem, feeding the watchdog while waiting.
+// Returns false if not acquired within timeoutMs.
+static bool modemAcquire(const char* owner, uint32_t timeoutMs) {
+    uint32_t start = millis();
+    while (xSemaphoreTakeRecursive(g_modemMutex, pdMS_TO_TICKS(MODEM_WAIT_SLICE_MS)) != pdTRUE) {
+        esp_task_wdt_reset();
+        if ((millis() - start) >= timeoutMs) {
+            LOGW("[MODEM] %s gave up waiting for modem (held by %s)\n",
+                 owner, g_modemOwner);
+            return false;
+        }
+    }
+    uint32_t waited = millis() - start;
+    if (waited >= MODEM_WAIT_SLICE_MS) {
+        LOGI("[MODEM] %s waited %lu ms for modem (was %s)\n", owner, waited, g_modemOwner);
+    }
+    g_modemOwner = owner;
+    return true;
+}
+
+// Take the modem only if nobody holds it
+static bool modemTryAcquire(const char* owner) {
+    if (xSemaphoreTakeRecursive(g_modemMutex, 0) != pdTRUE) return false;
+    g_modemOwner = owner;
+    return true;
+}
+
+static void modemRelease() {
+    xSemaphoreGiveRecursive(g_modemMutex);
+}
+
+// =============================================================================
+// Link State (URC-driven)
+// =============================================================================
+// Signal and registration are tracked from +CSQ / +CEREG lines as they pass
+// through the RX demultiplexer - unsolicited reports (AT+CEREG=2,
+// AT+AUTOCSQ=1,1) and solicited responses alike. Readers use the cache and
+// only go to the modem when it is stale.
+
+#define LINK_SIGNAL_STALE_MS (10UL * 60UL * 1000UL)  // Re-poll CSQ after this
+#define LINK_REG_STALE_MS    (30UL * 60UL * 1000UL)  // Re-query CEREG after this
+
+struct LinkState {
+    int8_t regStat;          // +CEREG <stat>: 1 home, 5 roaming, 2 searching, -1 unknown
+    uint32_t regAtMs;        // millis() of last registration update, 0 = never
+    uint16_t regChanges;     // Registration transitions seen since boot
+    char tac[8];             // Tracking area code (hex)
+    char cellId[12];         // E-UTRAN cell ID (hex)
+    int16_t rssiDbm;         // -999 = unknown
+    uint8_t ber;
+    uint32_t rssiAtMs;       // millis() of last signal update, 0 = never
+};
+
+static LinkState g_linkState = { -1, 0, 0, "", "", -999, 99, 0 };
+static portMUX_TYPE g_linkStateMux = portMUX_INITIALIZER_UNLOCKED;
+static bool g_linkSignalUrc = false;   // Modem accepted AT+AUTOCSQ
+
+// Convert CSQ rssi index to dBm
+// 0 = -113 dBm or less
+// 1 = -111 dBm
+// 2-30 = -109 to -53 dBm (2 dBm steps)
+// 31 = -51 dBm or greater
+// 99 = not known or not detectable
+static int csqToDbm(int rssi) {
+    if (rssi == 99) return -999;
+    if (rssi == 0) return -113;
+    if (rssi == 31) return -51;
+    return -113 + (rssi * 2);
+}
+
+// Copy a quoted field ("...") starting at p into out
+static const char* linkStateQuoted(const char* p, char* out, size_t outSize) {
+    const char* q = p ? strchr(p, '"') : nullptr;
+    if (!q) return nullptr;
+    const char* end = strchr(q + 1, '"');
+    if (!end) return nullptr;
+    size_t n = end - (q + 1);
+    if (n >= outSize) n = outSize - 1;
+    memcpy(out, q + 1, n);
+    out[n] = '\0';
+    return end + 1;
+}
+
+// Update the cache from one modem line (called by the demultiplexer)
+static void linkStateParseLine(const char* line) {
+    uint32_t now = millis() | 1;  // 0 = never
+
+    if (strncmp(line, "+CSQ:", 5) == 0) {
+        int rssi = 99, ber = 99;
+        if (sscanf(line + 5, " %d,%d", &rssi, &ber) != 2) return;
+        portENTER_CRITICAL(&g_linkStateMux);
+        g_linkState.rssiDbm = (int16_t)csqToDbm(rssi);
+        g_linkState.ber = (uint8_t)ber;
+        g_linkState.rssiAtMs = now;
+        portEXIT_CRITICAL(&g_linkStateMux);
+        return;
+    }
+
+    if (strncmp(line, "+CEREG:", 7) == 0) {
+        // Query response: +CEREG: <n>,<stat>[,"tac","ci",act]
+        // URC:            +CEREG: <stat>[,"tac","ci",act]
+        const char* p = line + 7;
+        while (*p == ' ') p++;
+        if (*p < '0' || *p > '9') return;
+        int stat = atoi(p);
+        const char* rest = strchr(p, ',');
+        if (rest && rest[1] >= '0' && rest[1] <= '9') {
+            stat = atoi(rest + 1);
+            rest = strchr(rest + 1, ',');
+        }
+        char tac[sizeof(g_linkState.tac)] = "";
+        char cellId[sizeof(g_linkState.cellId)] = "";
+        const char* next = linkStateQuoted(rest, tac, sizeof(tac));
+        linkStateQuoted(next, cellId, sizeof(cellId));
+
+        portENTER_CRITICAL(&g_linkStateMux);
+        bool changed = (g_linkState.regStat != stat);
+        if (changed) g_linkState.regChanges++;
+        g_linkState.regStat = (int8_t)stat;
+        g_linkState.regAtMs = now;
+        if (tac[0]) strcpy(g_linkState.tac, tac);
+        if (cellId[0]) strcpy(g_linkState.cellId, cellId);
+        portEXIT_CRITICAL(&g_linkStateMux);
+
+        if (changed) {
+            LOGI("[LINK] Registration stat=%d tac=%s ci=%s\n", stat, tac, cellId);
+        }
+    }
+}
+
+static LinkState linkStateSnapshot() {
+    portENTER_CRITICAL(&g_linkStateMux);
+    LinkState snap = g_linkState;
+    portEXIT_CRITICAL(&g_linkStateMux);
+    return snap;
+}
+
+static bool linkStateRegistered() {
+    int8_t stat = linkStateSnapshot().regStat;
+    return stat == 1 || stat == 5;
+}
+
+// True if a fresh registration report says we are NOT registered
+static bool linkStateLostRegistration() {
+    LinkState ls = linkStateSnapshot();
+    return ls.regAtMs != 0 && (millis() - ls.regAtMs) < LINK_REG_STALE_MS &&
+           ls.regStat != 1 && ls.regStat != 5;
+}
+
+// Cached signal in dBm, or -999 if never seen or older than LINK_SIGNAL_STALE_MS
+static int linkStateSignalDbm() {
+    LinkState ls = linkStateSnapshot();
+    if (ls.rssiAtMs == 0 || (millis() - ls.rssiAtMs) >= LINK_SIGNAL_STALE_MS) return -999;
+    return ls.rssiDbm;
+}
+
+// =============================================================================
+// Data Usage Accounting
+// =============================================================================
+// Every byte that crosses the air interface is charged to a per-day and a
+// per-month counter: TCP payload written with atSendRaw(), socket data
+// announced by +RECEIVE/+IPD headers (all links), and an estimate of the
+// IP/TCP overhead the modem adds per segment and per connection. The budget
+// governor (after Time Keeping) rolls the counters over and acts on them.
+
+#define USAGE_SEGMENT_OVERHEAD_BYTES    40    // IPv4 + TCP headers per payload segment
+#define USAGE_CONNECTION_OVERHEAD_BYTES 240   // Handshake, FIN and bare ACKs per connection
+
+static uint32_t g_usageDayBytes = 0;
+static uint32_t g_usageMonthBytes = 0;
+static portMUX_TYPE g_usageMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void usageCharge(uint32_t bytes) {
+    portENTER_CRITICAL(&g_usageMux);
+    g_usageDayBytes += bytes;
+    g_usageMonthBytes += bytes;
+    portEXIT_CRITICAL(&g_usageMux);
+}
+
+// Foreground URC hook - a successful CIPOPEN costs a TCP handshake
+static void usageParseLine(const char* line) {
+    int link, err;
+    if (sscanf(line, "+CIPOPEN: %d,%d", &link, &err) == 2 && err == 0) {
+        usageCharge(USAGE_CONNECTION_OVERHEAD_BYTES);
+    }
+}
+
+// =============================================================================
+// Modem RX Demultiplexer
+// =============================================================================
+// The SIM7028 delivers socket data inline as "+RECEIVE,<link>,<len>\r\n<data>"
+// (or "+IPD,<link>,<len>"). Link 0 is the foreground link: its data passes
+// through to the AT reader exactly as before. Data for background links
+// (OTA on link 1) is diverted into that link's buffer, so a report on link 0
+// and an OTA chunk on link 1 can be in flight at the same time. Whoever
+// holds the modem arbiter pumps the UART, so background data keeps flowing
+// while another task owns the modem.
+
+#define MODEM_LINK_REPORT 0     // Readings, heartbeats, config, logs, geolocation
+#define MODEM_LINK_OTA    1     // Delta OTA chunk downloads
+#define MODEM_LINK_COUNT  2
+#define MODEM_LINK_RX_SIZE 1536 // Chunk response: HTTP headers + ~700 B base64 JSON
+#define MODEM_RX_BUFFER_SIZE 4096  // UART driver RX buffer - covers poll gaps at fast baud
+#define MODEM_RX_FIFO_FULL   64    // RX interrupt threshold (of 128 B hardware FIFO)
+
+// UART-bound time accounting (bytes on the wire and blocking TX time)
+static volatile uint32_t g_uartTxBytes = 0;
+static volatile uint32_t g_uartRxBytes = 0;
+static volatile uint32_t g_uartTxUs = 0;      // Time spent writing + draining TX
+static uint32_t g_modemBaud = MODEM_BAUD;     // Rate currently in use
+static bool g_modemFlowControl = false;
+
+struct ModemLink {
+    volatile bool busy;          // Between open and close
+    volatile bool peerClosed;    // Saw +IPCLOSE for this link
+    uint32_t openCount;          // Opens so far (overlap detection)
+    char* rx;                    // Diverted data, nullptr = foreground
+    size_t rxCap;
+    volatile size_t rxLen;
+    bool rxOverflow;
+};
+
+static char g_otaLinkRx[MODEM_LINK_RX_SIZE];
+static ModemLink g_links[MODEM_LINK_COUNT] = {
+    { false, false, 0, nullptr,    0,                  0, false },
+    { false, false, 0, g_otaLinkRx, sizeof(g_otaLinkRx), 0, false },
+};
+
+enum ModemDemuxState { DMX_PASS, DMX_HEADER, DMX_DATA };
+
+static ModemDemuxState g_dmxState = DMX_PASS;
+static bool g_dmxLineStart = true;
+static char g_dmxHold[32];               // Candidate URC header being matched
+static uint8_t g_dmxHoldLen = 0;
+static uint8_t g_dmxLink = 0;            // Link receiving DMX_DATA bytes
+static uint16_t g_dmxRemaining = 0;
+
+// Foreground bytes ready for the AT reader
+static char g_dmxFg[64];
+static uint8_t g_dmxFgHead = 0;
+static uint8_t g_dmxFgCount = 0;
+
+static const char* const DMX_PREFIXES[] = { "+RECEIVE,", "+IPD,", "+IPCLOSE:" };
+
+// Current foreground line, scanned for link-state URCs
+static char g_dmxLine[96];
+static uint8_t g_dmxLineLen = 0;
+
+static void dmxFgPush(char c) {
+    if (g_dmxFgCount < sizeof(g_dmxFg)) {
+        g_dmxFg[(g_dmxFgHead + g_dmxFgCount) % sizeof(g_dmxFg)] = c;
+        g_dmxFgCount++;
+    }
+
+    if (c == '\n') {
+        g_dmxLine[g_dmxLineLen] = '\0';
+        if (g_dmxLine[0] == '+') {
+            linkStateParseLine(g_dmxLine);
+            usageParseLine(g_dmxLine);
+        }
+        g_dmxLineLen = 0;
+    } else if (c != '\r' && g_dmxLineLen < sizeof(g_dmxLine) - 1) {
+        g_dmxLine[g_dmxLineLen++] = c;
+    }
+}
+
+static void dmxFlushHold() {
+    for (uint8_t i = 0; i < g_dmxHoldLen; i++) dmxFgPush(g_dmxHold[i]);
+    g_dmxHoldLen = 0;
+}
+
+// True while the held bytes could still become one of DMX_PREFIXES
+static bool dmxHoldIsPrefix() {
+    for (const char* prefix : DMX_PREFIXES) {
+        size_t n = strlen(prefix);
+        if (g_dmxHoldLen <= n ? strncmp(g_dmxHold, prefix, g_dmxHoldLen) == 0
+                              : strncmp(g_dmxHold, prefix, n) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Complete header line held - divert the payload if it is for a background link
+static void dmxHeaderLine() {
+    g_dmxHold[g_dmxHoldLen] = '\0';
+    int link = -1, len = 0;
+    if (sscanf(g_dmxHold, "+RECEIVE,%d,%d", &link, &len) == 2 ||
+        sscanf(g_dmxHold, "+IPD,%d,%d", &link, &len) == 2) {
+        if (len > 0) usageCharge((uint32_t)len + USAGE_SEGMENT_OVERHEAD_BYTES);
+        if (link > 0 && link < MODEM_LINK_COUNT && g_links[link].rx && len > 0) {
+            g_dmxLink = (uint8_t)link;
+            g_dmxRemaining = (uint16_t)len;
+            g_dmxHoldLen = 0;
+            g_dmxState = DMX_DATA;
+            return;
+        }
+    } else if (sscanf(g_dmxHold, "+IPCLOSE: %d", &link) == 1 &&
+               link >= 0 && link < MODEM_LINK_COUNT) {
+        g_links[link].peerClosed = true;
+    }
+    dmxFlushHold();
+    g_dmxState = DMX_PASS;
+    g_dmxLineStart = true;
+}
+
+static void dmxFeed(char c) {
+    switch (g_dmxState) {
+        case DMX_DATA: {
+            ModemLink& l = g_links[g_dmxLink];
+            if (l.rxLen < l.rxCap - 1) {
+                l.rx[l.rxLen] = c;
+                l.rxLen = l.rxLen + 1;
+                l.rx[l.rxLen] = '\0';
+            } else {
+                l.rxOverflow = true;
+            }
+            if (--g_dmxRemaining == 0) {
+                g_dmxState = DMX_PASS;
+                g_dmxLineStart = true;
+            }
+            return;
+        }
+
+        case DMX_HEADER:
+            g_dmxHold[g_dmxHoldLen++] = c;
+            if (c == '\n') {
+                dmxHeaderLine();
+            } else if (!dmxHoldIsPrefix() || g_dmxHoldLen >= sizeof(g_dmxHold) - 1) {
+                dmxFlushHold();
+                g_dmxState = DMX_PASS;
+                g_dmxLineStart = false;
+            }
+            return;
+
+        case DMX_PASS:
+            if (g_dmxLineStart && c == '+') {
+                g_dmxHold[0] = c;
+                g_dmxHoldLen = 1;
+                g_dmxState = DMX_HEADER;
+                g_dmxLineStart = false;
+                return;
+            }
+            dmxFgPush(c);
+            g_dmxLineStart = (c == '\n');
+            return;
+    }
+}
+
+// Foreground byte available? Pumps the UART through the demultiplexer.
+// Replaces ModemSerial.available() for every AT reader.
+static bool modemAvailable() {
+    while (g_dmxFgCount == 0 && ModemSerial.available()) {
+        dmxFeed((char)ModemSerial.read());
+        g_uartRxBytes++;
+    }
+    return g_dmxFgCount > 0;
+}
+
+// Next foreground byte - only valid after modemAvailable() returned true
+static char modemRead() {
+    char c = g_dmxFg[g_dmxFgHead];
+    g_dmxFgHead = (g_dmxFgHead + 1) % sizeof(g_dmxFg);
+    g_dmxFgCount--;
+    return c;
+}
+
+// Move everything the UART has into link buffers (foreground bytes stay queued)
+static void modemPump() {
+    while (g_dmxFgCount < sizeof(g_dmxFg) - sizeof(g_dmxHold) && ModemSerial.available()) {
+        dmxFeed((char)ModemSerial.read());
+        g_uartRxBytes++;
+    }
+}
+
+// =============================================================================
+// AT Command Interface
+// =============================================================================
+
+// Write to the modem and wait for the TX FIFO to drain, timing the UART-bound part
+static void modemUartWrite(const uint8_t* data, size_t len) {
+    int64_t start = esp_timer_get_time();
+    ModemSerial.write(data, len);
+    ModemSerial.flush();
+    g_uartTxUs += (uint32_t)(esp_timer_get_time() - start);
+    g_uartTxBytes += len;
+}
+
+// Clear the AT response buffer
+static void atClearBuffer() {
+    g_atBufferLen = 0;
+    g_atBuffer[0] = '\0';
+}
+
+// Send AT command and wait for response
+// Returns true if expected response found, false on timeout
+static bool atSendCommand(const char* cmd, const char* expect, uint32_t timeoutMs) {
+    atClearBuffer();
+
+    // Flush any pending input
+    while (modemAvailable()) {
+        modemRead();
+    }
+
+    // Send command
+    LOGD("[AT TX] %s\n", cmd);
+    modemUartWrite((const uint8_t*)cmd, strlen(cmd));
+    modemUartWrite((const uint8_t*)"\r\n", 2);
+
+    uint32_t startTime = millis();
+    bool found = false;
+
+    while ((millis() - startTime) < timeoutMs && !found) {
+        while (modemAvailable() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
+            char c = modemRead();
+            g_atBuffer[g_atBufferLen++] = c;
+            g_atBuffer[g_atBufferLen] = '\0';
+
+            // Check for expected response
+            if (expect && strstr(g_atBuffer, expect)) {
+                found = true;
+                break;
+            }
+
+            // Check for error
+            if (strstr(g_atBuffer, "ERROR")) {
+                LOGD_DUMP("[AT RX] ", g_atBuffer);
+                return false;
+            }
+        }
+        delay(10);
+    }
+
+    LOGD_DUMP("[AT RX] ", g_atBuffer);
+    return found;
+}
+
+// Send raw data (for TCP payload)
+static void atSendRaw(const char* data, size_t len) {
+    LOGD("[AT TX RAW] (%zu bytes)\n", len);
+    modemUartWrite((const uint8_t*)data, len);
+    usageCharge((uint32_t)len + USAGE_SEGMENT_OVERHEAD_BYTES);
+}
+
+// Wait for specific string in modem output
+static bool atWaitFor(const char* expect, uint32_t timeoutMs) {
+    atClearBuffer();
+    uint32_t startTime = millis();
+
+    while ((millis() - startTime) < timeoutMs) {
+        while (modemAvailable() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
+            char c = modemRead();
+            g_atBuffer[g_atBufferLen++] = c;
+            g_atBuffer[g_atBufferLen] = '\0';
+
+            if (strstr(g_atBuffer, expect)) {
+                LOGD_DUMP("[AT RX] ", g_atBuffer);
+                return true;
+            }
+        }
+        delay(10);
+    }
+
+    LOGD_DUMP("[AT RX TIMEOUT] ", g_atBuffer);
+    return false;
+}
+
+// =============================================================================
+// Modem UART Rate & Flow Control
+// =============================================================================
+
+// Switch the ESP32 side to baud and check the modem answers there
+static bool modemTryBaud(uint32_t baud) {
+    ModemSerial.updateBaudRate(baud);
+    g_modemBaud = baud;
+    delay(50);
+    for (int i = 0; i < 3; i++) {
+        if (atSendCommand("AT", "OK", 500)) return true;
+    }
+    return false;
+}
+
+// Find the rate the modem is at. AT+IPR survives an ESP32 reset, so after
+// a reboot the modem may still be at the fast rate.
+static bool modemSyncBaud() {
+    if (modemTryBaud(MODEM_BAUD)) return true;
+    if (MODEM_BAUD_FAST != 0 && MODEM_BAUD_FAST != MODEM_BAUD && modemTryBaud(MODEM_BAUD_FAST)) {
+        LOGI("[UART] Modem answered at %lu baud\n", (uint32_t)MODEM_BAUD_FAST);
+        return true;
+    }
+    modemTryBaud(MODEM_BAUD);
+    return false;
+}
+
+// Move the modem to MODEM_BAUD_FAST, falling back to MODEM_BAUD if it
+// does not answer at the new rate
+static void modemNegotiateBaud() {
+    if (MODEM_BAUD_FAST == 0 || g_modemBaud == MODEM_BAUD_FAST) return;
+    if (MODEM_RTS_PIN >= 0 && MODEM_CTS_PIN >= 0 && !g_modemFlowControl) {
+        LOGW("[UART] No flow control, staying at %lu baud\n", g_modemBaud);
+        return;
+    }
+
+    // AT Command: AT+IPR=<rate>
+    // Purpose: Set modem UART rate (takes effect after OK)
+    // Expected Response: OK (at the old rate)
+    char cmd[24];
+    snprintf(cmd, sizeof(cmd), "AT+IPR=%lu", (uint32_t)MODEM_BAUD_FAST);
+    if (!atSendCommand(cmd, "OK", 2000)) {
+        LOGW("[UART] AT+IPR rejected, staying at %lu baud\n", g_modemBaud);
+        return;
+    }
+
+    if (modemTryBaud(MODEM_BAUD_FAST)) {
+        ModemSerial.setRxFIFOFull(MODEM_RX_FIFO_FULL);
+        LOGI("[UART] Modem link now %lu baud\n", g_modemBaud);
+        return;
+    }
+
+    // No answer at the fast rate - go back. The modem switched (it sent OK),
+    // so ask it to return to the default from whichever rate it is at.
+    LOGW("[UART] No response at %lu baud, falling back\n", (uint32_t)MODEM_BAUD_FAST);
+    if (!modemSyncBaud()) return;
+    if (g_modemBaud != MODEM_BAUD) {
+        snprintf(cmd, sizeof(cmd), "AT+IPR=%lu", (uint32_t)MODEM_BAUD);
+        atSendCommand(cmd, "OK", 2000);
+        modemTryBaud(MODEM_BAUD);
+    }
+}
+
+// Enable RTS/CTS on both ends when the board wires the pins
+static void modemEnableFlowControl() {
+    if (MODEM_RTS_PIN < 0 || MODEM_CTS_PIN < 0 || g_modemFlowControl) return;
+
+    // AT Command: AT+IFC=2,2
+    // Purpose: RTS/CTS hardware flow control in both directions
+    // Expected Response: OK
+    if (!atSendCommand("AT+IFC=2,2", "OK", 2000)) {
+        LOGW("[UART] AT+IFC rejected, no flow control\n");
+        return;
+    }
+    ModemSerial.setPins(-1, -1, MODEM_CTS_PIN, MODEM_RTS_PIN);
+    ModemSerial.setHwFlowCtrlMode(HW_FLOWCTRL_CTS_RTS, MODEM_RX_FIFO_FULL);
+    g_modemFlowControl = true;
+    LOGI("[UART] RTS/CTS flow control enabled\n");
+}
+
+// UART-bound share of modem traffic: measured TX time, plus wire time for
+// all bytes at the current rate and at MODEM_BAUD for comparison
+static void modemUartLog() {
+    uint32_t bytes = g_uartTxBytes + g_uartRxBytes;
+    uint32_t wireMs = (uint32_t)((uint64_t)bytes * 10 * 1000 / g_modemBaud);
+    uint32_t baseMs = (uint32_t)((uint64_t)bytes * 10 * 1000 / MODEM_BAUD);
+    LOGI("[UART] %lu baud%s: tx %lu B (%lu ms blocking), rx %lu B, wire %lu ms (%lu ms at %lu)\n",
+         g_modemBaud, g_modemFlowControl ? " RTS/CTS" : "",
+         g_uartTxBytes, g_uartTxUs / 1000, g_uartRxBytes, wireMs, baseMs, (uint32_t)MODEM_BAUD);
+}
+
+// =============================================================================
+// Socket Manager
+// =============================================================================
+// Thin wrappers for CIPOPEN/CIPSEND/CIPCLOSE on a given link ID. Callers
+// hold the modem arbiter for each call; a background link's response is
+// collected by the demultiplexer in between.
+
+static bool modemLinkOpen(uint8_t link) {
+    ModemLink& l = g_links[link];
+    l.rxLen = 0;
+    l.rxOverflow = false;
+    l.peerClosed = false;
+    if (l.rx) l.rx[0] = '\0';
+
+    char cmd[128];
+    char expect[24];
+    snprintf(cmd, sizeof(cmd), "AT+CIPOPEN=%d,\"TCP\",\"%s\",%d", link, BACKEND_HOST, BACKEND_PORT);
+    snprintf(expect, sizeof(expect), "+CIPOPEN: %d,0", link);
+    if (!atSendCommand(cmd, expect, TCP_CONNECT_TIMEOUT_MS)) {
+        LOGW("[SOCK] Link %d connect failed\n", link);
+        snprintf(cmd, sizeof(cmd), "AT+CIPCLOSE=%d", link);
+        atSendCommand(cmd, "OK", 5000);
+        return false;
+    }
+    l.busy = true;
+    l.openCount++;
+    delay(300);
+    return true;
+}
+
+static bool modemLinkSend(uint8_t link, const char* data, size_t len) {
+    char cmd[32];
+    snprintf(cmd, sizeof(cmd), "AT+CIPSEND=%d,%u", link, (unsigned)len);
+    if (!atSendCommand(cmd, ">", AT_COMMAND_TIMEOUT_MS)) {
+        LOGW("[SOCK] Link %d CIPSEND prompt failed\n", link);
+        return false;
+    }
+    atSendRaw(data, len);
+    if (!atWaitFor("+CIPSEND:", 15000)) {
+        LOGW("[SOCK] Link %d send confirmation timeout\n", link);
+        return false;
+    }
+    return true;
+}
+
+static void modemLinkClose(uint8_t link) {
+    char cmd[24];
+    snprintf(cmd, sizeof(cmd), "AT+CIPCLOSE=%d", link);
+    atSendCommand(cmd, "OK", 5000);
+    g_links[link].busy = false;
+}
+
+// Mark the foreground link in use for a whole report/heartbeat cycle. Those
+// transactions still issue CIPOPEN=0 themselves; this only feeds overlap stats.
+static void modemLinkClaim(uint8_t link, bool busy) {
+    if (busy) g_links[link].openCount++;
+    g_links[link].busy = busy;
+}
+
+// True once a background link holds a full HTTP response (Content-Length
+// satisfied) or the server closed the connection
+static bool modemLinkResponseComplete(uint8_t link) {
+    const ModemLink& l = g_links[link];
+    if (l.peerClosed || l.rxOverflow) return true;
+    const char* body = strstr(l.rx, "\r\n\r\n");
+    if (!body) return false;
+    const char* cl = strcasestr(l.rx, "Content-Length:");
+    if (!cl || cl > body) return false;
+    size_t contentLength = (size_t)atoi(cl + 15);
+    return (size_t)(l.rx + l.rxLen - (body + 4)) >= contentLength;
+}
+
+// Transaction latency, split by whether the other link was busy meanwhile
+enum LatencyKind { LATENCY_REPORT = 0, LATENCY_OTA_CHUNK, LATENCY_KIND_COUNT };
+
+struct LatencyStat {
+    uint32_t count;
+    uint32_t sumMs;
+    uint32_t maxMs;
+};
+
+static LatencyStat g_latency[LATENCY_KIND_COUNT][2];   // [kind][overlapped]
+static portMUX_TYPE g_latencyMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void latencyRecord(LatencyKind kind, bool overlapped, uint32_t ms) {
+    portENTER_CRITICAL(&g_latencyMux);
+    LatencyStat& st = g_latency[kind][overlapped ? 1 : 0];
+    st.count++;
+    st.sumMs += ms;
+    if (ms > st.maxMs) st.maxMs = ms;
+    portEXIT_CRITICAL(&g_latencyMux);
+}
+
+static void latencyLog() {
+    LatencyStat snap[LATENCY_KIND_COUNT][2];
+    portENTER_CRITICAL(&g_latencyMux);
+    memcpy(snap, g_latency, sizeof(snap));
+    portEXIT_CRITICAL(&g_latencyMux);
+
+    static const char* const names[LATENCY_KIND_COUNT] = { "report", "ota-chunk" };
+    for (int k = 0; k < LATENCY_KIND_COUNT; k++) {
+        if (snap[k][0].count == 0 && snap[k][1].count == 0) continue;
+        LOGI("[LATENCY] %s solo: n=%lu avg=%lu max=%lu ms | overlapped: n=%lu avg=%lu max=%lu ms\n",
+             names[k],
+             snap[k][0].count, snap[k][0].count ? snap[k][0].sumMs / snap[k][0].count : 0,
+             snap[k][0].maxMs,
+             snap[k][1].count, snap[k][1].count ? snap[k][1].sumMs / snap[k][1].count : 0,
+             snap[k][1].maxMs);
+    }
+}
+
+// =============================================================================
+// Time Keeping
+// =============================================================================
+// Wall time = anchor epoch + millis() elapsed since the anchor, corrected by
+// the estimated crystal drift. Anchors come from the modem's network clock
+// (AT+CCLK?, set by NITZ) when the network provides it, else from the
+// heartbeat's server_time. Drift is estimated from raw millis() against a
+// drift reference sync of the same source, kept across re-anchors so each
+// sample spans at least TIME_DRIFT_MIN_SPAN_MS (1 s of sync resolution is
+// then +-12 ppm rather than +-46 ppm over one 6 h re-sync).
+
+#define TIME_FALLBACK_EPOCH     1769587200UL             // 2026-01-28T08:00:00Z until first sync
+#define TIME_MIN_VALID_EPOCH    1735689600UL             // 2025-01-01 - rejects unset modem clocks
+#define TIME_MODEM_SYNC_MS      (6UL * 60UL * 60UL * 1000UL)   // Re-read modem clock
+#define TIME_STALE_MS           (48UL * 60UL * 60UL * 1000UL)  // Quality drops after this
+#define TIME_DRIFT_MIN_SPAN_MS  (24UL * 60UL * 60UL * 1000UL) // Shortest span for a drift sample
+#define TIME_DRIFT_MAX_SPAN_S   (40UL * 24UL * 60UL * 60UL)    // Longer spans may wrap millis()
+#define TIME_DRIFT_MAX_PPM      500
+
+// Per-reading time quality ("tq" in the payload)
+enum TimeQuality {
+    TIME_QUALITY_NONE = 0,      // Never synced - fallback epoch
+    TIME_QUALITY_STALE = 1,     // Synced, but longer ago than TIME_STALE_MS
+    TIME_QUALITY_SERVER = 2,    // Backend server_time (HTTP latency, ~1-2 s)
+    TIME_QUALITY_NETWORK = 3,   // Modem network time (NITZ)
+};
+
+static uint32_t g_timeAnchorEpoch = TIME_FALLBACK_EPOCH;
+static uint32_t g_timeAnchorMs = 0;          // millis() at the anchor
+static uint8_t g_timeSource = TIME_QUALITY_NONE;
+static int32_t g_timeDriftPpm = 0;           // + = local clock runs slow
+static uint32_t g_timeLastModemSync = 0;     // millis() of last AT+CCLK? attempt
+static uint32_t g_timeDriftRefEpoch = 0;     // Drift reference sync...
+static uint32_t g_timeDriftRefMs = 0;        // ...its millis()...
+static uint8_t g_timeDriftRefSource = TIME_QUALITY_NONE;  // ...and source
+
+// Days since 1970-01-01 for a proleptic Gregorian date (closed form)
+static int32_t daysFromCivil(int year, unsigned month, unsigned day) {
+    year -= month <= 2;
+    const int era = (year >= 0 ? year : year - 399) / 400;
+    const unsigned yoe = (unsigned)(year - era * 400);
+    const unsigned doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+static uint32_t civilToEpoch(int year, int month, int day, int hour, int minute, int second) {
+    return (uint32_t)daysFromCivil(year, month, day) * 86400UL +
+           hour * 3600UL + minute * 60UL + second;
+}
+
+// Drift-corrected seconds elapsed since the anchor
+static uint32_t timeElapsedSinceAnchor(uint32_t nowMs) {
+    int64_t elapsedMs = (int64_t)(uint32_t)(nowMs - g_timeAnchorMs);
+    elapsedMs += elapsedMs * g_timeDriftPpm / 1000000;
+    return (uint32_t)(elapsedMs / 1000);
+}
+
+// Current Unix time
+static uint32_t timeNow() {
+    return g_timeAnchorEpoch + timeElapsedSinceAnchor(millis());
+}
+
+// Unix time in ms at millis() == atMs (which may precede the anchor)
+static uint64_t timeMsAt(uint32_t atMs) {
+    int64_t elapsedMs = (int32_t)(atMs - g_timeAnchorMs);
+    elapsedMs += elapsedMs * g_timeDriftPpm / 1000000;
+    return (uint64_t)g_timeAnchorEpoch * 1000 + elapsedMs;
+}
+
+static TimeQuality timeQuality() {
+    if (g_timeSource == TIME_QUALITY_NONE) return TIME_QUALITY_NONE;
+    if ((millis() - g_timeAnchorMs) >= TIME_STALE_MS) return TIME_QUALITY_STALE;
+    return (TimeQuality)g_timeSource;
+}
+
+// Re-anchor to epoch (taken at millis() == atMs) from source
+static void timeApplySync(uint32_t epoch, uint32_t atMs, TimeQuality source) {
+    if (epoch < TIME_MIN_VALID_EPOCH) return;
+
+    // Server time must not override recent network time
+    if (source < g_timeSource && timeQuality() == (TimeQuality)g_timeSource) {
+        LOGD("[TIME] Ignoring quality %d sync, have %d\n", source, g_timeSource);
+        return;
+    }
+
+    uint32_t spanMs = atMs - g_timeAnchorMs;
+    int32_t errorS = (int32_t)(epoch - (g_timeAnchorEpoch + timeElapsedSinceAnchor(atMs)));
+
+    // Drift sample: raw millis() against the source since the drift reference.
+    // A better source restarts the reference, a worse one leaves it alone.
+    if (source > g_timeDriftRefSource || epoch - g_timeDriftRefEpoch > TIME_DRIFT_MAX_SPAN_S) {
+        g_timeDriftRefEpoch = epoch;
+        g_timeDriftRefMs = atMs;
+        g_timeDriftRefSource = source;
+    } else if (source == g_timeDriftRefSource && atMs - g_timeDriftRefMs >= TIME_DRIFT_MIN_SPAN_MS) {
+        uint32_t refSpanMs = atMs - g_timeDriftRefMs;
+        int64_t trueSpanMs = (int64_t)(int32_t)(epoch - g_timeDriftRefEpoch) * 1000;
+        int32_t samplePpm = (int32_t)((trueSpanMs - refSpanMs) * 1000000LL / refSpanMs);
+        if (samplePpm > TIME_DRIFT_MAX_PPM) samplePpm = TIME_DRIFT_MAX_PPM;
+        if (samplePpm < -TIME_DRIFT_MAX_PPM) samplePpm = -TIME_DRIFT_MAX_PPM;
+        g_timeDriftPpm = (g_timeDriftPpm + samplePpm) / 2;  // Smooth
+        g_timeDriftRefEpoch = epoch;
+        g_timeDriftRefMs = atMs;
+    }
+
+    if (g_timeSource != TIME_QUALITY_NONE) {
+        LOGI("[TIME] Sync (q=%d): error %ld s over %lu s, drift %ld ppm\n",
+             source, errorS, spanMs / 1000, g_timeDriftPpm);
+    } else {
+        LOGI("[TIME] First sync (q=%d): %lu\n", source, epoch);
+    }
+
+    g_timeAnchorEpoch = epoch;
+    g_timeAnchorMs = atMs;
+    g_timeSource = source;
+    g_bootTimestamp = epoch - atMs / 1000;
+    g_timeSynced = true;
+}
+
+// Read the modem's network-set clock
+// Response: +CCLK: "yy/MM/dd,hh:mm:ss+zz" (local time, zz = quarter hours from UTC)
+static bool timeSyncFromModem() {
+    g_timeLastModemSync = millis();
+
+    // AT Command: AT+CCLK?
+    // Purpose: Query real-time clock (set from NITZ when AT+CTZU=1)
+    // Expected Response: +CCLK: "26/01/28,08:00:00+00"\r\nOK
+    if (!atSendCommand("AT+CCLK?", "OK", 2000)) return false;
+    uint32_t atMs = millis();
+
+    char* ptr = strstr(g_atBuffer, "+CCLK:");
+    if (!ptr) return false;
+    ptr = strchr(ptr, '"');
+    if (!ptr) return false;
+
+    int yy, mo, dd, hh, mi, ss, tz = 0;
+    char sign = '+';
+    int n = sscanf(ptr + 1, "%d/%d/%d,%d:%d:%d%c%d", &yy, &mo, &dd, &hh, &mi, &ss, &sign, &tz);
+    if (n < 6) {
+        LOGW("[TIME] Failed to parse CCLK: %s\n", ptr);
+        return false;
+    }
+
+    int32_t offsetS = (n == 8) ? tz * 15 * 60 * (sign == '-' ? -1 : 1) : 0;
+    uint32_t epoch = civilToEpoch(2000 + yy, mo, dd, hh, mi, ss) - offsetS;
+    if (epoch < TIME_MIN_VALID_EPOCH) {
+        LOGD("[TIME] Modem clock not set by network (year %d)\n", 2000 + yy);
+        return false;
+    }
+
+    timeApplySync(epoch, atMs, TIME_QUALITY_NETWORK);
+    return true;
+}
+
+// Re-read the modem clock if due (caller holds the modem)
+static void timeMaybeSyncFromModem() {
+    if (g_timeLastModemSync == 0 || (millis() - g_timeLastModemSync) >= TIME_MODEM_SYNC_MS) {
+        timeSyncFromModem();
+    }
+}
+
+// =============================================================================
+// Data Budget Governor
+// =============================================================================
+// Month-to-date usage is projected to month end and compared with the monthly
+// budget ("data_budget_mb" from /api/config, 0 = unlimited). Projected over
+// budget, readings switch to the compact encoding, the report interval
+// doubles and OTA downloads wait; far over (or already out of) budget the
+// interval quadruples. Counters and budget persist in NVS across reboots.
+
+#define USAGE_NVS_NAMESPACE        "usage"
+#define USAGE_SAVE_INTERVAL_MS     (30UL * 60UL * 1000UL)  // NVS write cadence (flash wear)
+#define USAGE_MIN_PROJECTION_DAYS  2       // Don't extrapolate from the first hours of a month
+#define GOV_STRICT_PROJECTED_PCT   150
+
+enum GovernorLevel {
+    GOV_NORMAL = 0,     // Within budget (or no budget)
+    GOV_SAVE = 1,       // Projected over: compact readings, 2x interval, OTA deferred
+    GOV_STRICT = 2,     // Projected >150% or budget spent: 4x interval
+};
+
+static uint32_t g_dataBudgetMb = 0;
+static volatile uint8_t g_governorLevel = GOV_NORMAL;
+static uint32_t g_usageDayIndex = 0;        // Days since 1970 of the day counter
+static uint32_t g_usageMonthIndex = 0;      // year * 12 + month of the month counter, 0 = unset
+static uint32_t g_usageProjectedPct = 0;    // Projected month usage, % of budget
+static uint32_t g_usageLastSave = 0;
+
+static void usageSave() {
+    Preferences nvs;
+    nvs.begin(USAGE_NVS_NAMESPACE, false);
+    portENTER_CRITICAL(&g_usageMux);
+    uint32_t dayBytes = g_usageDayBytes;
+    uint32_t monthBytes = g_usageMonthBytes;
+    portEXIT_CRITICAL(&g_usageMux);
+    nvs.putUInt("day_idx", g_usageDayIndex);
+    nvs.putUInt("month_idx", g_usageMonthIndex);
+    nvs.putUInt("day_bytes", dayBytes);
+    nvs.putUInt("month_bytes", monthBytes);
+    nvs.putUInt("budget_mb", g_dataBudgetMb);
+    nvs.end();
+    g_usageLastSave = millis();
+}
+
+static void usageLoad() {
+    Preferences nvs;
+    nvs.begin(USAGE_NVS_NAMESPACE, true);  // true = read-only
+    g_usageDayIndex = nvs.getUInt("day_idx", 0);
+    g_usageMonthIndex = nvs.getUInt("month_idx", 0);
+    g_usageDayBytes = nvs.getUInt("day_bytes", 0);
+    g_usageMonthBytes = nvs.getUInt("month_bytes", 0);
+    g_dataBudgetMb = nvs.getUInt("budget_mb", 0);
+    nvs.end();
+    g_usageLastSave = millis();
+    LOGI("[USAGE] Restored: day %lu B, month %lu B, budget %lu MB\n",
+         g_usageDayBytes, g_usageMonthBytes, g_dataBudgetMb);
+}
+
+// New budget from /api/config - persisted immediately
+static void usageSetBudget(uint32_t budgetMb) {
+    if (budgetMb == g_dataBudgetMb) return;
+    g_dataBudgetMb = budgetMb;
+    usageSave();
+}
+
+// Start fresh day/month counters when the calendar rolls over. Until the
+// clock has been synced, usage keeps accruing to the stored period.
+static void usageRollover(const struct tm& t, uint32_t dayIndex) {
+    uint32_t monthIndex = (uint32_t)(t.tm_year + 1900) * 12 + t.tm_mon;
+    if (g_usageMonthIndex == 0) {
+        // First synced clock since the counters were created: they are this period's
+        g_usageDayIndex = dayIndex;
+        g_usageMonthIndex = monthIndex;
+        return;
+    }
+    if (dayIndex == g_usageDayIndex && monthIndex == g_usageMonthIndex) return;
+
+    portENTER_CRITICAL(&g_usageMux);
+    uint32_t dayBytes = g_usageDayBytes;
+    uint32_t monthBytes = g_usageMonthBytes;
+    g_usageDayBytes = 0;
+    if (monthIndex != g_usageMonthIndex) g_usageMonthBytes = 0;
+    portEXIT_CRITICAL(&g_usageMux);
+
+    LOGI("[USAGE] Rollover: yesterday %lu B, month %lu B%s\n", dayBytes, monthBytes,
+         monthIndex != g_usageMonthIndex ? " (new month)" : "");
+    g_usageDayIndex = dayIndex;
+    g_usageMonthIndex = monthIndex;
+    usageSave();
+}
+
+// Roll counters, re-evaluate the governor level and checkpoint to NVS when due
+static void usageGovernorUpdate() {
+    portENTER_CRITICAL(&g_usageMux);
+    uint32_t monthBytes = g_usageMonthBytes;
+    portEXIT_CRITICAL(&g_usageMux);
+
+    uint64_t projected = monthBytes;
+    if (timeQuality() != TIME_QUALITY_NONE) {
+        time_t now = (time_t)timeNow();
+        struct tm t;
+        gmtime_r(&now, &t);
+        usageRollover(t, (uint32_t)(now / 86400));
+        portENTER_CRITICAL(&g_usageMux);
+        monthBytes = g_usageMonthBytes;
+        portEXIT_CRITICAL(&g_usageMux);
+
+        int year = t.tm_year + 1900;
+        unsigned month = t.tm_mon + 1;
+        int32_t monthStart = daysFromCivil(year, month, 1);
+        int32_t monthEnd = month == 12 ? daysFromCivil(year + 1, 1, 1)
+                                       : daysFromCivil(year, month + 1, 1);
+        uint32_t monthS = (uint32_t)(monthEnd - monthStart) * 86400UL;
+        uint32_t elapsedS = (uint32_t)(now - (time_t)monthStart * 86400);
+        if (elapsedS < USAGE_MIN_PROJECTION_DAYS * 86400UL) {
+            elapsedS = USAGE_MIN_PROJECTION_DAYS * 86400UL;
+        }
+        projected = (uint64_t)monthBytes * monthS / elapsedS;
+    }
+
+    uint8_t level = GOV_NORMAL;
+    g_usageProjectedPct = 0;
+    if (g_dataBudgetMb > 0) {
+        uint64_t budget = (uint64_t)g_dataBudgetMb * 1024 * 1024;
+        g_usageProjectedPct = (uint32_t)(projected * 100 / budget);
+        if (monthBytes >= budget || g_usageProjectedPct >= GOV_STRICT_PROJECTED_PCT) {
+            level = GOV_STRICT;
+        } else if (g_usageProjectedPct >= 100) {
+            level = GOV_SAVE;
+        }
+    }
+
+    if (level != g_governorLevel) {
+        LOGI("[USAGE] Governor level %u -> %u (month %lu B, projected %lu%% of %lu MB)\n",
+             g_governorLevel, level, monthBytes, g_usageProjectedPct, g_dataBudgetMb);
+        g_governorLevel = level;
+    }
+
+    if ((millis() - g_usageLastSave) >= USAGE_SAVE_INTERVAL_MS) {
+        usageSave();
+    }
+}
+
+// =============================================================================
+// Adaptive Report Interval
+// =============================================================================
+// The interval follows traffic within configured bounds. Each quiet epoch
+// (few uniques, little change from the previous one) lengthens it by half, a
+// significant change in the per-minute unique rate halves it, and steady
+// traffic eases it back toward the base interval. A once-a-minute check also
+// cuts a long interval short when the live rate breaks away from the last
+// epoch's. Base and bounds come from /api/config; REPORT_INTERVAL_MS is the
+// base until the first fetch.
+
+#ifndef REPORT_INTERVAL_MIN_MS
+#define REPORT_INTERVAL_MIN_MS  (2UL * 60UL * 1000UL)
+#endif
+#ifndef REPORT_INTERVAL_MAX_MS
+#define REPORT_INTERVAL_MAX_MS  (30UL * 60UL * 1000UL)
+#endif
+#define ADAPT_QUIET_PER_MIN     0.5f    // Uniques/min at or below this is quiet
+#define ADAPT_CHANGE_PER_MIN    2.0f    // A change must move the rate at least this much...
+#define ADAPT_CHANGE_RATIO      0.5f    // ...and by this fraction of the larger rate
+#define ADAPT_MIN_EPOCH_MS      60000   // Shorter (forced) epochs don't steer the interval
+
+static uint32_t g_reportIntervalBaseMs = REPORT_INTERVAL_MS;
+static uint32_t g_reportIntervalMinMs = REPORT_INTERVAL_MIN_MS;
+static uint32_t g_reportIntervalMaxMs = REPORT_INTERVAL_MAX_MS;
+static uint32_t g_adaptiveIntervalMs = REPORT_INTERVAL_MS;
+static float g_adaptiveLastRate = -1.0f;    // Uniques/min of the last epoch, <0 = none yet
+static bool g_adaptiveCutShort = false;     // Live check already shortened this epoch
+
+static uint32_t adaptiveClamp(uint32_t intervalMs) {
+    if (intervalMs < g_reportIntervalMinMs) return g_reportIntervalMinMs;
+    if (intervalMs > g_reportIntervalMaxMs) return g_reportIntervalMaxMs;
+    return intervalMs;
+}
+
+static bool adaptiveRateChanged(float rate, float prev) {
+    float delta = fabsf(rate - prev);
+    float larger = rate > prev ? rate : prev;
+    return delta >= ADAPT_CHANGE_PER_MIN && delta > ADAPT_CHANGE_RATIO * larger;
+}
+
+// New base/bounds from /api/config (0 leaves a value unchanged)
+static void adaptiveSetBounds(uint32_t baseMs, uint32_t minMs, uint32_t maxMs) {
+    if (minMs > 0) g_reportIntervalMinMs = minMs;
+    if (maxMs > 0) g_reportIntervalMaxMs = maxMs;
+    if (g_reportIntervalMaxMs < g_reportIntervalMinMs) g_reportIntervalMaxMs = g_reportIntervalMinMs;
+    if (baseMs > 0) g_reportIntervalBaseMs = baseMs;
+    g_reportIntervalBaseMs = adaptiveClamp(g_reportIntervalBaseMs);
+    g_adaptiveIntervalMs = adaptiveClamp(g_adaptiveIntervalMs);
+}
+
+// Steer the interval from a finished epoch's unique count
+static void adaptiveOnEpoch(uint32_t uniques, uint32_t epochMs) {
+    bool cutShort = g_adaptiveCutShort;
+    g_adaptiveCutShort = false;
+    if (epochMs < ADAPT_MIN_EPOCH_MS) return;
+
+    float rate = uniques * 60000.0f / epochMs;
+    float prev = g_adaptiveLastRate;
+    g_adaptiveLastRate = rate;
+    uint32_t interval = g_adaptiveIntervalMs;
+    const char* why;
+
+    if (prev >= 0.0f && adaptiveRateChanged(rate, prev)) {
+        if (cutShort) return;  // Already shrunk to the break-away point
+        interval /= 2;
+        why = "traffic changed";
+    } else if (rate <= ADAPT_QUIET_PER_MIN && (prev < 0.0f || prev <= ADAPT_QUIET_PER_MIN)) {
+        interval += interval / 2;
+        why = "quiet";
+    } else if (interval > g_reportIntervalBaseMs) {
+        interval = max(g_reportIntervalBaseMs, interval * 3 / 4);
+        why = "steady";
+    } else if (interval < g_reportIntervalBaseMs) {
+        interval = min(g_reportIntervalBaseMs, interval + interval / 2);
+        why = "steady";
+    } else {
+        return;
     }
 
-    if (g_pBleScan && !g_pBleScan->isScanning()) {
-        // Start scanning for BLE_SCAN_DURATION_MS (non-blocking)
-        g_pBleScan->start(BLE_SCAN_DURATION_MS / 1000, false);
-        Serial.println("[BLE] Scanning started");
+    interval = adaptiveClamp(interval);
+    if (interval != g_adaptiveIntervalMs) {
+        LOGI("[ADAPT] %.1f -> %.1f uniques/min (%s): interval %lu -> %lu s\n",
+             prev < 0.0f ? 0.0f : prev, rate, why,
+             g_adaptiveIntervalMs / 1000, interval / 1000);
+        g_adaptiveIntervalMs = interval;
     }
 }
 
-static void stopBleScan() {
-    if (g_pBleScan && g_pBleScan->isScanning()) {
-        g_pBleScan->stop();
-        Serial.println("[BLE] Scanning stopped");
+// Minute check: report early if the running epoch's rate broke away from the
+// last epoch's. Not while the budget governor is stretching the interval.
+static void adaptiveCheckLive(uint32_t uniques, uint32_t elapsedMs) {
+    if (g_governorLevel != GOV_NORMAL || g_adaptiveLastRate < 0.0f) return;
+    if (elapsedMs < g_reportIntervalMinMs || elapsedMs >= g_adaptiveIntervalMs) return;
+
+    float rate = uniques * 60000.0f / elapsedMs;
+    if (adaptiveRateChanged(rate, g_adaptiveLastRate)) {
+        LOGI("[ADAPT] Live rate %.1f vs %.1f uniques/min - reporting early at %lu s\n",
+             rate, g_adaptiveLastRate, elapsedMs / 1000);
+        g_adaptiveIntervalMs = adaptiveClamp(elapsedMs);
+        g_adaptiveCutShort = true;
     }
 }
 
-// Radio time-slicing: switches between WiFi and BLE modes
-static void updateRadioMode() {
-    uint32_t now = millis();
-    uint32_t elapsed = now - g_lastRadioSwitch;
+// Interval in force: adaptive interval after the governor's stretch (x1, x2, x4)
+static uint32_t reportIntervalMs() {
+    return g_adaptiveIntervalMs << g_governorLevel;
+}
 
-    if (g_radioMode == RADIO_WIFI) {
-        // Currently in WiFi mode - check if time to switch to BLE
-        if (elapsed >= WIFI_SCAN_DURATION_MS) {
-            g_lastRadioSwitch = now;
-            g_radioMode = RADIO_BLE;
+// =============================================================================
+// Aligned Reporting Periods
+// =============================================================================
+// Once the clock is synced, epochs end on wall-clock boundaries instead of
+// "interval after the last send", so every device's readings cover the same
+// windows and site rollups are plain bucket sums. The interval in force is
+// snapped down to the largest step that divides a day (5 min -> :00, :05,
+// ...; 7.5 min -> 6 min), and the report timer is armed for the next
+// multiple of that step in Unix time. Each reading carries its period's
+// start and end; a period that starts or ends off the grid (boot, clock
+// sync, forced reports) is marked partial.
+
+#define PERIOD_MIN_FRACTION     2       // A boundary closer than step/2 after a send is skipped
+
+static const uint32_t PERIOD_STEPS_S[] = {
+    60, 120, 180, 240, 300, 360, 600, 720, 900, 1200, 1800,
+    3600, 7200, 10800, 14400, 21600, 43200, 86400,
+};
 
-            // Stop WiFi promiscuous mode
-            stopProbeCapture();
+static uint32_t g_periodStartMs = 0;        // millis() the running period began
+static uint32_t g_periodStartS = 0;         // ...as Unix time, once known (0 = not yet)
+static bool g_periodStartAligned = false;   // Running period began on a grid boundary
+static uint32_t g_periodStepS = 0;          // Grid the report timer is armed on (0 = unaligned)
+static uint32_t g_periodEndMs = 0;          // millis() capture stopped for the report in progress
 
-            // Start BLE scanning
-            startBleScan();
-        } else {
-            // Still in WiFi mode - do channel hopping
-            updateChannelHop();
-        }
-    } else {
-        // Currently in BLE mode - check if time to switch back to WiFi
-        if (elapsed >= BLE_SCAN_DURATION_MS) {
-            g_lastRadioSwitch = now;
-            g_radioMode = RADIO_WIFI;
+// Largest day-dividing step not longer than the interval
+static uint32_t periodStepFor(uint32_t intervalMs) {
+    uint32_t step = PERIOD_STEPS_S[0];
+    for (size_t i = 0; i < sizeof(PERIOD_STEPS_S) / sizeof(PERIOD_STEPS_S[0]); i++) {
+        if (PERIOD_STEPS_S[i] * 1000UL > intervalMs) break;
+        step = PERIOD_STEPS_S[i];
+    }
+    return step;
+}
 
-            // Stop BLE scanning
-            stopBleScan();
+// Delay to the next report: the next grid boundary when time is synced,
+// otherwise one interval after the last send
+static uint32_t periodNextDelayMs(uint32_t sinceReportMs) {
+    uint32_t interval = reportIntervalMs();
+    if (timeQuality() == TIME_QUALITY_NONE) {
+        g_periodStepS = 0;
+        return sinceReportMs < interval ? interval - sinceReportMs : 0;
+    }
+    g_periodStepS = periodStepFor(interval);
+    uint32_t stepMs = g_periodStepS * 1000UL;
+    uint32_t delay = stepMs - (uint32_t)(timeMsAt(millis()) % stepMs);
+    if (sinceReportMs + delay < stepMs / PERIOD_MIN_FRACTION) delay += stepMs;
+    return delay;
+}
 
-            // Resume WiFi promiscuous mode
-            startProbeCapture();
+// Close the period for reading r: stamp start/end, start the next one at the end
+static void periodClose(CachedReading* r) {
+    uint32_t endS = 0;
+    bool endAligned = false;
+    if (timeQuality() != TIME_QUALITY_NONE) {
+        endS = (uint32_t)((timeMsAt(g_periodEndMs) + 500) / 1000);
+        if (g_periodStartS == 0) {
+            // Clock synced during this period - place its start retroactively
+            g_periodStartS = (uint32_t)((timeMsAt(g_periodStartMs) + 500) / 1000);
         }
+        endAligned = g_periodStepS > 0 && endS % g_periodStepS == 0;
     }
+    r->periodStart = endS ? g_periodStartS : 0;
+    r->periodEnd = endS;
+    r->periodPartial = !(g_periodStartAligned && endAligned);
+
+    g_periodStartMs = g_periodEndMs;
+    g_periodStartS = endS;
+    g_periodStartAligned = endAligned;
 }
 
 // =============================================================================
-// AT Command Interface
+// Anomaly Detection
 // =============================================================================
+// Once a minute the capture counters are differenced into per-minute samples
+// of impressions, new uniques, mean probe RSSI and the filtered-static ratio.
+// Each metric keeps an EWMA mean/variance and a two-sided CUSUM on the
+// standardized residual; a CUSUM crossing (or a stall - zero captures for
+// several minutes at a normally busy site) flags the metric and requests an
+// out-of-cycle report carrying the reason, so the backend hears about a
+// break within minutes instead of at the next interval.
+
+#define ANOMALY_ALPHA           0.05f   // EWMA weight (~20 min memory)
+#define ANOMALY_WARMUP_SAMPLES  30      // Minutes before alarms are armed
+#define ANOMALY_CUSUM_K         0.5f    // Slack, in sigmas
+#define ANOMALY_CUSUM_H         5.0f    // Decision threshold, in sigmas
+#define ANOMALY_STALL_MINUTES   3       // Zero-capture minutes that count as a stall
+#define ANOMALY_STALL_MIN_MEAN  5.0f    // ...at a site averaging this many probes/min
+#define ANOMALY_RATIO_MIN_FRAMES 10     // Frames/min needed for a static-ratio sample
+#define ANOMALY_REPORT_HOLDOFF_MS (15UL * 60UL * 1000UL)  // Between anomaly-triggered reports
+
+enum AnomalyMetric {
+    ANOMALY_IMPRESSIONS = 0,
+    ANOMALY_UNIQUES,
+    ANOMALY_RSSI,
+    ANOMALY_STATIC_RATIO,
+    ANOMALY_METRIC_COUNT
+};
 
-// Clear the AT response buffer
-static void atClearBuffer() {
-    g_atBufferLen = 0;
-    g_atBuffer[0] = '\0';
-}
-
-// Send AT command and wait for response
-// Returns true if expected response found, false on timeout
-static bool atSendCommand(const char* cmd, const char* expect, uint32_t timeoutMs) {
-    atClearBuffer();
+// Flag bits: two per metric (rise, drop), then the stall flag
+#define ANOMALY_FLAG_RISE(m)    (1u << ((m) * 2))
+#define ANOMALY_FLAG_DROP(m)    (1u << ((m) * 2 + 1))
+#define ANOMALY_FLAG_STALL      (1u << (ANOMALY_METRIC_COUNT * 2))
 
-    // Flush any pending input
-    while (ModemSerial.available()) {
-        ModemSerial.read();
-    }
+static const char* const ANOMALY_METRIC_NAMES[ANOMALY_METRIC_COUNT] = {
+    "imp", "uniq", "rssi", "static"
+};
+// Sigma floors keep quiet sites (near-zero variance) from alarming on noise
+static const float ANOMALY_SIGMA_FLOOR[ANOMALY_METRIC_COUNT] = { 2.0f, 1.0f, 3.0f, 0.05f };
+
+struct AnomalyDetector {
+    float mean;         // EWMA of the metric
+    float var;          // EWMA of the squared residual
+    float cusumHi;      // Evidence of a rise
+    float cusumLo;      // Evidence of a drop
+    uint16_t samples;
+};
 
-    // Send command
-    Serial.printf("[AT TX] %s\n", cmd);
-    ModemSerial.print(cmd);
-    ModemSerial.print("\r\n");
+// Capture counter values at a minute boundary
+struct AnomalyTap {
+    uint32_t probes;
+    uint32_t uniques;
+    uint32_t filtered;
+    int32_t rssiSum;
+    uint32_t rssiCount;
+};
 
-    uint32_t startTime = millis();
-    bool found = false;
+static AnomalyDetector g_anomaly[ANOMALY_METRIC_COUNT];
+static AnomalyTap g_anomalyTap = {};        // Counters at the last sample (this epoch)
+static AnomalyTap g_anomalyCarry = {};      // Counted between the last sample and a reset
+static uint32_t g_anomalyLastSample = 0;
+static uint8_t g_anomalyZeroMinutes = 0;
+static uint16_t g_anomalyFlags = 0;         // Pending for the next reading
+static uint32_t g_anomalyLastReport = 0;
+
+// Caller holds g_probeMux
+static void anomalyReadTap(AnomalyTap* t) {
+    t->probes = g_wifiCounter.impressions();
+    t->uniques = g_wifiCounter.uniques();
+    t->filtered = g_filteredStatic;
+    t->rssiSum = g_wifiCounter.rssiSum();
+    t->rssiCount = g_wifiCounter.rssiCount();
+}
 
-    while ((millis() - startTime) < timeoutMs && !found) {
-        while (ModemSerial.available() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
-            char c = ModemSerial.read();
-            g_atBuffer[g_atBufferLen++] = c;
-            g_atBuffer[g_atBufferLen] = '\0';
+// Epoch counters are about to be zeroed - carry what the last sample hasn't
+// seen yet into the next one. Caller holds g_probeMux.
+static void anomalyOnCounterReset() {
+    AnomalyTap cur;
+    anomalyReadTap(&cur);
+    g_anomalyCarry.probes += cur.probes - g_anomalyTap.probes;
+    g_anomalyCarry.uniques += cur.uniques - g_anomalyTap.uniques;
+    g_anomalyCarry.filtered += cur.filtered - g_anomalyTap.filtered;
+    g_anomalyCarry.rssiSum += cur.rssiSum - g_anomalyTap.rssiSum;
+    g_anomalyCarry.rssiCount += cur.rssiCount - g_anomalyTap.rssiCount;
+    g_anomalyTap = {};
+}
 
-            // Check for expected response
-            if (expect && strstr(g_atBuffer, expect)) {
-                found = true;
-                break;
-            }
+// Feed one sample; returns the flag bit raised, or 0
+static uint16_t anomalyUpdate(AnomalyMetric m, float x) {
+    AnomalyDetector& d = g_anomaly[m];
+    if (d.samples == 0) {
+        d.mean = x;
+        d.samples = 1;
+        return 0;
+    }
+
+    float sigma = sqrtf(d.var);
+    if (sigma < ANOMALY_SIGMA_FLOOR[m]) sigma = ANOMALY_SIGMA_FLOOR[m];
+    float residual = x - d.mean;
+    float z = residual / sigma;
+
+    d.mean += ANOMALY_ALPHA * residual;
+    d.var = (1.0f - ANOMALY_ALPHA) * (d.var + ANOMALY_ALPHA * residual * residual);
+    if (d.samples < ANOMALY_WARMUP_SAMPLES) {
+        d.samples++;
+        return 0;
+    }
+
+    d.cusumHi = fmaxf(0.0f, d.cusumHi + z - ANOMALY_CUSUM_K);
+    d.cusumLo = fmaxf(0.0f, d.cusumLo - z - ANOMALY_CUSUM_K);
+    uint16_t flag = 0;
+    if (d.cusumHi > ANOMALY_CUSUM_H) flag = ANOMALY_FLAG_RISE(m);
+    else if (d.cusumLo > ANOMALY_CUSUM_H) flag = ANOMALY_FLAG_DROP(m);
+    if (flag) {
+        LOGW("[ANOMALY] %s %s: %.2f vs mean %.2f (sigma %.2f)\n", ANOMALY_METRIC_NAMES[m],
+             (flag & ANOMALY_FLAG_RISE(m)) ? "rise" : "drop", x, d.mean, sigma);
+        d.cusumHi = 0.0f;  // Re-arm; the EWMA adapts to the new level
+        d.cusumLo = 0.0f;
+    }
+    return flag;
+}
 
-            // Check for error
-            if (strstr(g_atBuffer, "ERROR")) {
-                Serial.printf("[AT RX] %s\n", g_atBuffer);
-                return false;
+// Comma-separated reason list for flags ("uniq_drop,stall")
+static void anomalyFormat(uint16_t flags, char* out, size_t outSize) {
+    size_t n = 0;
+    out[0] = '\0';
+    for (int m = 0; m < ANOMALY_METRIC_COUNT; m++) {
+        for (int dir = 0; dir < 2; dir++) {
+            if (flags & (1u << (m * 2 + dir))) {
+                n += snprintf(out + n, outSize - n, "%s%s_%s", n ? "," : "",
+                              ANOMALY_METRIC_NAMES[m], dir ? "drop" : "rise");
+                if (n >= outSize) return;
             }
         }
-        delay(10);
     }
-
-    Serial.printf("[AT RX] %s\n", g_atBuffer);
-    return found;
-}
-
-// Send raw data (for TCP payload)
-static void atSendRaw(const char* data, size_t len) {
-    Serial.printf("[AT TX RAW] (%zu bytes)\n", len);
-    ModemSerial.write((const uint8_t*)data, len);
+    if (flags & ANOMALY_FLAG_STALL) {
+        snprintf(out + n, outSize - n, "%sstall", n ? "," : "");
+    }
 }
 
-// Wait for specific string in modem output
-static bool atWaitFor(const char* expect, uint32_t timeoutMs) {
-    atClearBuffer();
-    uint32_t startTime = millis();
-
-    while ((millis() - startTime) < timeoutMs) {
-        while (ModemSerial.available() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
-            char c = ModemSerial.read();
-            g_atBuffer[g_atBufferLen++] = c;
-            g_atBuffer[g_atBufferLen] = '\0';
+// Minute tick from the loop: sample, run the detectors, request a report on a break
+static void anomalySampleMinute() {
+    uint32_t now = millis();
+    uint32_t elapsedMs = now - g_anomalyLastSample;
+    AnomalyTap cur, delta;
+    portENTER_CRITICAL(&g_probeMux);
+    anomalyReadTap(&cur);
+    delta.probes = cur.probes - g_anomalyTap.probes + g_anomalyCarry.probes;
+    delta.uniques = cur.uniques - g_anomalyTap.uniques + g_anomalyCarry.uniques;
+    delta.filtered = cur.filtered - g_anomalyTap.filtered + g_anomalyCarry.filtered;
+    delta.rssiSum = cur.rssiSum - g_anomalyTap.rssiSum + g_anomalyCarry.rssiSum;
+    delta.rssiCount = cur.rssiCount - g_anomalyTap.rssiCount + g_anomalyCarry.rssiCount;
+    g_anomalyTap = cur;
+    g_anomalyCarry = {};
+    portEXIT_CRITICAL(&g_probeMux);
 
-            if (strstr(g_atBuffer, expect)) {
-                Serial.printf("[AT RX] %s\n", g_atBuffer);
-                return true;
-            }
-        }
-        delay(10);
-    }
+    // Skip the first call and gaps where capture was stopped (long report cycles)
+    bool first = g_anomalyLastSample == 0;
+    g_anomalyLastSample = now | 1;
+    if (first || elapsedMs < 30000 || elapsedMs > 180000) return;
+
+    float perMinute = 60000.0f / elapsedMs;
+    uint16_t flags = 0;
+    flags |= anomalyUpdate(ANOMALY_IMPRESSIONS, delta.probes * perMinute);
+    flags |= anomalyUpdate(ANOMALY_UNIQUES, delta.uniques * perMinute);
+    if (delta.rssiCount > 0) {
+        flags |= anomalyUpdate(ANOMALY_RSSI, (float)delta.rssiSum / delta.rssiCount);
+    }
+    uint32_t frames = delta.probes + delta.filtered;
+    if (frames * perMinute >= ANOMALY_RATIO_MIN_FRAMES) {
+        flags |= anomalyUpdate(ANOMALY_STATIC_RATIO, (float)delta.filtered / frames);
+    }
+
+    // Capture stall: the CUSUM needs several minutes to accumulate, a dead
+    // capture path at a busy site is worth reporting sooner
+    g_anomalyZeroMinutes = (frames == 0 && g_anomalyZeroMinutes < 255) ? g_anomalyZeroMinutes + 1 : 0;
+    if (g_anomalyZeroMinutes == ANOMALY_STALL_MINUTES &&
+        g_anomaly[ANOMALY_IMPRESSIONS].samples >= ANOMALY_WARMUP_SAMPLES &&
+        g_anomaly[ANOMALY_IMPRESSIONS].mean >= ANOMALY_STALL_MIN_MEAN) {
+        LOGW("[ANOMALY] No captures for %u minutes (mean %.1f probes/min)\n",
+             g_anomalyZeroMinutes, g_anomaly[ANOMALY_IMPRESSIONS].mean);
+        flags |= ANOMALY_FLAG_STALL;
+    }
+
+    if (!flags) return;
+    g_anomalyFlags |= flags;
+
+    // Out-of-cycle report, rate-limited, and not when the data budget is spent
+    if (g_governorLevel >= GOV_STRICT) return;
+    if (g_anomalyLastReport != 0 && (now - g_anomalyLastReport) < ANOMALY_REPORT_HOLDOFF_MS) return;
+    g_anomalyLastReport = now | 1;
+    char reason[64];
+    anomalyFormat(g_anomalyFlags, reason, sizeof(reason));
+    LOGI("[ANOMALY] Requesting immediate report (%s)\n", reason);
+    requestReportNow();
+}
 
-    Serial.printf("[AT RX TIMEOUT] %s\n", g_atBuffer);
-    return false;
+// Flags for the reading being built - cleared once taken
+static uint16_t anomalyTakeFlags() {
+    uint16_t flags = g_anomalyFlags;
+    g_anomalyFlags = 0;
+    return flags;
 }
 
 // =============================================================================
@@ -1024,41 +4003,26 @@ static int getSignalQuality() {
     // the full response to parse the rssi value correctly.
 
     if (!atSendCommand("AT+CSQ", "OK", 5000)) {
-        Serial.println("[NET] CSQ command failed or timed out");
+        LOGW("[NET] CSQ command failed or timed out\n");
         return -999;
     }
 
-    // Parse +CSQ: rssi,ber from buffer
-    // Response format: "+CSQ: 15,99" or "+CSQ:15,99" (with or without space)
-    char* ptr = strstr(g_atBuffer, "+CSQ:");
-    if (!ptr) {
-        Serial.println("[NET] CSQ response not found in buffer");
+    // The +CSQ line was parsed into the link state as it arrived
+    LinkState ls = linkStateSnapshot();
+    if (ls.rssiAtMs == 0 || !strstr(g_atBuffer, "+CSQ:")) {
+        LOGW("[NET] CSQ response not found in buffer\n");
         return -999;
     }
 
-    int rssi = 99;
-    int ber = 99;
-
-    // Try parsing with space first, then without
-    if (sscanf(ptr, "+CSQ: %d,%d", &rssi, &ber) != 2) {
-        if (sscanf(ptr, "+CSQ:%d,%d", &rssi, &ber) != 2) {
-            Serial.printf("[NET] Failed to parse CSQ response: %s\n", ptr);
-            return -999;
-        }
-    }
-
-    Serial.printf("[NET] CSQ raw: rssi=%d, ber=%d\n", rssi, ber);
+    LOGD("[NET] CSQ: %d dBm, ber=%d\n", ls.rssiDbm, ls.ber);
+    return ls.rssiDbm;
+}
 
-    // Convert RSSI to dBm
-    // 0 = -113 dBm or less
-    // 1 = -111 dBm
-    // 2-30 = -109 to -53 dBm (2 dBm steps)
-    // 31 = -51 dBm or greater
-    // 99 = not known or not detectable
-    if (rssi == 99) return -999;
-    if (rssi == 0) return -113;
-    if (rssi == 31) return -51;
-    return -113 + (rssi * 2);
+// Signal for a report - cached from URCs when fresh, polled otherwise
+static int currentSignalDbm() {
+    int dbm = linkStateSignalDbm();
+    if (dbm != -999) return dbm;
+    return getSignalQuality();
 }
 
 // Check network registration status
@@ -1074,45 +4038,35 @@ static bool checkNetworkRegistration() {
         return false;
     }
 
-    // Parse +CEREG: n,stat from buffer
-    char* ptr = strstr(g_atBuffer, "+CEREG:");
-    if (!ptr) return false;
-
-    int n = 0, stat = 0;
-    // Try parsing with both spaces and without
-    if (sscanf(ptr, "+CEREG: %d,%d", &n, &stat) != 2) {
-        if (sscanf(ptr, "+CEREG:%d,%d", &n, &stat) != 2) {
-            Serial.printf("[NET] Failed to parse CEREG: %s\n", ptr);
-            return false;
-        }
-    }
+    // The +CEREG line was parsed into the link state as it arrived
+    if (!strstr(g_atBuffer, "+CEREG:")) return false;
 
-    Serial.printf("[NET] CEREG status: n=%d, stat=%d\n", n, stat);
+    LOGD("[NET] CEREG status: stat=%d\n", linkStateSnapshot().regStat);
 
     // stat: 1=registered home, 5=registered roaming
-    return (stat == 1 || stat == 5);
+    return linkStateRegistered();
 }
 
 // Initialize modem and establish network connection
 static bool initializeNetwork() {
-    Serial.println("[NET] Initializing modem...");
+    LOGI("[NET] Initializing modem...\n");
     ledSetStatus(LED_STATUS_SEARCHING);
 
     // Basic modem test with retry loop
     // Modem needs time to initialize after power-on
     bool modemReady = false;
     for (int attempt = 1; attempt <= 5; attempt++) {
-        Serial.printf("[NET] Modem AT test attempt %d/5...\n", attempt);
-        if (atSendCommand("AT", "OK", 2000)) {
+        LOGI("[NET] Modem AT test attempt %d/5...\n", attempt);
+        if (atSendCommand("AT", "OK", 2000) || modemSyncBaud()) {
             modemReady = true;
             break;
         }
-        Serial.println("[NET] Modem not ready, waiting 2 seconds...");
+        LOGW("[NET] Modem not ready, waiting 2 seconds...\n");
         delay(2000);
     }
 
     if (!modemReady) {
-        Serial.println("[NET] Modem not responding after 5 attempts");
+        LOGE("[NET] Modem not responding after 5 attempts\n");
         ledSetStatus(LED_STATUS_ERROR);
         return false;
     }
@@ -1124,13 +4078,17 @@ static bool initializeNetwork() {
     // Timeout: 2000ms
     atSendCommand("ATE0", "OK", 2000);
 
+    // Flow control, then a faster UART, before any bulk traffic
+    modemEnableFlowControl();
+    modemNegotiateBaud();
+
     // Check SIM status
     // AT Command: AT+CPIN?
     // Purpose: Check SIM card status
     // Expected Response: +CPIN: READY
     // Timeout: 5000ms
     if (!atSendCommand("AT+CPIN?", "READY", 5000)) {
-        Serial.println("[NET] SIM not ready");
+        LOGE("[NET] SIM not ready\n");
         ledSetStatus(LED_STATUS_ERROR);
         return false;
     }
@@ -1142,29 +4100,56 @@ static bool initializeNetwork() {
     // Timeout: 5000ms
     atSendCommand("AT+CNMP=38", "OK", 5000);
 
-    // Wait for network registration
-    Serial.println("[NET] Waiting for network registration...");
+    // Unsolicited registration reports with location (URC: +CEREG: <stat>,"tac","ci",<act>)
+    // AT Command: AT+CEREG=2
+    // Expected Response: OK
+    atSendCommand("AT+CEREG=2", "OK", 2000);
+
+    // Unsolicited signal reports on change (URC: +CSQ: <rssi>,<ber>)
+    // AT Command: AT+AUTOCSQ=1,1
+    // Expected Response: OK - not all firmware has it; fall back to polling
+    g_linkSignalUrc = atSendCommand("AT+AUTOCSQ=1,1", "OK", 2000);
+    if (!g_linkSignalUrc) {
+        LOGD("[NET] AUTOCSQ not supported, signal will be polled when stale\n");
+    }
+
+    // Wait for network registration - driven by +CEREG URCs, with an
+    // occasional query in case one was missed
+    LOGI("[NET] Waiting for network registration...\n");
     uint32_t startTime = millis();
+    uint32_t lastQuery = 0;
     while ((millis() - startTime) < NETWORK_INIT_TIMEOUT_MS) {
         esp_task_wdt_reset();  // Feed watchdog - network init can take 2+ minutes
-        ledUpdate();  // Keep LED animation running
-        if (checkNetworkRegistration()) {
-            Serial.println("[NET] Registered to network");
+        if (lastQuery == 0 || (millis() - lastQuery) >= 15000) {
+            lastQuery = millis();
+            checkNetworkRegistration();
+        }
+        while (modemAvailable()) modemRead();  // Let URCs through the parser
+        if (linkStateRegistered()) {
+            LOGI("[NET] Registered to network\n");
             break;
         }
-        Serial.print(".");
-        delay(5000);
+        delay(200);
     }
 
-    if (!checkNetworkRegistration()) {
-        Serial.println("\n[NET] Registration timeout");
+    if (!linkStateRegistered()) {
+        LOGW("\n[NET] Registration timeout\n");
         ledSetStatus(LED_STATUS_SEARCHING);
         return false;
     }
 
     // Get signal quality
     g_cellRssi = getSignalQuality();
-    Serial.printf("[NET] Signal: %d dBm\n", g_cellRssi);
+    LOGI("[NET] Signal: %d dBm\n", g_cellRssi);
+
+    // Network time - NITZ updates the modem clock once registered
+    // AT Command: AT+CTZU=1
+    // Purpose: Let network time/zone updates set the RTC
+    // Expected Response: OK
+    atSendCommand("AT+CTZU=1", "OK", 2000);
+    if (!timeSyncFromModem()) {
+        LOGI("[NET] No network time yet, will use server time\n");
+    }
 
     // Close any existing network connection
     // AT Command: AT+NETCLOSE
@@ -1187,7 +4172,7 @@ static bool initializeNetwork() {
     // Expected Response: OK
     // Timeout: 30000ms
     if (!atSendCommand("AT+CGATT=1", "OK", 30000)) {
-        Serial.println("[NET] PS attach failed");
+        LOGW("[NET] PS attach failed\n");
         ledSetStatus(LED_STATUS_SEARCHING);
         return false;
     }
@@ -1201,7 +4186,7 @@ static bool initializeNetwork() {
     if (!atSendCommand("AT+NETOPEN", "+NETOPEN: 0", 60000)) {
         // Check if already open
         if (!strstr(g_atBuffer, "Network is already opened")) {
-            Serial.println("[NET] NETOPEN failed");
+            LOGW("[NET] NETOPEN failed\n");
             ledSetStatus(LED_STATUS_SEARCHING);
             return false;
         }
@@ -1213,24 +4198,219 @@ static bool initializeNetwork() {
     // Expected Response: +IPADDR: x.x.x.x\r\nOK
     // Timeout: 5000ms
     if (!atSendCommand("AT+IPADDR", "OK", 5000)) {
-        Serial.println("[NET] No IP address assigned");
+        LOGI("[NET] No IP address assigned\n");
         ledSetStatus(LED_STATUS_SEARCHING);
         return false;
     }
 
     // Make sure we actually got an IP (not an error)
     if (!strstr(g_atBuffer, "+IPADDR:")) {
-        Serial.println("[NET] IPADDR response missing");
+        LOGW("[NET] IPADDR response missing\n");
         ledSetStatus(LED_STATUS_SEARCHING);
         return false;
     }
 
-    Serial.println("[NET] Network ready");
+    LOGI("[NET] Network ready\n");
     g_networkReady = true;
     ledSetStatus(LED_STATUS_CONNECTED);  // Set LED to CYAN when network is ready
     return true;
 }
 
+// =============================================================================
+// Reading Sequence Numbers
+// =============================================================================
+// Every closed period takes the next number of a per-device sequence that
+// survives reboots (NVS, reserved SEQ_NVS_BLOCK at a time so a reading does
+// not cost a flash write; a reboot skips the rest of the block). The backend
+// keys readings on (stream, seq), so a reading re-sent after a lost response
+// is ignored, and answers with "ack", the highest sequence it holds
+// contiguously; cached readings at or below it are dropped unsent. "sqf"
+// tells it the lowest sequence still held here, so gaps left by reboots or
+// discarded readings don't stall the ack. The stream id is drawn with the
+// first sequence - an NVS wipe starts a new stream instead of reusing
+// numbers the server already acknowledged.
+
+#define SEQ_NVS_NAMESPACE   "seq"
+#define SEQ_NVS_BLOCK       32      // Sequence numbers reserved per NVS write
+
+static uint32_t g_seqStream = 0;        // Random stream id, persisted
+static uint32_t g_seqNext = 1;          // Next number to hand out
+static uint32_t g_seqReserved = 1;      // NVS "next" - where numbering resumes after a reboot
+static uint32_t g_seqAcked = 0;         // Highest contiguous sequence the server holds
+
+static void seqLoad() {
+    Preferences nvs;
+    nvs.begin(SEQ_NVS_NAMESPACE, false);
+    g_seqStream = nvs.getULong("stream", 0);
+    if (g_seqStream == 0) {
+        g_seqStream = esp_random() | 1;
+        nvs.putULong("stream", g_seqStream);
+        nvs.putULong("next", 1);
+        LOGI("[SEQ] New sequence stream %08lx\n", g_seqStream);
+    }
+    g_seqNext = nvs.getULong("next", 1);
+    g_seqReserved = g_seqNext + SEQ_NVS_BLOCK;
+    nvs.putULong("next", g_seqReserved);
+    nvs.end();
+    LOGI("[SEQ] Stream %08lx resuming at %lu\n", g_seqStream, g_seqNext);
+}
+
+static uint32_t seqTake() {
+    if (g_seqNext >= g_seqReserved) {
+        g_seqReserved = g_seqNext + SEQ_NVS_BLOCK;
+        Preferences nvs;
+        nvs.begin(SEQ_NVS_NAMESPACE, false);
+        nvs.putULong("next", g_seqReserved);
+        nvs.end();
+    }
+    return g_seqNext++;
+}
+
+// Lowest sequence still held: the reading in flight or anything cached
+static uint32_t seqFloor(uint32_t inFlight) {
+    uint32_t floor = inFlight;
+    for (int i = 0; i < g_cacheCount; i++) {
+        const CachedReading& c = g_cacheBuffer[(g_cacheTail + i) % MAX_CACHED_READINGS];
+        if (c.seq != 0 && c.seq < floor) floor = c.seq;
+    }
+    return floor;
+}
+
+// Pick up "ack" from a reading response
+static void seqOnAck(const char* response) {
+    const char* p = strstr(response, "\"ack\":");
+    if (!p) return;
+    p += 6;
+    while (*p == ' ') p++;
+    uint32_t ack = strtoul(p, nullptr, 10);
+    if (ack > g_seqAcked) g_seqAcked = ack;
+}
+
+// Whole reading (every merged sequence) already on the server
+static bool seqAcked(const CachedReading& r) {
+    return r.seq != 0 && r.seqLast <= g_seqAcked;
+}
+
+// =============================================================================
+// Uplink Back-off
+// =============================================================================
+// After a carrier outage the whole fleet recovers at once. Periods still
+// close on their boundary, but each device starts its upload a deterministic
+// per-device offset later (hash of DEVICE_ID, so a site's devices keep a
+// fixed, spread order), backs off exponentially on consecutive send failures
+// with the same per-device spread, and holds off for a server's Retry-After
+// on 429/503. Held readings wait in g_reportPending or the cache.
+
+#define UPLINK_JITTER_MAX_MS     (60UL * 1000UL)       // Upload spread after a boundary...
+#define UPLINK_JITTER_FRACTION   4                     // ...at most this fraction of the interval
+#define UPLINK_BACKOFF_BASE_MS   (60UL * 1000UL)       // Hold after the first failure
+#define UPLINK_BACKOFF_MAX_MS    (60UL * 60UL * 1000UL)
+#define UPLINK_RETRY_AFTER_MAX_S (6UL * 60UL * 60UL)   // Clamp for server Retry-After
+
+static uint32_t g_uplinkSeed = 0;          // FNV-1a of DEVICE_ID (0 = not yet computed)
+static uint32_t g_uplinkNotBeforeMs = 0;   // millis() before which no upload starts
+static bool g_uplinkHeld = false;          // g_uplinkNotBeforeMs is in force
+static bool g_uplinkServerHold = false;    // ...and came from Retry-After
+static int g_httpStatus = 0;               // Status of the last reading POST (0 = no response)
+static uint32_t g_httpRetryAfterS = 0;     // Its Retry-After, 0 = none
+static bool g_httpRequestSent = false;     // Its request went out in full (a failure may be a lost response)
+
+// Deterministic per-device value in [0, spanMs); salt spreads successive retries
+static uint32_t uplinkJitter(uint32_t salt, uint32_t spanMs) {
+    if (spanMs == 0) return 0;
+    if (g_uplinkSeed == 0) {
+        uint32_t h = 2166136261UL;
+        for (const char* p = DEVICE_ID; *p; p++) h = (h ^ (uint8_t)*p) * 16777619UL;
+        g_uplinkSeed = h | 1;
+    }
+    uint32_t h = g_uplinkSeed ^ (salt * 0x9E3779B9UL);
+    h ^= h >> 16;
+    h *= 0x7FEB352DUL;
+    h ^= h >> 15;
+    h *= 0x846CA68BUL;
+    h ^= h >> 16;
+    return h % spanMs;
+}
+
+// Remaining hold in ms (0 = may upload now). Forced reports skip the
+// failure back-off but still honor the server.
+static uint32_t uplinkHoldMs(bool forced) {
+    if (!g_uplinkHeld || (forced && !g_uplinkServerHold)) return 0;
+    int32_t left = (int32_t)(g_uplinkNotBeforeMs - millis());
+    if (left <= 0) {
+        g_uplinkHeld = false;
+        return 0;
+    }
+    return (uint32_t)left;
+}
+
+// Delay from closing a period to uploading it
+static uint32_t uplinkDelayMs(uint32_t intervalMs, bool forced) {
+    uint32_t hold = uplinkHoldMs(forced);
+    if (forced) return hold;
+    uint32_t span = intervalMs / UPLINK_JITTER_FRACTION;
+    if (span > UPLINK_JITTER_MAX_MS) span = UPLINK_JITTER_MAX_MS;
+    uint32_t jitter = uplinkJitter(0, span);
+    return hold > jitter ? hold : jitter;
+}
+
+// Status code from an "HTTP/1.x NNN" status line, 0 if none
+static int httpStatusCode(const char* response) {
+    const char* p = strstr(response, "HTTP/1.");
+    if (!p) return 0;
+    p = strchr(p, ' ');
+    return p ? atoi(p + 1) : 0;
+}
+
+// 2xx status line in the response. Only the status line counts: a "200"
+// elsewhere (a +CSQ/+CEREG URC, a body, a length) is not a success.
+static bool httpResponseOk(const char* response) {
+    int status = httpStatusCode(response);
+    return status >= 200 && status < 300;
+}
+
+// Retry-After in seconds (header, else the receiver's JSON "retry_after"), 0 if none
+static uint32_t httpRetryAfterS(const char* response) {
+    const char* p = strcasestr(response, "\r\nRetry-After:");
+    if (p) {
+        p += 14;
+    } else if ((p = strstr(response, "\"retry_after\":")) != NULL) {
+        p += 14;
+        while (*p == ' ' || *p == '"') p++;
+    } else {
+        return 0;
+    }
+    long s = atol(p);  // Delta-seconds form only; an HTTP-date parses as 0
+    if (s <= 0) return 0;
+    return (uint32_t)s > UPLINK_RETRY_AFTER_MAX_S ? UPLINK_RETRY_AFTER_MAX_S : (uint32_t)s;
+}
+
+// Outcome of an upload cycle: clear the hold, or back off from g_sendFailures
+static void uplinkOnResult(bool sent) {
+    if (sent) {
+        g_uplinkHeld = false;
+        g_uplinkServerHold = false;
+        return;
+    }
+    uint8_t shift = g_sendFailures > 0 ? g_sendFailures - 1 : 0;
+    if (shift > 6) shift = 6;
+    uint32_t hold = UPLINK_BACKOFF_BASE_MS << shift;
+    if (hold > UPLINK_BACKOFF_MAX_MS) hold = UPLINK_BACKOFF_MAX_MS;
+    hold += uplinkJitter(g_sendFailures, hold / 2);  // +0..50%, per device and attempt
+
+    bool server = g_httpRetryAfterS > 0 && (g_httpStatus == 429 || g_httpStatus == 503);
+    if (server) {
+        uint32_t serverMs = g_httpRetryAfterS * 1000UL;
+        serverMs += uplinkJitter(g_sendFailures, serverMs / 4 + 1);
+        if (serverMs > hold) hold = serverMs;
+    }
+    g_uplinkNotBeforeMs = millis() + hold;
+    g_uplinkHeld = true;
+    g_uplinkServerHold = server;
+    LOGI("[UPLINK] %u failure(s), HTTP %d%s - next upload in %lu s\n",
+         g_sendFailures, g_httpStatus, server ? " (Retry-After)" : "", hold / 1000);
+}
+
 // =============================================================================
 // HTTP POST via TCP
 // =============================================================================
@@ -1243,51 +4423,137 @@ static bool checkOtaTrigger(const char* response) {
 }
 
 // Send reading to backend via HTTP POST over TCP
-// Quality fields: overflowCount=uniques dropped, ageSeconds=how old is this reading (0=live)
-static bool sendReading(const char* timestamp, uint32_t impressions, uint32_t unique,
-                        int probeRssiAvg, int probeRssiMin, int probeRssiMax, int cellRssi,
-                        uint32_t dwell_0_1, uint32_t dwell_1_5, uint32_t dwell_5_10, uint32_t dwell_10plus,
-                        uint32_t rssi_immediate, uint32_t rssi_near, uint32_t rssi_far, uint32_t rssi_remote,
-                        uint32_t bleImpressions, uint32_t bleUnique,
-                        uint32_t bleApple, uint32_t bleOther, int bleRssiAvg,
-                        uint16_t overflowCount, uint32_t ageSeconds) {
-    Serial.printf("[HTTP] WiFi: t=%s, i=%lu, u=%lu\n", timestamp, impressions, unique);
-    Serial.printf("[HTTP]   probe_rssi: avg=%d min=%d max=%d, cell_rssi=%d\n",
-                  probeRssiAvg, probeRssiMin, probeRssiMax, cellRssi);
-    Serial.printf("[HTTP]   dwell: 0-1=%lu, 1-5=%lu, 5-10=%lu, 10+=%lu\n",
-                  dwell_0_1, dwell_1_5, dwell_5_10, dwell_10plus);
-    Serial.printf("[HTTP]   rssi_zones: imm=%lu, near=%lu, far=%lu, remote=%lu\n",
-                  rssi_immediate, rssi_near, rssi_far, rssi_remote);
-    Serial.printf("[HTTP] BLE: i=%lu, u=%lu, Apple=%lu, Other=%lu, rssi_avg=%d\n",
-                  bleImpressions, bleUnique, bleApple, bleOther, bleRssiAvg);
-    Serial.printf("[HTTP] Quality: of=%u, cd=%u, sf=%u, age=%lu\n",
-                  overflowCount, g_cacheCount, g_sendFailures, ageSeconds);
+// Quality fields: r.overflowCount=uniques dropped, ageSeconds=how old is this reading.
+// live = the reading just closed (not a cache retry) - only it carries sessions.
+static bool sendReading(const CachedReading& r, uint32_t ageSeconds, bool live) {
+    // Duty-cycle-normalized estimates: counts scaled to the full epoch
+    uint32_t impressionsNorm = normalizeCount(r.impressions, r.wifiListenMs, r.epochMs);
+    uint32_t uniqueNorm = normalizeCount(r.unique, r.wifiListenMs, r.epochMs);
+    uint32_t bleImpressionsNorm = normalizeCount(r.bleImpressions, r.bleListenMs, r.epochMs);
+    uint32_t bleUniqueNorm = normalizeCount(r.bleUnique, r.bleListenMs, r.epochMs);
+
+    LOGI("[HTTP] WiFi: t=%s, i=%lu, u=%lu\n", r.timestamp, r.impressions, r.unique);
+    LOGD("[HTTP]   probe_rssi: avg=%d min=%d max=%d, cell_rssi=%d\n",
+                  r.probeRssiAvg, r.probeRssiMin, r.probeRssiMax, r.cellRssi);
+    LOGD("[HTTP]   dwell: 0-1=%lu, 1-5=%lu, 5-10=%lu, 10+=%lu\n",
+                  r.dwell_0_1, r.dwell_1_5, r.dwell_5_10, r.dwell_10plus);
+    LOGD("[HTTP]   rssi_zones: imm=%lu, near=%lu, far=%lu, remote=%lu\n",
+                  r.rssi_immediate, r.rssi_near, r.rssi_far, r.rssi_remote);
+    LOGD("[HTTP] BLE: i=%lu, u=%lu, Apple=%lu, Other=%lu, rssi_avg=%d\n",
+                  r.bleImpressions, r.bleUnique, r.bleApple, r.bleOther, r.bleRssiAvg);
+    LOGD("[HTTP] Listen: epoch=%lu ms, wifi=%lu ms, ble=%lu ms (norm i=%lu u=%lu ble_i=%lu ble_u=%lu)\n",
+                  r.epochMs, r.wifiListenMs, r.bleListenMs,
+                  impressionsNorm, uniqueNorm, bleImpressionsNorm, bleUniqueNorm);
+    LOGI("[HTTP] Quality: of=%u, cd=%u, sf=%u, age=%lu, rxe=%lu, sqm=%lu, cbx=%lu us\n",
+                  r.overflowCount, g_cacheCount, g_sendFailures, ageSeconds,
+                  r.rxErrors, r.seqMissed, r.rxCallbackMaxUs);
 
     ledSetStatus(LED_STATUS_TRANSMITTING);  // Orange pulsing during send
+    g_httpStatus = 0;
+    g_httpRetryAfterS = 0;
+    g_httpRequestSent = false;
 
     // Build JSON payload with WiFi probes + BLE device counts (Apple vs Other)
-    // Quality fields: of=overflow, cd=cache_depth, sf=send_failures, age=seconds old
-    char jsonPayload[900];
-    snprintf(jsonPayload, sizeof(jsonPayload),
-             "{\"d\":\"%s\",\"t\":\"%s\",\"i\":%lu,\"u\":%lu,"
-             "\"probe_rssi_avg\":%d,\"probe_rssi_min\":%d,\"probe_rssi_max\":%d,\"cell_rssi\":%d,"
+    // BLE dwell/zones: bdw=[short,medium,long,loyal] dwell buckets, bz=[immediate,near,far,remote]
+    // (same thresholds as the WiFi dwell_* and rssi_* fields)
+    // Quality fields: of=overflow, cd=cache_depth, sf=send_failures, age=seconds old,
+    // rxs/rxp=mgmt frames seen/processed per channel, rxe=frames failing FCS/PHY checks,
+    // sqm=probes missed (seq gaps), cbx=slowest callback us
+    // Listen fields: ep=epoch ms, wl/bl=WiFi/BLE listen ms, wch=WiFi listen ms per channel,
+    // *_n=counts normalized to the full epoch
+    // uc=unique with MAC rotations merged by probe IE fingerprint (<= u), rl=rotations merged
+    // Compaction fields: ml=merge level, mc=readings merged (u/ble_u are upper bounds when mc>1)
+    // ri=report interval in seconds this reading was scheduled for (summed when merged)
+    // sq=reading sequence number, sql=last sequence when merged, sqs=sequence stream id,
+    // sqf=lowest sequence still held on the device (server acks up to its contiguous high)
+    // ps/pe=period start/end, Unix seconds, on wall-clock boundaries once time is synced;
+    // pp=1 when the period starts or ends off the grid (only when the clock is synced)
+    // rm=radio schedule, 0=time-sliced 1=concurrent WiFi+BLE 2=both (merged readings only)
+    // an=anomaly reasons detected on-device during the epoch (only when any)
+    // occupancy=distinct devices in the last 15 min at near zone or closer (peak when merged)
+    // rvn=distinct stable identifiers today, rv=permille of them seen on an earlier day
+    // (only when any; rv absent until a past day is on flash)
+    // ss=closed presence sessions [start Unix minute, minutes, best zone 0=immediate..3=remote],
+    // sd=sessions lost to ring overflow - live readings only
+    // Over the data budget the compact encoding drops the BLE dwell/zone
+    // breakdown, the listen and capture diagnostics and the probe RSSI spread
+    static_assert(WIFI_CHANNEL_COUNT == 3, "wch/rxs/rxp payload fields expect 3 channels");
+    bool compact = g_governorLevel >= GOV_SAVE;
+    // Static: payload outgrew what is comfortable on the loop task stack
+    static char jsonPayload[1800];
+    size_t n = snprintf(jsonPayload, sizeof(jsonPayload),
+             "{\"d\":\"%s\",\"t\":\"%s\",\"i\":%lu,\"u\":%lu,\"uc\":%lu,\"probe_rssi_avg\":%d,",
+             DEVICE_ID, r.timestamp, r.impressions, r.unique, r.uniqueCorrected, r.probeRssiAvg);
+    if (!compact) {
+        n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n,
+                 "\"probe_rssi_min\":%d,\"probe_rssi_max\":%d,",
+                 r.probeRssiMin, r.probeRssiMax);
+    }
+    n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n,
+             "\"cell_rssi\":%d,"
              "\"dwell_0_1\":%lu,\"dwell_1_5\":%lu,\"dwell_5_10\":%lu,\"dwell_10plus\":%lu,"
              "\"rssi_immediate\":%lu,\"rssi_near\":%lu,\"rssi_far\":%lu,\"rssi_remote\":%lu,"
              "\"ble_i\":%lu,\"ble_u\":%lu,\"ble_apple\":%lu,\"ble_other\":%lu,\"ble_rssi_avg\":%d,"
-             "\"of\":%u,\"cd\":%u,\"sf\":%u,\"age\":%lu,"
-             "\"ts\":%d,\"bt\":%lu}",
-             DEVICE_ID, timestamp, impressions, unique,
-             probeRssiAvg, probeRssiMin, probeRssiMax, cellRssi,
-             dwell_0_1, dwell_1_5, dwell_5_10, dwell_10plus,
-             rssi_immediate, rssi_near, rssi_far, rssi_remote,
-             bleImpressions, bleUnique, bleApple, bleOther, bleRssiAvg,
-             overflowCount, g_cacheCount, g_sendFailures, ageSeconds,
-             g_timeSynced ? 1 : 0, g_bootTimestamp);
+             "\"of\":%u,\"cd\":%u,\"sf\":%u,\"age\":%lu,",
+             r.cellRssi,
+             r.dwell_0_1, r.dwell_1_5, r.dwell_5_10, r.dwell_10plus,
+             r.rssi_immediate, r.rssi_near, r.rssi_far, r.rssi_remote,
+             r.bleImpressions, r.bleUnique, r.bleApple, r.bleOther, r.bleRssiAvg,
+             r.overflowCount, g_cacheCount, g_sendFailures, ageSeconds);
+    if (!compact) {
+        n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n,
+                 "\"bdw\":[%lu,%lu,%lu,%lu],\"bz\":[%lu,%lu,%lu,%lu],"
+                 "\"ep\":%lu,\"wl\":%lu,\"bl\":%lu,\"wch\":[%lu,%lu,%lu],"
+                 "\"i_n\":%lu,\"u_n\":%lu,\"ble_i_n\":%lu,\"ble_u_n\":%lu,"
+                 "\"rxs\":[%lu,%lu,%lu],\"rxp\":[%lu,%lu,%lu],\"rxe\":%lu,\"sqm\":%lu,\"cbx\":%lu,\"rl\":%lu,",
+                 r.bleDwell[0], r.bleDwell[1], r.bleDwell[2], r.bleDwell[3],
+                 r.bleZones[0], r.bleZones[1], r.bleZones[2], r.bleZones[3],
+                 r.epochMs, r.wifiListenMs, r.bleListenMs,
+                 r.channelListenMs[0], r.channelListenMs[1], r.channelListenMs[2],
+                 impressionsNorm, uniqueNorm, bleImpressionsNorm, bleUniqueNorm,
+                 r.rxMgmtSeen[0], r.rxMgmtSeen[1], r.rxMgmtSeen[2],
+                 r.rxMgmtProcessed[0], r.rxMgmtProcessed[1], r.rxMgmtProcessed[2],
+                 r.rxErrors, r.seqMissed, r.rxCallbackMaxUs, r.rotationsLinked);
+    }
+    if (r.anomalyFlags) {
+        char reason[64];
+        anomalyFormat(r.anomalyFlags, reason, sizeof(reason));
+        n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n, "\"an\":\"%s\",", reason);
+    }
+    n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n,
+             "\"sq\":%lu,\"sqs\":%lu,\"sqf\":%lu,",
+             r.seq, g_seqStream, seqFloor(r.seq));
+    if (r.seqLast != r.seq) {
+        n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n, "\"sql\":%lu,", r.seqLast);
+    }
+    if (r.periodStart > 0) {
+        n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n,
+                 "\"ps\":%lu,\"pe\":%lu,\"pp\":%d,",
+                 r.periodStart, r.periodEnd, r.periodPartial ? 1 : 0);
+    }
+    n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n,
+             "\"ts\":%d,\"bt\":%lu,\"tq\":%u,\"ml\":%u,\"mc\":%u,\"ri\":%lu,\"rm\":%u,\"occupancy\":%u",
+             g_timeSynced ? 1 : 0, g_bootTimestamp, r.timeQuality,
+             r.mergeLevel, r.mergedCount ? r.mergedCount : 1, r.intervalS, r.radioSchedule, r.occupancy);
+    if (r.stableIds > 0) {
+        n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n, ",\"rvn\":%u", r.stableIds);
+        if (r.returningPermille >= 0) {
+            n += snprintf(jsonPayload + n, sizeof(jsonPayload) - n, ",\"rv\":%d", r.returningPermille);
+        }
+    }
+    // Sessions ride with the live reading; released only when it is accepted
+    uint32_t sessionsUpTo = 0;
+    bool carriesSessions = live && n < sizeof(jsonPayload);
+    if (carriesSessions) {
+        sessionsUpTo = sessionFormat(jsonPayload + n, sizeof(jsonPayload) - n - 1, timeNow() / 60);
+        n += strlen(jsonPayload + n);
+    }
+    snprintf(jsonPayload + n, sizeof(jsonPayload) - n, "}");
 
     size_t jsonLen = strlen(jsonPayload);
 
     // Build HTTP request
-    char httpRequest[1100];
+    static char httpRequest[2000];
     int httpLen = snprintf(httpRequest, sizeof(httpRequest),
         "POST %s HTTP/1.1\r\n"
         "Host: %s:%d\r\n"
@@ -1305,42 +4571,53 @@ static bool sendReading(const char* timestamp, uint32_t impressions, uint32_t un
     snprintf(tcpOpenCmd, sizeof(tcpOpenCmd),
              "AT+CIPOPEN=0,\"TCP\",\"%s\",%d", BACKEND_HOST, BACKEND_PORT);
 
-    Serial.printf("[HTTP] Connecting to %s:%d\n", BACKEND_HOST, BACKEND_PORT);
+    LOGI("[HTTP] Connecting to %s:%d\n", BACKEND_HOST, BACKEND_PORT);
 
     if (!atSendCommand(tcpOpenCmd, "+CIPOPEN: 0,0", TCP_CONNECT_TIMEOUT_MS)) {
-        Serial.println("[HTTP] TCP connect failed");
+        LOGW("[HTTP] TCP connect failed\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         g_lastSendSuccess = false;
+        sendFailureCount();
         ledSetStatus(LED_STATUS_SEND_FAILED);
         return false;
     }
 
-    Serial.println("[HTTP] Connected");
+    LOGI("[HTTP] Connected\n");
     delay(500);
 
-    // Send data
-    char sendCmd[32];
-    snprintf(sendCmd, sizeof(sendCmd), "AT+CIPSEND=0,%d", httpLen);
-
-    if (!atSendCommand(sendCmd, ">", AT_COMMAND_TIMEOUT_MS)) {
-        Serial.println("[HTTP] CIPSEND prompt failed");
-        atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
-        g_lastSendSuccess = false;
-        ledSetStatus(LED_STATUS_SEND_FAILED);
-        return false;
-    }
+    // Send data - in READING_SEND_CHUNK pieces, session records can push a
+    // reading past what one AT+CIPSEND accepts
+    for (int sentLen = 0; sentLen < httpLen; ) {
+        int piece = httpLen - sentLen;
+        if (piece > READING_SEND_CHUNK) piece = READING_SEND_CHUNK;
+
+        char sendCmd[32];
+        snprintf(sendCmd, sizeof(sendCmd), "AT+CIPSEND=0,%d", piece);
+
+        if (!atSendCommand(sendCmd, ">", AT_COMMAND_TIMEOUT_MS)) {
+            LOGW("[HTTP] CIPSEND prompt failed\n");
+            atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
+            g_lastSendSuccess = false;
+            sendFailureCount();
+            ledSetStatus(LED_STATUS_SEND_FAILED);
+            return false;
+        }
 
-    // Send HTTP request data
-    atSendRaw(httpRequest, httpLen);
+        // Send HTTP request data
+        atSendRaw(httpRequest + sentLen, piece);
 
-    // Wait for send confirmation
-    if (!atWaitFor("+CIPSEND:", 15000)) {
-        Serial.println("[HTTP] Send confirmation timeout");
-        atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
-        g_lastSendSuccess = false;
-        ledSetStatus(LED_STATUS_SEND_FAILED);
-        return false;
+        // Wait for send confirmation
+        if (!atWaitFor("+CIPSEND:", 15000)) {
+            LOGW("[HTTP] Send confirmation timeout\n");
+            atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
+            g_lastSendSuccess = false;
+            sendFailureCount();
+            ledSetStatus(LED_STATUS_SEND_FAILED);
+            return false;
+        }
+        sentLen += piece;
     }
+    g_httpRequestSent = true;
 
     // Wait for HTTP response
     delay(2000);
@@ -1349,8 +4626,8 @@ static bool sendReading(const char* timestamp, uint32_t impressions, uint32_t un
     atClearBuffer();
     uint32_t readStart = millis();
     while ((millis() - readStart) < 5000) {
-        while (ModemSerial.available() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
-            char c = ModemSerial.read();
+        while (modemAvailable() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
+            char c = modemRead();
             g_atBuffer[g_atBufferLen++] = c;
         }
         delay(100);
@@ -1358,16 +4635,22 @@ static bool sendReading(const char* timestamp, uint32_t impressions, uint32_t un
     g_atBuffer[g_atBufferLen] = '\0';
 
     if (g_atBufferLen > 0) {
-        Serial.printf("[HTTP] Response: %s\n", g_atBuffer);
+        LOGD_DUMP("[HTTP] Response: ", g_atBuffer);
     }
 
-    // Check for HTTP success (200 OK or 201 Created)
-    bool success = (strstr(g_atBuffer, "200") != NULL ||
-                    strstr(g_atBuffer, "201") != NULL);
+    // Check for HTTP success (2xx status line)
+    g_httpStatus = httpStatusCode(g_atBuffer);
+    g_httpRetryAfterS = httpRetryAfterS(g_atBuffer);
+    bool success = g_httpStatus >= 200 && g_httpStatus < 300;
+
+    // Acknowledged sequence - before CIPCLOSE clears the buffer
+    if (success) {
+        seqOnAck(g_atBuffer);
+    }
 
     // Check for OTA trigger in response
     if (success && checkOtaTrigger(g_atBuffer)) {
-        Serial.println("[HTTPS] OTA update requested by backend");
+        LOGI("[HTTPS] OTA update requested by backend\n");
         g_otaRequested = true;
     }
 
@@ -1387,24 +4670,27 @@ static bool sendReading(const char* timestamp, uint32_t impressions, uint32_t un
                     size_t cmdLen = cmdEnd - cmdStart;
                     memcpy(command, cmdStart, cmdLen);
 
-                    Serial.printf("[COMMAND] Received in reading response: %s\n", command);
+                    LOGI("[COMMAND] Received in reading response: %s\n", command);
 
                     if (strcmp(command, "reboot") == 0) {
-                        Serial.println("[COMMAND] Reboot scheduled");
+                        LOGI("[COMMAND] Reboot scheduled\n");
                         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
                         delay(1000);
+                        logFlush(LOG_FLUSH_TIMEOUT_MS);
                         ESP.restart();
                     } else if (strcmp(command, "send_now") == 0) {
-                        Serial.println("[COMMAND] Force send requested");
-                        g_forceSendRequested = true;
+                        LOGI("[COMMAND] Force send requested\n");
+                        requestReportNow();
                     } else if (strcmp(command, "geolocate") == 0) {
-                        Serial.println("[COMMAND] Remote geolocation requested");
+                        LOGI("[COMMAND] Remote geolocation requested\n");
                         g_geolocationPending = true;
                     } else if (strcmp(command, "ota_check") == 0) {
-                        Serial.println("[COMMAND] OTA update check requested");
+                        LOGI("[COMMAND] OTA update check requested\n");
                         triggerOtaCheck();
+                    } else if (strncmp(command, "upload_logs", 11) == 0) {
+                        scheduleLogUpload(command);
                     } else {
-                        Serial.printf("[COMMAND] Unknown command: %s\n", command);
+                        LOGW("[COMMAND] Unknown command: %s\n", command);
                     }
                 }
             }
@@ -1415,7 +4701,8 @@ static bool sendReading(const char* timestamp, uint32_t impressions, uint32_t un
     atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
 
     if (success) {
-        Serial.println("[HTTP] Success");
+        LOGI("[HTTP] Success\n");
+        if (carriesSessions) sessionRelease(sessionsUpTo);
         g_lastSendSuccess = true;
         g_sendFailures = 0;  // Reset consecutive failure count on success
         ledSetStatus(LED_STATUS_SEND_SUCCESS);  // Green for 3 sec, then cyan
@@ -1426,12 +4713,12 @@ static bool sendReading(const char* timestamp, uint32_t impressions, uint32_t un
         if (!g_otaConfirmed) {
             esp_ota_mark_app_valid_cancel_rollback();
             g_otaConfirmed = true;
-            Serial.println("[OTA] Firmware confirmed valid - rollback disabled");
+            LOGI("[OTA] Firmware confirmed valid - rollback disabled\n");
         }
     } else {
-        Serial.println("[HTTP] Response not OK");
+        LOGI("[HTTP] Response not OK (%d)\n", g_httpStatus);
         g_lastSendSuccess = false;
-        g_sendFailures++;    // Increment consecutive failure count
+        sendFailureCount();
         ledSetStatus(LED_STATUS_SEND_FAILED);   // Blue slow blink
     }
 
@@ -1444,26 +4731,34 @@ static bool sendReading(const char* timestamp, uint32_t impressions, uint32_t un
 
 // Send heartbeat to backend - daily check-in even with zero traffic
 static bool sendHeartbeat() {
-    Serial.println("[HEARTBEAT] Sending heartbeat...");
+    LOGI("[HEARTBEAT] Sending heartbeat...\n");
 
     // Get current cellular signal
-    int cellRssi = getSignalQuality();
+    int cellRssi = currentSignalDbm();
     uint32_t uptimeSec = millis() / 1000;
 
-    Serial.printf("[HEARTBEAT] Device: %s, Version: %s, Uptime: %lu sec, RSSI: %d dBm\n",
+    LOGI("[HEARTBEAT] Device: %s, Version: %s, Uptime: %lu sec, RSSI: %d dBm\n",
                   DEVICE_ID, FIRMWARE_VERSION, uptimeSec, cellRssi);
 
     // Build JSON payload
-    // Format: {"d":"JBNB0001","v":"2.8","uptime":86400,"cell_rssi":-85}
-    char jsonPayload[128];
+    // Format: {"d":"JBNB0001","v":"2.8","uptime":86400,"cell_rssi":-85,"tq":3,"drift_ppm":-12,
+    //          "ub_day":48211,"ub_month":1032554,"gov":0}
+    portENTER_CRITICAL(&g_usageMux);
+    uint32_t usageDay = g_usageDayBytes;
+    uint32_t usageMonth = g_usageMonthBytes;
+    portEXIT_CRITICAL(&g_usageMux);
+    char jsonPayload[224];
     snprintf(jsonPayload, sizeof(jsonPayload),
-             "{\"d\":\"%s\",\"v\":\"%s\",\"uptime\":%lu,\"cell_rssi\":%d}",
-             DEVICE_ID, FIRMWARE_VERSION, uptimeSec, cellRssi);
+             "{\"d\":\"%s\",\"v\":\"%s\",\"uptime\":%lu,\"cell_rssi\":%d,"
+             "\"tq\":%u,\"drift_ppm\":%ld,\"ub_day\":%lu,\"ub_month\":%lu,\"gov\":%u}",
+             DEVICE_ID, FIRMWARE_VERSION, uptimeSec, cellRssi,
+             (unsigned)timeQuality(), g_timeDriftPpm, usageDay, usageMonth,
+             (unsigned)g_governorLevel);
 
     size_t jsonLen = strlen(jsonPayload);
 
     // Build HTTP request
-    char httpRequest[384];
+    char httpRequest[512];
     int httpLen = snprintf(httpRequest, sizeof(httpRequest),
         "POST %s HTTP/1.1\r\n"
         "Host: %s:%d\r\n"
@@ -1481,15 +4776,15 @@ static bool sendHeartbeat() {
     snprintf(tcpOpenCmd, sizeof(tcpOpenCmd),
              "AT+CIPOPEN=0,\"TCP\",\"%s\",%d", BACKEND_HOST, BACKEND_PORT);
 
-    Serial.printf("[HEARTBEAT] Connecting to %s:%d\n", BACKEND_HOST, BACKEND_PORT);
+    LOGI("[HEARTBEAT] Connecting to %s:%d\n", BACKEND_HOST, BACKEND_PORT);
 
     if (!atSendCommand(tcpOpenCmd, "+CIPOPEN: 0,0", TCP_CONNECT_TIMEOUT_MS)) {
-        Serial.println("[HEARTBEAT] TCP connect failed");
+        LOGW("[HEARTBEAT] TCP connect failed\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
 
-    Serial.println("[HEARTBEAT] Connected");
+    LOGI("[HEARTBEAT] Connected\n");
     delay(500);
 
     // Send data
@@ -1497,7 +4792,7 @@ static bool sendHeartbeat() {
     snprintf(sendCmd, sizeof(sendCmd), "AT+CIPSEND=0,%d", httpLen);
 
     if (!atSendCommand(sendCmd, ">", AT_COMMAND_TIMEOUT_MS)) {
-        Serial.println("[HEARTBEAT] CIPSEND prompt failed");
+        LOGW("[HEARTBEAT] CIPSEND prompt failed\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
@@ -1507,7 +4802,7 @@ static bool sendHeartbeat() {
 
     // Wait for send confirmation
     if (!atWaitFor("+CIPSEND:", 15000)) {
-        Serial.println("[HEARTBEAT] Send confirmation timeout");
+        LOGW("[HEARTBEAT] Send confirmation timeout\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
@@ -1519,8 +4814,8 @@ static bool sendHeartbeat() {
     atClearBuffer();
     uint32_t readStart = millis();
     while ((millis() - readStart) < 5000) {
-        while (ModemSerial.available() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
-            char c = ModemSerial.read();
+        while (modemAvailable() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
+            char c = modemRead();
             g_atBuffer[g_atBufferLen++] = c;
         }
         delay(100);
@@ -1528,31 +4823,30 @@ static bool sendHeartbeat() {
     g_atBuffer[g_atBufferLen] = '\0';
 
     if (g_atBufferLen > 0) {
-        Serial.printf("[HEARTBEAT] Response: %s\n", g_atBuffer);
+        LOGD_DUMP("[HEARTBEAT] Response: ", g_atBuffer);
     }
 
     // Check for HTTP success
-    bool success = (strstr(g_atBuffer, "200") != NULL ||
-                    strstr(g_atBuffer, "201") != NULL);
+    bool success = httpResponseOk(g_atBuffer);
 
     // Parse server_time BEFORE closing connection (atSendCommand clears g_atBuffer!)
     if (success) {
-        Serial.println("[HEARTBEAT] Success");
+        LOGI("[HEARTBEAT] Success\n");
 
         // Parse server_time for timestamp synchronization
-        Serial.printf("[TIME DEBUG] Buffer len: %d\n", g_atBufferLen);
+        LOGD("[TIME DEBUG] Buffer len: %d\n", g_atBufferLen);
         char* jsonBody = strstr(g_atBuffer, "\r\n\r\n");
         if (!jsonBody) {
-            Serial.println("[TIME DEBUG] No \\r\\n\\r\\n found, looking for {");
+            LOGD("[TIME DEBUG] No \\r\\n\\r\\n found, looking for {\n");
             jsonBody = strstr(g_atBuffer, "{");
         }
 
         if (jsonBody) {
-            Serial.printf("[TIME DEBUG] JSON body found at offset %ld\n", jsonBody - g_atBuffer);
+            LOGD("[TIME DEBUG] JSON body found at offset %ld\n", jsonBody - g_atBuffer);
             // Look for server_time in response (ISO 8601 format)
             char* timeStart = strstr(jsonBody, "\"server_time\":\"");
             if (timeStart) {
-                Serial.println("[TIME DEBUG] Found server_time key");
+                LOGD("[TIME DEBUG] Found server_time key\n");
                 timeStart += 15;  // Skip past "server_time":"
                 char* timeEnd = strchr(timeStart, '"');
                 if (timeEnd && (timeEnd - timeStart) < 40) {
@@ -1562,37 +4856,17 @@ static bool sendHeartbeat() {
                     // Parse ISO 8601: "2026-01-26T12:30:00+00:00" or "2026-01-26T12:30:00.123456+00:00"
                     int year, month, day, hour, minute, second;
                     if (sscanf(serverTime, "%d-%d-%dT%d:%d:%d", &year, &month, &day, &hour, &minute, &second) == 6) {
-                        // Convert to Unix timestamp manually (avoids mktime timezone issues)
-                        // Days from year 1970 to start of given year
-                        uint32_t days = 0;
-                        for (int y = 1970; y < year; y++) {
-                            days += (y % 4 == 0 && (y % 100 != 0 || y % 400 == 0)) ? 366 : 365;
-                        }
-                        // Days in months of current year
-                        static const int daysInMonth[] = {31,28,31,30,31,30,31,31,30,31,30,31};
-                        bool isLeap = (year % 4 == 0 && (year % 100 != 0 || year % 400 == 0));
-                        for (int m = 0; m < month - 1; m++) {
-                            days += daysInMonth[m];
-                            if (m == 1 && isLeap) days++; // Feb in leap year
-                        }
-                        days += day - 1;
-
-                        uint32_t serverEpoch = days * 86400UL + hour * 3600UL + minute * 60UL + second;
-                        uint32_t deviceUptime = millis() / 1000;
-                        g_bootTimestamp = serverEpoch - deviceUptime;
-
-                        Serial.printf("[TIME] Parsed: %04d-%02d-%02d %02d:%02d:%02d\n", year, month, day, hour, minute, second);
-                        Serial.printf("[TIME] Server epoch: %lu, uptime: %lu\n", serverEpoch, deviceUptime);
-                        Serial.printf("[TIME] Boot timestamp set to: %lu\n", g_bootTimestamp);
-                        g_timeSynced = true;
+                        uint32_t serverEpoch = civilToEpoch(year, month, day, hour, minute, second);
+                        LOGI("[TIME] Server time: %04d-%02d-%02d %02d:%02d:%02d\n", year, month, day, hour, minute, second);
+                        timeApplySync(serverEpoch, millis(), TIME_QUALITY_SERVER);
                     } else {
-                        Serial.printf("[TIME] Failed to parse: %s\n", serverTime);
+                        LOGW("[TIME] Failed to parse: %s\n", serverTime);
                     }
                 } else {
-                    Serial.println("[TIME DEBUG] Could not find end quote for server_time value");
+                    LOGD("[TIME DEBUG] Could not find end quote for server_time value\n");
                 }
             } else {
-                Serial.println("[TIME DEBUG] server_time key not found in response");
+                LOGD("[TIME DEBUG] server_time key not found in response\n");
             }
 
             // Check for remote command in response (reuse jsonBody from time sync)
@@ -1606,28 +4880,31 @@ static bool sendHeartbeat() {
                     size_t cmdLen = cmdEnd - cmdStart;
                     memcpy(command, cmdStart, cmdLen);
 
-                    Serial.printf("[COMMAND] Received: %s\n", command);
+                    LOGI("[COMMAND] Received: %s\n", command);
 
                     if (strcmp(command, "reboot") == 0) {
-                        Serial.println("[COMMAND] Reboot scheduled - closing connection first");
+                        LOGI("[COMMAND] Reboot scheduled - closing connection first\n");
                         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
                         delay(1000);
-                        Serial.println("[COMMAND] Executing reboot now...");
+                        LOGI("[COMMAND] Executing reboot now...\n");
+                        logFlush(LOG_FLUSH_TIMEOUT_MS);
                         ESP.restart();
                     } else if (strcmp(command, "send_now") == 0) {
-                        Serial.println("[COMMAND] Force send requested");
-                        g_forceSendRequested = true;
+                        LOGI("[COMMAND] Force send requested\n");
+                        requestReportNow();
                     } else if (strcmp(command, "geolocate") == 0) {
-                        Serial.println("[COMMAND] Remote geolocation requested");
+                        LOGI("[COMMAND] Remote geolocation requested\n");
                         g_geolocationPending = true;
                     } else if (strcmp(command, "ota_check") == 0) {
-                        Serial.println("[COMMAND] OTA update check requested");
+                        LOGI("[COMMAND] OTA update check requested\n");
                         triggerOtaCheck();
                     } else if (strcmp(command, "fetch_config") == 0) {
-                        Serial.println("[COMMAND] Config fetch requested");
+                        LOGI("[COMMAND] Config fetch requested\n");
                         g_configFetchPending = true;
+                    } else if (strncmp(command, "upload_logs", 11) == 0) {
+                        scheduleLogUpload(command);
                     } else {
-                        Serial.printf("[COMMAND] Unknown command: %s\n", command);
+                        LOGW("[COMMAND] Unknown command: %s\n", command);
                     }
                 }
             }
@@ -1638,30 +4915,30 @@ static bool sendHeartbeat() {
                 configVerStart += 17;  // Skip past "config_version":
                 uint32_t serverConfigVersion = (uint32_t)atol(configVerStart);
                 if (serverConfigVersion > g_configVersion) {
-                    Serial.printf("[CONFIG] Server config v%lu > local v%lu - fetch scheduled\n",
+                    LOGI("[CONFIG] Server config v%lu > local v%lu - fetch scheduled\n",
                                   serverConfigVersion, g_configVersion);
                     g_configFetchPending = true;
                 }
             }
         } else {
-            Serial.println("[TIME DEBUG] No JSON body found in response");
+            LOGD("[TIME DEBUG] No JSON body found in response\n");
         }
 
         // OTA rollback protection: After first successful communication, mark firmware valid
         if (!g_otaConfirmed) {
             esp_ota_mark_app_valid_cancel_rollback();
             g_otaConfirmed = true;
-            Serial.println("[OTA] Firmware confirmed valid - rollback disabled");
+            LOGI("[OTA] Firmware confirmed valid - rollback disabled\n");
         }
 
         // Schedule OTA check after successful heartbeat (if not already in progress)
         // This provides automatic daily update checking
         if (g_otaDelta.state == OTA_DELTA_IDLE) {
             g_otaDelta.checkPending = true;
-            Serial.println("[HEARTBEAT] OTA check scheduled (daily)");
+            LOGI("[HEARTBEAT] OTA check scheduled (daily)\n");
         }
     } else {
-        Serial.println("[HEARTBEAT] Failed");
+        LOGW("[HEARTBEAT] Failed\n");
     }
 
     // Close TCP connection (after parsing is complete)
@@ -1679,7 +4956,7 @@ static bool sendHeartbeat() {
 
 // Fetch device config from backend and apply thresholds
 static bool fetchAndApplyConfig() {
-    Serial.println("[CONFIG] Fetching remote configuration...");
+    LOGI("[CONFIG] Fetching remote configuration...\n");
 
     // Build config path with device ID
     char configPath[64];
@@ -1695,36 +4972,36 @@ static bool fetchAndApplyConfig() {
         "\r\n",
         configPath, BACKEND_HOST, BACKEND_PORT, AUTH_TOKEN);
 
-    Serial.printf("[CONFIG] Connecting to %s:%d\n", BACKEND_HOST, BACKEND_PORT);
+    LOGI("[CONFIG] Connecting to %s:%d\n", BACKEND_HOST, BACKEND_PORT);
 
     // Open TCP connection
     char cmd[128];
     snprintf(cmd, sizeof(cmd), "AT+CIPOPEN=0,\"TCP\",\"%s\",%d", BACKEND_HOST, BACKEND_PORT);
     if (!atSendCommand(cmd, "+CIPOPEN: 0,0", TCP_CONNECT_TIMEOUT_MS)) {
-        Serial.println("[CONFIG] TCP connect failed");
+        LOGW("[CONFIG] TCP connect failed\n");
         return false;
     }
 
-    Serial.println("[CONFIG] Connected, sending request");
+    LOGI("[CONFIG] Connected, sending request\n");
 
     // Send data
     snprintf(cmd, sizeof(cmd), "AT+CIPSEND=0,%d", requestLen);
     if (!atSendCommand(cmd, ">", 5000)) {
-        Serial.println("[CONFIG] CIPSEND prompt failed");
+        LOGW("[CONFIG] CIPSEND prompt failed\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
 
     // Send HTTP request
-    ModemSerial.write((uint8_t*)request, requestLen);
+    atSendRaw(request, requestLen);
 
     // Wait for response
     delay(500);
     uint32_t responseStart = millis();
     g_atBufferLen = 0;
     while ((millis() - responseStart) < 15000 && g_atBufferLen < (sizeof(g_atBuffer) - 1)) {
-        if (ModemSerial.available()) {
-            char c = ModemSerial.read();
+        if (modemAvailable()) {
+            char c = modemRead();
             g_atBuffer[g_atBufferLen++] = c;
         }
         delay(10);
@@ -1735,12 +5012,12 @@ static bool fetchAndApplyConfig() {
     atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
 
     // Check for HTTP success
-    if (strstr(g_atBuffer, "200") == NULL) {
-        Serial.println("[CONFIG] HTTP request failed");
+    if (!httpResponseOk(g_atBuffer)) {
+        LOGW("[CONFIG] HTTP request failed\n");
         return false;
     }
 
-    Serial.println("[CONFIG] Response received, parsing...");
+    LOGI("[CONFIG] Response received, parsing...\n");
 
     // Find JSON body
     char* jsonBody = strstr(g_atBuffer, "\r\n\r\n");
@@ -1748,7 +5025,7 @@ static bool fetchAndApplyConfig() {
         jsonBody = strstr(g_atBuffer, "{");
     }
     if (!jsonBody) {
-        Serial.println("[CONFIG] No JSON body found");
+        LOGW("[CONFIG] No JSON body found\n");
         return false;
     }
 
@@ -1758,64 +5035,279 @@ static bool fetchAndApplyConfig() {
     if (ptr) {
         ptr += 17;
         g_configVersion = (uint32_t)atol(ptr);
-        Serial.printf("[CONFIG] Version: %lu\n", g_configVersion);
+        LOGI("[CONFIG] Version: %lu\n", g_configVersion);
     }
 
-    // report_interval_ms - note: not applied in this MVP, would require NVS persistence
+    // Report interval base and adaptive bounds
+    uint32_t intervalBase = 0, intervalMin = 0, intervalMax = 0;
     ptr = strstr(jsonBody, "\"report_interval_ms\":");
     if (ptr) {
         ptr += 21;
-        uint32_t interval = (uint32_t)atol(ptr);
-        Serial.printf("[CONFIG] Report interval: %lu ms (note: requires reflash to change)\n", interval);
-        // Future: store in NVS and use dynamic interval
+        intervalBase = (uint32_t)atol(ptr);
+    }
+
+    ptr = strstr(jsonBody, "\"report_interval_min_ms\":");
+    if (ptr) {
+        ptr += 25;
+        intervalMin = (uint32_t)atol(ptr);
+    }
+
+    ptr = strstr(jsonBody, "\"report_interval_max_ms\":");
+    if (ptr) {
+        ptr += 25;
+        intervalMax = (uint32_t)atol(ptr);
+    }
+
+    adaptiveSetBounds(intervalBase, intervalMin, intervalMax);
+    LOGI("[CONFIG] Report interval: base %lu s, bounds %lu-%lu s\n",
+         g_reportIntervalBaseMs / 1000, g_reportIntervalMinMs / 1000, g_reportIntervalMaxMs / 1000);
+
+    // RSSI thresholds
+    ptr = strstr(jsonBody, "\"rssi_immediate_threshold\":");
+    if (ptr) {
+        ptr += 27;
+        g_rssiImmediateThreshold = atoi(ptr);
+        LOGI("[CONFIG] RSSI immediate: %d dBm\n", g_rssiImmediateThreshold);
+    }
+
+    ptr = strstr(jsonBody, "\"rssi_near_threshold\":");
+    if (ptr) {
+        ptr += 22;
+        g_rssiNearThreshold = atoi(ptr);
+        LOGI("[CONFIG] RSSI near: %d dBm\n", g_rssiNearThreshold);
+    }
+
+    ptr = strstr(jsonBody, "\"rssi_far_threshold\":");
+    if (ptr) {
+        ptr += 21;
+        g_rssiFarThreshold = atoi(ptr);
+        LOGI("[CONFIG] RSSI far: %d dBm\n", g_rssiFarThreshold);
+    }
+
+    // Dwell thresholds
+    ptr = strstr(jsonBody, "\"dwell_short_threshold\":");
+    if (ptr) {
+        ptr += 24;
+        g_dwellShortThreshold = (uint8_t)atoi(ptr);
+        LOGI("[CONFIG] Dwell short: %u min\n", g_dwellShortThreshold);
+    }
+
+    ptr = strstr(jsonBody, "\"dwell_medium_threshold\":");
+    if (ptr) {
+        ptr += 25;
+        g_dwellMediumThreshold = (uint8_t)atoi(ptr);
+        LOGI("[CONFIG] Dwell medium: %u min\n", g_dwellMediumThreshold);
+    }
+
+    ptr = strstr(jsonBody, "\"dwell_long_threshold\":");
+    if (ptr) {
+        ptr += 23;
+        g_dwellLongThreshold = (uint8_t)atoi(ptr);
+        LOGI("[CONFIG] Dwell long: %u min\n", g_dwellLongThreshold);
+    }
+
+    // Monthly data budget (0 = unlimited)
+    ptr = strstr(jsonBody, "\"data_budget_mb\":");
+    if (ptr) {
+        ptr += 17;
+        usageSetBudget((uint32_t)atol(ptr));
+        LOGI("[CONFIG] Data budget: %lu MB/month\n", g_dataBudgetMb);
+    }
+
+    // Radio schedule - takes effect when capture resumes after this report cycle
+    ptr = strstr(jsonBody, "\"radio_mode\":\"");
+    if (ptr) {
+        ptr += 14;
+        g_radioScheduleNext = strncmp(ptr, "coex", 4) == 0 ? RADIO_SCHEDULE_COEX : RADIO_SCHEDULE_SLICED;
+        LOGI("[CONFIG] Radio mode: %s\n", g_radioScheduleNext == RADIO_SCHEDULE_COEX ? "coex" : "sliced");
+    }
+
+    LOGI("[CONFIG] Configuration applied successfully\n");
+    return true;
+}
+
+// =============================================================================
+// Remote Log Upload
+// =============================================================================
+
+// Log upload endpoint - raw LZSS body, device ID and sizes in the query string
+#define LOG_UPLOAD_PATH "/api/logs"
+#define LOG_UPLOAD_SEND_CHUNK 512   // Bytes per AT+CIPSEND while streaming the body
+
+// LZSS format (decoded by backend receiver.py):
+//   a flag byte precedes each group of up to 8 items, LSB first;
+//   flag bit 0 = literal byte, 1 = match of 2 bytes:
+//     byte0 = (offset-1) & 0xFF, byte1 = ((offset-1) >> 8) << 4 | (length-3)
+//   offsets 1..4096, lengths 3..18
+#define LZSS_WINDOW      4096
+#define LZSS_MIN_MATCH   3
+#define LZSS_MAX_MATCH   18
+#define LZSS_HASH_SIZE   1024
+
+typedef void (*LzssSink)(const uint8_t* data, size_t len);
+
+static uint16_t g_lzssHash[LZSS_HASH_SIZE];  // Last position+1 per 3-byte hash
+
+static inline uint8_t logHistoryAt(uint32_t start, uint32_t i) {
+    return (uint8_t)g_logHistory[(start + i) % LOG_HISTORY_SIZE];
+}
+
+// Compress n bytes of log history starting at absolute offset start.
+// Deterministic, so it runs once with a null sink to size the body and
+// again to stream it - no output buffer needed.
+static size_t lzssCompressHistory(uint32_t start, uint32_t n, LzssSink sink) {
+    memset(g_lzssHash, 0, sizeof(g_lzssHash));
+    uint8_t group[1 + 8 * 2];
+    size_t groupLen = 1;
+    uint8_t items = 0;
+    size_t total = 0;
+    group[0] = 0;
+
+    uint32_t i = 0;
+    while (i < n) {
+        uint32_t matchLen = 0;
+        uint32_t matchOff = 0;
+        if (i + LZSS_MIN_MATCH <= n) {
+            uint32_t h = ((logHistoryAt(start, i) << 6) ^ (logHistoryAt(start, i + 1) << 3) ^
+                          logHistoryAt(start, i + 2)) & (LZSS_HASH_SIZE - 1);
+            uint32_t cand = g_lzssHash[h];
+            g_lzssHash[h] = (uint16_t)(i + 1);
+            if (cand > 0 && (i - (cand - 1)) <= LZSS_WINDOW) {
+                uint32_t c = cand - 1;
+                uint32_t maxLen = min((uint32_t)LZSS_MAX_MATCH, n - i);
+                while (matchLen < maxLen &&
+                       logHistoryAt(start, c + matchLen) == logHistoryAt(start, i + matchLen)) {
+                    matchLen++;
+                }
+                matchOff = i - c;
+            }
+        }
+
+        if (matchLen >= LZSS_MIN_MATCH) {
+            group[0] |= (uint8_t)(1 << items);
+            group[groupLen++] = (uint8_t)((matchOff - 1) & 0xFF);
+            group[groupLen++] = (uint8_t)((((matchOff - 1) >> 8) << 4) | (matchLen - LZSS_MIN_MATCH));
+            i += matchLen;
+        } else {
+            group[groupLen++] = logHistoryAt(start, i);
+            i++;
+        }
+
+        if (++items == 8) {
+            if (sink) sink(group, groupLen);
+            total += groupLen;
+            group[0] = 0;
+            groupLen = 1;
+            items = 0;
+        }
+    }
+    if (items > 0) {
+        if (sink) sink(group, groupLen);
+        total += groupLen;
+    }
+    return total;
+}
+
+// Streaming sink state - body goes out in LOG_UPLOAD_SEND_CHUNK pieces
+static uint8_t g_logSendBuf[LOG_UPLOAD_SEND_CHUNK];
+static size_t g_logSendLen = 0;
+static bool g_logSendOk = false;
+
+static void logSendFlush() {
+    if (!g_logSendOk || g_logSendLen == 0) return;
+
+    char sendCmd[32];
+    snprintf(sendCmd, sizeof(sendCmd), "AT+CIPSEND=0,%u", (unsigned)g_logSendLen);
+    if (!atSendCommand(sendCmd, ">", AT_COMMAND_TIMEOUT_MS)) {
+        g_logSendOk = false;
+        return;
     }
-
-    // RSSI thresholds
-    ptr = strstr(jsonBody, "\"rssi_immediate_threshold\":");
-    if (ptr) {
-        ptr += 27;
-        g_rssiImmediateThreshold = atoi(ptr);
-        Serial.printf("[CONFIG] RSSI immediate: %d dBm\n", g_rssiImmediateThreshold);
+    atSendRaw((const char*)g_logSendBuf, g_logSendLen);
+    if (!atWaitFor("+CIPSEND:", 15000)) {
+        g_logSendOk = false;
+        return;
     }
+    g_logSendLen = 0;
+    esp_task_wdt_reset();
+}
 
-    ptr = strstr(jsonBody, "\"rssi_near_threshold\":");
-    if (ptr) {
-        ptr += 22;
-        g_rssiNearThreshold = atoi(ptr);
-        Serial.printf("[CONFIG] RSSI near: %d dBm\n", g_rssiNearThreshold);
+static void logSendSink(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        g_logSendBuf[g_logSendLen++] = data[i];
+        if (g_logSendLen == LOG_UPLOAD_SEND_CHUNK) {
+            logSendFlush();
+        }
     }
+}
 
-    ptr = strstr(jsonBody, "\"rssi_far_threshold\":");
-    if (ptr) {
-        ptr += 21;
-        g_rssiFarThreshold = atoi(ptr);
-        Serial.printf("[CONFIG] RSSI far: %d dBm\n", g_rssiFarThreshold);
+// Ship the last kb KB of log history, LZSS-compressed
+// POST /api/logs?d=JBNB0001&raw=4096&total=123456  (body: LZSS bytes)
+static bool uploadLogs(uint16_t kb) {
+    // Freeze history so both compression passes see identical bytes
+    portENTER_CRITICAL(&g_logHistoryMux);
+    g_logHistoryFrozen = true;
+    uint32_t historyTotal = g_logHistoryTotal;
+    portEXIT_CRITICAL(&g_logHistoryMux);
+
+    uint32_t available = min(historyTotal, (uint32_t)LOG_HISTORY_SIZE);
+    uint32_t rawLen = min((uint32_t)kb * 1024, available);
+    uint32_t start = historyTotal - rawLen;
+    bool success = false;
+
+    if (rawLen == 0) {
+        LOGW("[LOGS] No log history to upload\n");
+        g_logHistoryFrozen = false;
+        return false;
     }
 
-    // Dwell thresholds
-    ptr = strstr(jsonBody, "\"dwell_short_threshold\":");
-    if (ptr) {
-        ptr += 24;
-        g_dwellShortThreshold = (uint8_t)atoi(ptr);
-        Serial.printf("[CONFIG] Dwell short: %u min\n", g_dwellShortThreshold);
-    }
+    size_t bodyLen = lzssCompressHistory(start, rawLen, nullptr);
+    LOGI("[LOGS] Uploading %lu bytes of log (%u compressed)\n", rawLen, (unsigned)bodyLen);
 
-    ptr = strstr(jsonBody, "\"dwell_medium_threshold\":");
-    if (ptr) {
-        ptr += 25;
-        g_dwellMediumThreshold = (uint8_t)atoi(ptr);
-        Serial.printf("[CONFIG] Dwell medium: %u min\n", g_dwellMediumThreshold);
-    }
+    char httpHeader[320];
+    int headerLen = snprintf(httpHeader, sizeof(httpHeader),
+        "POST %s?d=%s&raw=%lu&total=%lu HTTP/1.1\r\n"
+        "Host: %s:%d\r\n"
+        "Authorization: Bearer %s\r\n"
+        "Content-Type: application/octet-stream\r\n"
+        "Content-Length: %u\r\n"
+        "Connection: close\r\n"
+        "\r\n",
+        LOG_UPLOAD_PATH, DEVICE_ID, rawLen, historyTotal,
+        BACKEND_HOST, BACKEND_PORT, AUTH_TOKEN, (unsigned)bodyLen);
 
-    ptr = strstr(jsonBody, "\"dwell_long_threshold\":");
-    if (ptr) {
-        ptr += 23;
-        g_dwellLongThreshold = (uint8_t)atoi(ptr);
-        Serial.printf("[CONFIG] Dwell long: %u min\n", g_dwellLongThreshold);
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "AT+CIPOPEN=0,\"TCP\",\"%s\",%d", BACKEND_HOST, BACKEND_PORT);
+    if (!atSendCommand(cmd, "+CIPOPEN: 0,0", TCP_CONNECT_TIMEOUT_MS)) {
+        LOGW("[LOGS] TCP connect failed\n");
+    } else {
+        // Header and body go out through the same chunked sink
+        g_logSendLen = 0;
+        g_logSendOk = true;
+        logSendSink((const uint8_t*)httpHeader, headerLen);
+        lzssCompressHistory(start, rawLen, logSendSink);
+        logSendFlush();
+
+        if (g_logSendOk) {
+            delay(2000);
+            atClearBuffer();
+            uint32_t readStart = millis();
+            while ((millis() - readStart) < 5000) {
+                while (modemAvailable() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
+                    g_atBuffer[g_atBufferLen++] = modemRead();
+                }
+                delay(100);
+            }
+            g_atBuffer[g_atBufferLen] = '\0';
+            success = httpResponseOk(g_atBuffer);
+        } else {
+            LOGW("[LOGS] Send failed mid-body\n");
+        }
     }
+    atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
 
-    Serial.println("[CONFIG] Configuration applied successfully");
-    return true;
+    g_logHistoryFrozen = false;
+    LOGI("[LOGS] Upload %s\n", success ? "complete" : "failed");
+    return success;
 }
 
 // =============================================================================
@@ -1890,20 +5382,21 @@ static int base64_decode(const char* input, size_t inputLen, uint8_t* output, si
 static bool initSpiffs() {
     if (g_spiffsReady) return true;
 
-    Serial.println("[OTA-DELTA] Initializing SPIFFS...");
+    LOGI("[OTA-DELTA] Initializing SPIFFS...\n");
     if (!SPIFFS.begin(true)) {  // true = format if mount fails
-        Serial.println("[OTA-DELTA] SPIFFS mount failed!");
+        LOGE("[OTA-DELTA] SPIFFS mount failed!\n");
         return false;
     }
 
     g_spiffsReady = true;
-    Serial.printf("[OTA-DELTA] SPIFFS mounted. Total: %u, Used: %u\n",
+    LOGI("[OTA-DELTA] SPIFFS mounted. Total: %u, Used: %u\n",
                   SPIFFS.totalBytes(), SPIFFS.usedBytes());
     return true;
 }
 
 // Save OTA state to NVS for crash recovery
 static void otaSaveState() {
+    g_otaNvsWrites++;
     g_otaNvs.begin(OTA_NVS_NAMESPACE, false);
     g_otaNvs.putUChar("state", (uint8_t)g_otaDelta.state);
     g_otaNvs.putString("target_ver", g_otaDelta.targetVersion);
@@ -1912,9 +5405,13 @@ static void otaSaveState() {
     g_otaNvs.putUShort("total_chunks", g_otaDelta.totalChunks);
     g_otaNvs.putUShort("chunks_rcvd", g_otaDelta.chunksReceived);
     g_otaNvs.putString("sha256", g_otaDelta.patchSha256);
+    g_otaNvs.putBytes("bitmap", g_otaProgress.bitmap, otaBitmapBytes(g_otaDelta.totalChunks));
+    g_otaNvs.putUInt("nvs_writes", g_otaNvsWrites);
     g_otaNvs.end();
-    Serial.printf("[OTA-DELTA] State saved: state=%d, chunks=%d/%d\n",
-                  g_otaDelta.state, g_otaDelta.chunksReceived, g_otaDelta.totalChunks);
+    otaProgressCheckpointed(&g_otaProgress, millis());
+    LOGI("[OTA-DELTA] State saved: state=%d, chunks=%d/%d, writes=%lu\n",
+                  g_otaDelta.state, g_otaDelta.chunksReceived, g_otaDelta.totalChunks,
+                  g_otaNvsWrites);
 }
 
 // Load OTA state from NVS (for recovery after crash/reboot)
@@ -1935,10 +5432,19 @@ static void otaLoadState() {
     String sha256 = g_otaNvs.getString("sha256", "");
     strncpy(g_otaDelta.patchSha256, sha256.c_str(), sizeof(g_otaDelta.patchSha256) - 1);
 
+    memset(g_otaProgress.bitmap, 0, sizeof(g_otaProgress.bitmap));
+    if (g_otaDelta.totalChunks <= OTA_MAX_CHUNKS) {
+        g_otaNvs.getBytes("bitmap", g_otaProgress.bitmap, otaBitmapBytes(g_otaDelta.totalChunks));
+    }
+    g_otaNvsWrites = g_otaNvs.getUInt("nvs_writes", 0);
+
     g_otaNvs.end();
 
+    // The bitmap is authoritative for what is on SPIFFS
+    g_otaDelta.chunksReceived = otaProgressResume(&g_otaProgress, g_otaDelta.totalChunks, millis());
+
     if (g_otaDelta.state != OTA_DELTA_IDLE) {
-        Serial.printf("[OTA-DELTA] Recovered state: state=%d, target=%s, chunks=%d/%d\n",
+        LOGI("[OTA-DELTA] Recovered state: state=%d, target=%s, chunks=%d/%d\n",
                       g_otaDelta.state, g_otaDelta.targetVersion,
                       g_otaDelta.chunksReceived, g_otaDelta.totalChunks);
     }
@@ -1952,21 +5458,23 @@ static void otaClearState() {
 
     memset(&g_otaDelta, 0, sizeof(g_otaDelta));
     g_otaDelta.state = OTA_DELTA_IDLE;
+    otaProgressClear(&g_otaProgress, millis());
+    g_otaNvsWrites = 0;
 
     // Remove patch file if exists
     if (g_spiffsReady && SPIFFS.exists(OTA_PATCH_FILE)) {
         SPIFFS.remove(OTA_PATCH_FILE);
-        Serial.println("[OTA-DELTA] Removed old patch file");
+        LOGI("[OTA-DELTA] Removed old patch file\n");
     }
 
-    Serial.println("[OTA-DELTA] State cleared");
+    LOGI("[OTA-DELTA] State cleared\n");
 }
 
 // Check for OTA update availability
 // POST /api/ota/check {"device_id":"JBNB0001","fw_version":"4.6"}
 // Response: {"update_available":true,"target":"4.7","patch_size":18432,"chunk_count":36,"sha256":"abc..."}
 static bool otaCheckForUpdate() {
-    Serial.printf("[OTA-DELTA] Checking for updates (current: v%s)...\n", FIRMWARE_VERSION);
+    LOGI("[OTA-DELTA] Checking for updates (current: v%s)...\n", FIRMWARE_VERSION);
 
     // Build JSON payload
     char jsonPayload[128];
@@ -1996,7 +5504,7 @@ static bool otaCheckForUpdate() {
              "AT+CIPOPEN=0,\"TCP\",\"%s\",%d", BACKEND_HOST, BACKEND_PORT);
 
     if (!atSendCommand(tcpOpenCmd, "+CIPOPEN: 0,0", TCP_CONNECT_TIMEOUT_MS)) {
-        Serial.println("[OTA-DELTA] TCP connect failed");
+        LOGW("[OTA-DELTA] TCP connect failed\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
@@ -2008,7 +5516,7 @@ static bool otaCheckForUpdate() {
     snprintf(sendCmd, sizeof(sendCmd), "AT+CIPSEND=0,%d", httpLen);
 
     if (!atSendCommand(sendCmd, ">", AT_COMMAND_TIMEOUT_MS)) {
-        Serial.println("[OTA-DELTA] CIPSEND prompt failed");
+        LOGW("[OTA-DELTA] CIPSEND prompt failed\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
@@ -2016,7 +5524,7 @@ static bool otaCheckForUpdate() {
     atSendRaw(httpRequest, httpLen);
 
     if (!atWaitFor("+CIPSEND:", 15000)) {
-        Serial.println("[OTA-DELTA] Send confirmation timeout");
+        LOGW("[OTA-DELTA] Send confirmation timeout\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
@@ -2027,8 +5535,8 @@ static bool otaCheckForUpdate() {
     atClearBuffer();
     uint32_t readStart = millis();
     while ((millis() - readStart) < 5000) {
-        while (ModemSerial.available() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
-            char c = ModemSerial.read();
+        while (modemAvailable() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
+            char c = modemRead();
             g_atBuffer[g_atBufferLen++] = c;
         }
         delay(100);
@@ -2038,8 +5546,8 @@ static bool otaCheckForUpdate() {
     atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
 
     // Check HTTP status
-    if (!strstr(g_atBuffer, "200")) {
-        Serial.println("[OTA-DELTA] Check request failed (not 200)");
+    if (httpStatusCode(g_atBuffer) != 200) {
+        LOGW("[OTA-DELTA] Check request failed (not 200)\n");
         return false;
     }
 
@@ -2047,27 +5555,27 @@ static bool otaCheckForUpdate() {
     char* jsonBody = strstr(g_atBuffer, "\r\n\r\n");
     if (!jsonBody) jsonBody = strstr(g_atBuffer, "{");
     if (!jsonBody) {
-        Serial.println("[OTA-DELTA] No JSON body in response");
+        LOGW("[OTA-DELTA] No JSON body in response\n");
         return false;
     }
 
     // Check if update is available
     if (!strstr(jsonBody, "\"update_available\":true") &&
         !strstr(jsonBody, "\"update_available\": true")) {
-        Serial.println("[OTA-DELTA] No update available");
+        LOGI("[OTA-DELTA] No update available\n");
         return false;
     }
 
     // Parse target version
     char* targetStart = strstr(jsonBody, "\"target\":\"");
     if (!targetStart) {
-        Serial.println("[OTA-DELTA] Missing target version");
+        LOGW("[OTA-DELTA] Missing target version\n");
         return false;
     }
     targetStart += 10;
     char* targetEnd = strchr(targetStart, '"');
     if (!targetEnd || (targetEnd - targetStart) >= (int)sizeof(g_otaDelta.targetVersion)) {
-        Serial.println("[OTA-DELTA] Invalid target version");
+        LOGW("[OTA-DELTA] Invalid target version\n");
         return false;
     }
     memcpy(g_otaDelta.targetVersion, targetStart, targetEnd - targetStart);
@@ -2084,6 +5592,11 @@ static bool otaCheckForUpdate() {
     if (chunkStart) {
         g_otaDelta.totalChunks = atoi(chunkStart + 14);
     }
+    if (g_otaDelta.totalChunks == 0 || g_otaDelta.totalChunks > OTA_MAX_CHUNKS) {
+        LOGW("[OTA-DELTA] Unsupported chunk count %d (max %d)\n",
+             g_otaDelta.totalChunks, OTA_MAX_CHUNKS);
+        return false;
+    }
 
     // Parse sha256
     char* shaStart = strstr(jsonBody, "\"sha256\":\"");
@@ -2099,11 +5612,11 @@ static bool otaCheckForUpdate() {
     // Store current version
     strncpy(g_otaDelta.currentVersion, FIRMWARE_VERSION, sizeof(g_otaDelta.currentVersion) - 1);
 
-    Serial.printf("[OTA-DELTA] Update available: v%s -> v%s\n",
+    LOGI("[OTA-DELTA] Update available: v%s -> v%s\n",
                   FIRMWARE_VERSION, g_otaDelta.targetVersion);
-    Serial.printf("[OTA-DELTA]   Patch size: %lu bytes, %d chunks\n",
+    LOGI("[OTA-DELTA]   Patch size: %lu bytes, %d chunks\n",
                   g_otaDelta.patchSize, g_otaDelta.totalChunks);
-    Serial.printf("[OTA-DELTA]   SHA256: %.16s...\n", g_otaDelta.patchSha256);
+    LOGI("[OTA-DELTA]   SHA256: %.16s...\n", g_otaDelta.patchSha256);
 
     return true;
 }
@@ -2112,9 +5625,11 @@ static bool otaCheckForUpdate() {
 // GET /api/ota/chunk?device_id=JBNB0001&from=4.6&to=4.7&chunk=N
 // Response: {"chunk":N,"data":"base64...","crc":1234,"final":false}
 static bool otaDownloadChunk(uint16_t chunkNum) {
-    Serial.printf("[OTA-DELTA] Downloading chunk %d/%d...\n",
+    LOGD("[OTA-DELTA] Downloading chunk %d/%d...\n",
                   chunkNum + 1, g_otaDelta.totalChunks);
 
+    g_otaChunkWireBytes = 0;
+
     // Build HTTP GET request with query parameters
     char httpRequest[384];
     int httpLen = snprintf(httpRequest, sizeof(httpRequest),
@@ -2127,59 +5642,66 @@ static bool otaDownloadChunk(uint16_t chunkNum) {
         g_otaDelta.targetVersion, chunkNum,
         BACKEND_HOST, BACKEND_PORT, AUTH_TOKEN);
 
-    // Open TCP connection
-    char tcpOpenCmd[128];
-    snprintf(tcpOpenCmd, sizeof(tcpOpenCmd),
-             "AT+CIPOPEN=0,\"TCP\",\"%s\",%d", BACKEND_HOST, BACKEND_PORT);
-
-    if (!atSendCommand(tcpOpenCmd, "+CIPOPEN: 0,0", TCP_CONNECT_TIMEOUT_MS)) {
-        Serial.println("[OTA-DELTA] TCP connect failed");
-        atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
+    // Phase 1: open the OTA link and send the request (modem held briefly)
+    if (!modemAcquire("ota-chunk", OTA_MODEM_WAIT_MS)) return false;
+    uint32_t holdStart = millis();
+    uint32_t reportOpens = g_links[MODEM_LINK_REPORT].openCount;
+    bool overlapped = g_links[MODEM_LINK_REPORT].busy;
+    if (!modemLinkOpen(MODEM_LINK_OTA)) {
+        g_otaChunkModemMs = millis() - holdStart;
+        modemRelease();
         return false;
     }
-
-    delay(300);
-
-    // Send request
-    char sendCmd[32];
-    snprintf(sendCmd, sizeof(sendCmd), "AT+CIPSEND=0,%d", httpLen);
-
-    if (!atSendCommand(sendCmd, ">", AT_COMMAND_TIMEOUT_MS)) {
-        Serial.println("[OTA-DELTA] CIPSEND prompt failed");
-        atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
+    if (!modemLinkSend(MODEM_LINK_OTA, httpRequest, httpLen)) {
+        modemLinkClose(MODEM_LINK_OTA);
+        g_otaChunkModemMs = millis() - holdStart;
+        modemRelease();
         return false;
     }
-
-    atSendRaw(httpRequest, httpLen);
-
-    if (!atWaitFor("+CIPSEND:", 15000)) {
-        Serial.println("[OTA-DELTA] Send confirmation timeout");
-        atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
-        return false;
+    g_otaChunkModemMs = millis() - holdStart;
+    modemRelease();
+    uint32_t requestStart = holdStart;
+
+    // Phase 2: wait for the response with the modem free. Readings can use
+    // link 0 meanwhile; whichever task holds the modem pumps our data.
+    bool complete = false;
+    uint32_t waitStart = millis();
+    while (!complete && (millis() - waitStart) < OTA_CHUNK_RESPONSE_MS) {
+        vTaskDelay(pdMS_TO_TICKS(OTA_CHUNK_POLL_MS));
+        if (!modemAcquire("ota-rx", OTA_MODEM_WAIT_MS)) break;
+        modemPump();
+        complete = modemLinkResponseComplete(MODEM_LINK_OTA);
+        modemRelease();
+    }
+
+    // Phase 3: close the link
+    if (modemAcquire("ota-close", OTA_MODEM_WAIT_MS)) {
+        uint32_t closeStart = millis();
+        modemPump();
+        modemLinkClose(MODEM_LINK_OTA);
+        g_otaChunkModemMs += millis() - closeStart;
+        modemRelease();
+    } else {
+        g_links[MODEM_LINK_OTA].busy = false;
     }
 
-    // Wait for response (chunks can take a moment)
-    delay(2000);
+    if (g_links[MODEM_LINK_REPORT].openCount != reportOpens || g_links[MODEM_LINK_REPORT].busy) {
+        overlapped = true;
+    }
+    latencyRecord(LATENCY_OTA_CHUNK, overlapped, millis() - requestStart);
 
-    // Use a larger buffer for chunk data (base64 encoded 512 bytes = ~700 chars)
-    static char chunkBuffer[1024];
-    size_t chunkBufLen = 0;
+    char* chunkBuffer = g_links[MODEM_LINK_OTA].rx;
+    size_t chunkBufLen = g_links[MODEM_LINK_OTA].rxLen;
+    g_otaChunkWireBytes = httpLen + chunkBufLen;
 
-    uint32_t readStart = millis();
-    while ((millis() - readStart) < 8000 && chunkBufLen < sizeof(chunkBuffer) - 1) {
-        while (ModemSerial.available() && chunkBufLen < sizeof(chunkBuffer) - 1) {
-            char c = ModemSerial.read();
-            chunkBuffer[chunkBufLen++] = c;
-        }
-        delay(50);
+    if (g_links[MODEM_LINK_OTA].rxOverflow) {
+        LOGW("[OTA-DELTA] Chunk response overflowed link buffer\n");
+        return false;
     }
-    chunkBuffer[chunkBufLen] = '\0';
-
-    atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
 
     // Check HTTP status
-    if (!strstr(chunkBuffer, "200")) {
-        Serial.println("[OTA-DELTA] Chunk request failed (not 200)");
+    if (httpStatusCode(chunkBuffer) != 200) {
+        LOGW("[OTA-DELTA] Chunk request failed (not 200)\n");
         return false;
     }
 
@@ -2187,26 +5709,26 @@ static bool otaDownloadChunk(uint16_t chunkNum) {
     char* jsonBody = strstr(chunkBuffer, "\r\n\r\n");
     if (!jsonBody) jsonBody = strstr(chunkBuffer, "{");
     if (!jsonBody) {
-        Serial.println("[OTA-DELTA] No JSON body in chunk response");
+        LOGW("[OTA-DELTA] No JSON body in chunk response\n");
         return false;
     }
 
     // Parse chunk number (verify it matches)
     char* chunkNumStart = strstr(jsonBody, "\"chunk\":");
     if (!chunkNumStart) {
-        Serial.println("[OTA-DELTA] Missing chunk number in response");
+        LOGW("[OTA-DELTA] Missing chunk number in response\n");
         return false;
     }
     int receivedChunk = atoi(chunkNumStart + 8);
     if (receivedChunk != chunkNum) {
-        Serial.printf("[OTA-DELTA] Chunk mismatch: expected %d, got %d\n", chunkNum, receivedChunk);
+        LOGW("[OTA-DELTA] Chunk mismatch: expected %d, got %d\n", chunkNum, receivedChunk);
         return false;
     }
 
     // Parse CRC
     char* crcStart = strstr(jsonBody, "\"crc\":");
     if (!crcStart) {
-        Serial.println("[OTA-DELTA] Missing CRC in response");
+        LOGW("[OTA-DELTA] Missing CRC in response\n");
         return false;
     }
     uint16_t expectedCrc = (uint16_t)atoi(crcStart + 6);
@@ -2214,13 +5736,13 @@ static bool otaDownloadChunk(uint16_t chunkNum) {
     // Parse base64 data
     char* dataStart = strstr(jsonBody, "\"data\":\"");
     if (!dataStart) {
-        Serial.println("[OTA-DELTA] Missing data in response");
+        LOGW("[OTA-DELTA] Missing data in response\n");
         return false;
     }
     dataStart += 8;
     char* dataEnd = strchr(dataStart, '"');
     if (!dataEnd) {
-        Serial.println("[OTA-DELTA] Malformed data field");
+        LOGW("[OTA-DELTA] Malformed data field\n");
         return false;
     }
 
@@ -2230,45 +5752,55 @@ static bool otaDownloadChunk(uint16_t chunkNum) {
     static uint8_t decodedData[OTA_CHUNK_SIZE + 16];  // Small buffer for one chunk
     int decodedLen = base64_decode(dataStart, b64Len, decodedData, sizeof(decodedData));
     if (decodedLen < 0) {
-        Serial.println("[OTA-DELTA] Base64 decode failed");
+        LOGW("[OTA-DELTA] Base64 decode failed\n");
         return false;
     }
 
     // Verify CRC
     uint16_t calculatedCrc = crc16_ccitt(decodedData, decodedLen);
     if (calculatedCrc != expectedCrc) {
-        Serial.printf("[OTA-DELTA] CRC mismatch: expected 0x%04X, got 0x%04X\n",
+        LOGW("[OTA-DELTA] CRC mismatch: expected 0x%04X, got 0x%04X\n",
                       expectedCrc, calculatedCrc);
         return false;
     }
 
-    // Append to patch file
-    File patchFile = SPIFFS.open(OTA_PATCH_FILE, chunkNum == 0 ? "w" : "a");
+    // Every chunk but the last is exactly OTA_CHUNK_SIZE, so chunks can be
+    // written in place - a re-fetched chunk after a resume just overwrites
+    bool lastChunk = (chunkNum + 1 == g_otaDelta.totalChunks);
+    if (decodedLen > OTA_CHUNK_SIZE || (!lastChunk && decodedLen != OTA_CHUNK_SIZE)) {
+        LOGW("[OTA-DELTA] Unexpected chunk length %d\n", decodedLen);
+        return false;
+    }
+
+    File patchFile = SPIFFS.open(OTA_PATCH_FILE, SPIFFS.exists(OTA_PATCH_FILE) ? "r+" : "w");
     if (!patchFile) {
-        Serial.println("[OTA-DELTA] Failed to open patch file");
+        LOGW("[OTA-DELTA] Failed to open patch file\n");
         return false;
     }
 
-    size_t written = patchFile.write(decodedData, decodedLen);
+    size_t written = 0;
+    if (patchFile.seek((uint32_t)chunkNum * OTA_CHUNK_SIZE)) {
+        written = patchFile.write(decodedData, decodedLen);
+    }
     patchFile.close();
 
     if (written != (size_t)decodedLen) {
-        Serial.printf("[OTA-DELTA] Write failed: %d/%d bytes\n", written, decodedLen);
+        LOGW("[OTA-DELTA] Write failed: %d/%d bytes\n", written, decodedLen);
         return false;
     }
 
-    Serial.printf("[OTA-DELTA] Chunk %d: %d bytes, CRC OK\n", chunkNum, decodedLen);
+    LOGI("[OTA-DELTA] Chunk %d: %d bytes, CRC OK\n", chunkNum, decodedLen);
 
     return true;
 }
 
 // Verify the complete patch file SHA256
 static bool otaVerifyPatch() {
-    Serial.println("[OTA-DELTA] Verifying patch SHA256...");
+    LOGI("[OTA-DELTA] Verifying patch SHA256...\n");
 
     File patchFile = SPIFFS.open(OTA_PATCH_FILE, "r");
     if (!patchFile) {
-        Serial.println("[OTA-DELTA] Cannot open patch file for verification");
+        LOGW("[OTA-DELTA] Cannot open patch file for verification\n");
         return false;
     }
 
@@ -2298,29 +5830,31 @@ static bool otaVerifyPatch() {
     }
     hashHex[64] = '\0';
 
-    Serial.printf("[OTA-DELTA] Patch size: %zu bytes\n", totalRead);
-    Serial.printf("[OTA-DELTA] Calculated SHA256: %s\n", hashHex);
-    Serial.printf("[OTA-DELTA] Expected SHA256:   %s\n", g_otaDelta.patchSha256);
+    LOGI("[OTA-DELTA] Patch size: %zu bytes\n", totalRead);
+    LOGI("[OTA-DELTA] Calculated SHA256: %s\n", hashHex);
+    LOGI("[OTA-DELTA] Expected SHA256:   %s\n", g_otaDelta.patchSha256);
 
     // Compare (case-insensitive)
     if (strcasecmp(hashHex, g_otaDelta.patchSha256) != 0) {
-        Serial.println("[OTA-DELTA] SHA256 MISMATCH - patch corrupted!");
+        LOGE("[OTA-DELTA] SHA256 MISMATCH - patch corrupted!\n");
         return false;
     }
 
-    Serial.println("[OTA-DELTA] SHA256 verified OK");
+    LOGI("[OTA-DELTA] SHA256 verified OK\n");
     return true;
 }
 
 // Report OTA completion status to backend
 // POST /api/ota/complete {"device_id":"JBNB0001","fw_version":"4.7","status":"success"}
 static void otaReportComplete(const char* status) {
-    Serial.printf("[OTA-DELTA] Reporting completion: %s\n", status);
+    LOGI("[OTA-DELTA] Reporting completion: %s\n", status);
 
-    char jsonPayload[128];
+    // nvs_writes: state commits this update took (progress checkpoint cost)
+    char jsonPayload[160];
     snprintf(jsonPayload, sizeof(jsonPayload),
-             "{\"device_id\":\"%s\",\"fw_version\":\"%s\",\"status\":\"%s\"}",
-             DEVICE_ID, g_otaDelta.targetVersion, status);
+             "{\"device_id\":\"%s\",\"fw_version\":\"%s\",\"status\":\"%s\","
+             "\"nvs_writes\":%lu}",
+             DEVICE_ID, g_otaDelta.targetVersion, status, g_otaNvsWrites);
 
     size_t jsonLen = strlen(jsonPayload);
 
@@ -2341,8 +5875,11 @@ static void otaReportComplete(const char* status) {
     snprintf(tcpOpenCmd, sizeof(tcpOpenCmd),
              "AT+CIPOPEN=0,\"TCP\",\"%s\",%d", BACKEND_HOST, BACKEND_PORT);
 
+    if (!modemAcquire("ota-report", OTA_MODEM_WAIT_MS)) return;
+
     if (!atSendCommand(tcpOpenCmd, "+CIPOPEN: 0,0", TCP_CONNECT_TIMEOUT_MS)) {
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
+        modemRelease();
         return;
     }
 
@@ -2358,37 +5895,38 @@ static void otaReportComplete(const char* status) {
     }
 
     atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
+    modemRelease();
 }
 
 // Apply the delta patch to create new firmware
 // This is a simplified approach - for full bsdiff support, use esp_delta_ota component
 // For now, we'll implement a direct binary patch application
 static bool otaApplyPatch() {
-    Serial.println("[OTA-DELTA] Applying patch...");
+    LOGI("[OTA-DELTA] Applying patch...\n");
 
     // Get the running partition and next OTA partition
     const esp_partition_t* running = esp_ota_get_running_partition();
     const esp_partition_t* update = esp_ota_get_next_update_partition(NULL);
 
     if (!running || !update) {
-        Serial.println("[OTA-DELTA] Cannot get partition info");
+        LOGW("[OTA-DELTA] Cannot get partition info\n");
         return false;
     }
 
-    Serial.printf("[OTA-DELTA] Running partition: %s at 0x%08lx\n",
+    LOGI("[OTA-DELTA] Running partition: %s at 0x%08lx\n",
                   running->label, running->address);
-    Serial.printf("[OTA-DELTA] Update partition: %s at 0x%08lx\n",
+    LOGI("[OTA-DELTA] Update partition: %s at 0x%08lx\n",
                   update->label, update->address);
 
     // Open patch file
     File patchFile = SPIFFS.open(OTA_PATCH_FILE, "r");
     if (!patchFile) {
-        Serial.println("[OTA-DELTA] Cannot open patch file");
+        LOGW("[OTA-DELTA] Cannot open patch file\n");
         return false;
     }
 
     size_t patchSize = patchFile.size();
-    Serial.printf("[OTA-DELTA] Patch file size: %zu bytes\n", patchSize);
+    LOGI("[OTA-DELTA] Patch file size: %zu bytes\n", patchSize);
 
     // Note: For a true delta update, we would need to:
     // 1. Read the current firmware from running partition
@@ -2407,7 +5945,7 @@ static bool otaApplyPatch() {
     esp_ota_handle_t ota_handle;
     esp_err_t err = esp_ota_begin(update, patchSize, &ota_handle);
     if (err != ESP_OK) {
-        Serial.printf("[OTA-DELTA] esp_ota_begin failed: 0x%x\n", err);
+        LOGW("[OTA-DELTA] esp_ota_begin failed: 0x%x\n", err);
         patchFile.close();
         return false;
     }
@@ -2421,7 +5959,7 @@ static bool otaApplyPatch() {
 
         err = esp_ota_write(ota_handle, writeBuf, bytesRead);
         if (err != ESP_OK) {
-            Serial.printf("[OTA-DELTA] esp_ota_write failed at %zu: 0x%x\n", totalWritten, err);
+            LOGW("[OTA-DELTA] esp_ota_write failed at %zu: 0x%x\n", totalWritten, err);
             esp_ota_abort(ota_handle);
             patchFile.close();
             return false;
@@ -2431,7 +5969,7 @@ static bool otaApplyPatch() {
 
         // Progress indicator every 10KB
         if (totalWritten % 10240 < 1024) {
-            Serial.printf("[OTA-DELTA] Written: %zu / %zu bytes\n", totalWritten, patchSize);
+            LOGD("[OTA-DELTA] Written: %zu / %zu bytes\n", totalWritten, patchSize);
         }
 
         // Feed watchdog during long write
@@ -2440,36 +5978,60 @@ static bool otaApplyPatch() {
 
     patchFile.close();
 
-    Serial.printf("[OTA-DELTA] Total written: %zu bytes\n", totalWritten);
+    LOGI("[OTA-DELTA] Total written: %zu bytes\n", totalWritten);
 
     // Finalize OTA update
     err = esp_ota_end(ota_handle);
     if (err != ESP_OK) {
-        Serial.printf("[OTA-DELTA] esp_ota_end failed: 0x%x\n", err);
+        LOGW("[OTA-DELTA] esp_ota_end failed: 0x%x\n", err);
         return false;
     }
 
     // Set boot partition
     err = esp_ota_set_boot_partition(update);
     if (err != ESP_OK) {
-        Serial.printf("[OTA-DELTA] esp_ota_set_boot_partition failed: 0x%x\n", err);
+        LOGW("[OTA-DELTA] esp_ota_set_boot_partition failed: 0x%x\n", err);
         return false;
     }
 
-    Serial.println("[OTA-DELTA] Patch applied successfully");
-    Serial.printf("[OTA-DELTA] Next boot will use partition: %s\n", update->label);
+    LOGI("[OTA-DELTA] Patch applied successfully\n");
+    LOGI("[OTA-DELTA] Next boot will use partition: %s\n", update->label);
 
     return true;
 }
 
-// Non-blocking OTA background handler - call from main loop
-// Processes one step per call to avoid blocking probe capture
-static void handleOtaDeltaBackground() {
+// True when a reading is due soon - OTA yields so the uplink finds the modem free
+static bool otaUplinkImminent() {
+    if (g_forceSendRequested) return true;
+    uint32_t sinceReport = millis() - g_lastReportTime;
+    return sinceReport + OTA_UPLINK_GUARD_MS >= reportIntervalMs();
+}
+
+// Milliseconds until the hourly budget allows another chunk, 0 = go ahead
+static uint32_t otaBudgetWaitMs() {
+    uint32_t now = millis();
+    uint32_t elapsed = now - g_otaBudgetWindowStart;
+    if (g_otaBudgetWindowStart == 0 || elapsed >= 3600000UL) {
+        g_otaBudgetWindowStart = now | 1;
+        g_otaBudgetBytes = 0;
+        g_otaBudgetModemMs = 0;
+        return 0;
+    }
+    if (g_otaBudgetBytes >= OTA_BUDGET_BYTES_PER_HOUR ||
+        g_otaBudgetModemMs >= OTA_BUDGET_MODEM_MS_PER_HOUR) {
+        return 3600000UL - elapsed;
+    }
+    return 0;
+}
+
+// Run one step of the delta OTA state machine (OTA task context).
+// Returns how long the task should sleep before the next step.
+static uint32_t handleOtaDeltaStep() {
     // Skip if WiFi AP OTA is in progress
-    if (g_otaInProgress) return;
+    if (g_otaInProgress) return OTA_IDLE_POLL_MS;
 
-    // Skip if network not ready
-    if (!g_networkReady) return;
+    // Skip if network not ready (a flashed image reboots regardless)
+    if (!g_networkReady && g_otaDelta.state != OTA_DELTA_REBOOTING) return OTA_IDLE_POLL_MS;
 
     switch (g_otaDelta.state) {
         case OTA_DELTA_IDLE:
@@ -2478,28 +6040,40 @@ static void handleOtaDeltaBackground() {
                 g_otaDelta.checkPending = false;
                 g_otaDelta.state = OTA_DELTA_CHECKING;
                 ledSetStatus(LED_STATUS_TRANSMITTING);  // CYAN during check
-                Serial.println("[OTA-DELTA] Starting update check...");
+                LOGI("[OTA-DELTA] Starting update check...\n");
+                return 0;
             }
-            break;
+            return OTA_IDLE_POLL_MS;
+
+        case OTA_DELTA_CHECKING: {
+            if (otaUplinkImminent()) return OTA_IDLE_POLL_MS;
+            if (!modemAcquire("ota-check", OTA_MODEM_WAIT_MS)) return OTA_IDLE_POLL_MS;
+            bool available = otaCheckForUpdate();
+            modemRelease();
 
-        case OTA_DELTA_CHECKING:
-            // Perform update check
-            if (otaCheckForUpdate()) {
+            if (available) {
                 // Update available - initialize download
                 if (!initSpiffs()) {
-                    Serial.println("[OTA-DELTA] SPIFFS init failed, aborting");
+                    LOGW("[OTA-DELTA] SPIFFS init failed, aborting\n");
                     otaClearState();
                     ledSetStatus(LED_STATUS_CONNECTED);
                     break;
                 }
 
+                // Fresh download - drop any stale patch file and progress
+                if (SPIFFS.exists(OTA_PATCH_FILE)) {
+                    SPIFFS.remove(OTA_PATCH_FILE);
+                }
+                otaProgressClear(&g_otaProgress, millis());
+                g_otaNvsWrites = 0;
+
                 g_otaDelta.chunksReceived = 0;
                 g_otaDelta.chunkRetries = 0;
                 g_otaDelta.lastChunkTime = millis();
                 g_otaDelta.state = OTA_DELTA_DOWNLOADING;
                 otaSaveState();
 
-                Serial.println("[OTA-DELTA] Starting download...");
+                LOGI("[OTA-DELTA] Starting download...\n");
                 ledSetStatus(LED_STATUS_TRANSMITTING);  // CYAN pulse during download
             } else {
                 // No update or check failed
@@ -2507,53 +6081,86 @@ static void handleOtaDeltaBackground() {
                 ledSetStatus(LED_STATUS_CONNECTED);
             }
             break;
+        }
 
         case OTA_DELTA_DOWNLOADING:
-            // Download one chunk per loop iteration (non-blocking)
+            // Download one chunk per step, within the hourly budget
             if (g_otaDelta.chunksReceived < g_otaDelta.totalChunks) {
-                if (otaDownloadChunk(g_otaDelta.chunksReceived)) {
-                    // Success - move to next chunk
+                if (otaUplinkImminent()) return OTA_IDLE_POLL_MS;
+
+                // Projected over the data budget - the image can wait for next month
+                if (g_governorLevel >= GOV_SAVE) {
+                    static uint32_t lastGovernorLog = 0;
+                    if (lastGovernorLog == 0 || (millis() - lastGovernorLog) >= 3600000) {
+                        lastGovernorLog = millis() | 1;
+                        LOGI("[OTA-DELTA] Deferred by data budget governor (level %u)\n",
+                             g_governorLevel);
+                    }
+                    return 60000;
+                }
+
+                uint32_t budgetWait = otaBudgetWaitMs();
+                if (budgetWait > 0) {
+                    static uint32_t lastBudgetLog = 0;
+                    if (lastBudgetLog == 0 || (millis() - lastBudgetLog) >= 600000) {
+                        lastBudgetLog = millis() | 1;
+                        LOGI("[OTA-DELTA] Hourly budget used (%lu bytes, %lu ms modem), "
+                             "resuming in %lu s\n",
+                             g_otaBudgetBytes, g_otaBudgetModemMs, budgetWait / 1000);
+                    }
+                    return budgetWait < 60000 ? budgetWait : 60000;
+                }
+
+                // otaDownloadChunk() takes the modem only for open/send/close
+                uint16_t chunk = otaProgressNext(&g_otaProgress, g_otaDelta.totalChunks);
+                bool ok = otaDownloadChunk(chunk);
+                g_otaBudgetModemMs += g_otaChunkModemMs;
+                g_otaBudgetBytes += g_otaChunkWireBytes;
+
+                if (ok) {
+                    // Success - move to next chunk (NVS commit is batched)
                     g_otaDelta.chunksReceived++;
                     g_otaDelta.chunkRetries = 0;
                     g_otaDelta.lastChunkTime = millis();
-                    otaSaveState();
+                    if (otaProgressMark(&g_otaProgress, chunk, millis())) {
+                        otaSaveState();
+                    }
 
                     // Brief LED flash to show progress
-                    ledSetColor(COLOR_GREEN);
-                    delay(50);
-                    ledSetColor(COLOR_CYAN);
+                    ledPulse(COLOR_GREEN, 50);
                 } else {
                     // Failed - retry or abort
                     g_otaDelta.chunkRetries++;
-                    Serial.printf("[OTA-DELTA] Chunk %d failed, retry %d/%d\n",
-                                  g_otaDelta.chunksReceived,
+                    LOGW("[OTA-DELTA] Chunk %d failed, retry %d/%d\n",
+                                  chunk,
                                   g_otaDelta.chunkRetries,
                                   OTA_MAX_CHUNK_RETRIES);
 
                     if (g_otaDelta.chunkRetries >= OTA_MAX_CHUNK_RETRIES) {
-                        Serial.println("[OTA-DELTA] Too many retries, aborting OTA");
+                        LOGW("[OTA-DELTA] Too many retries, aborting OTA\n");
                         otaReportComplete("failed_download");
                         otaClearState();
                         ledSetStatus(LED_STATUS_CONNECTED);
                     }
                 }
+                return OTA_CHUNK_GAP_MS;
             } else {
                 // All chunks downloaded - move to verification
-                Serial.println("[OTA-DELTA] Download complete, verifying...");
+                LOGI("[OTA-DELTA] Download complete, verifying...\n");
                 g_otaDelta.state = OTA_DELTA_VERIFYING;
                 otaSaveState();
             }
             break;
 
         case OTA_DELTA_VERIFYING:
-            // Verify the complete patch
+            // Verify the complete patch (SPIFFS only, no modem)
             if (otaVerifyPatch()) {
-                Serial.println("[OTA-DELTA] Verification passed, applying...");
+                LOGI("[OTA-DELTA] Verification passed, applying...\n");
                 g_otaDelta.state = OTA_DELTA_APPLYING;
                 otaSaveState();
                 ledSetStatus(LED_STATUS_OTA_MODE);  // YELLOW during apply
             } else {
-                Serial.println("[OTA-DELTA] Verification failed, aborting OTA");
+                LOGW("[OTA-DELTA] Verification failed, aborting OTA\n");
                 otaReportComplete("failed_verify");
                 otaClearState();
                 ledSetStatus(LED_STATUS_CONNECTED);
@@ -2561,12 +6168,10 @@ static void handleOtaDeltaBackground() {
             break;
 
         case OTA_DELTA_APPLYING:
-            // Apply the patch to OTA partition
-            // Disable watchdog during patch application (can take a while)
-            esp_task_wdt_delete(NULL);
-
+            // Apply the patch to OTA partition. Runs in this task, which feeds
+            // its own watchdog entry during the write - the loop keeps running.
             if (otaApplyPatch()) {
-                Serial.println("[OTA-DELTA] Patch applied successfully");
+                LOGI("[OTA-DELTA] Patch applied successfully\n");
                 g_otaDelta.state = OTA_DELTA_REBOOTING;
                 otaSaveState();
 
@@ -2575,35 +6180,54 @@ static void handleOtaDeltaBackground() {
 
                 // Clean up patch file
                 SPIFFS.remove(OTA_PATCH_FILE);
-
-                Serial.println("[OTA-DELTA] Rebooting to new firmware...");
-                delay(1000);
-                ESP.restart();
+                return 0;  // Reboot from OTA_DELTA_REBOOTING once the modem is free
             } else {
-                Serial.println("[OTA-DELTA] Patch application failed");
+                LOGW("[OTA-DELTA] Patch application failed\n");
                 otaReportComplete("failed_apply");
                 otaClearState();
-
-                // Re-enable watchdog
-                esp_task_wdt_add(NULL);
                 ledSetStatus(LED_STATUS_CONNECTED);
             }
             break;
 
         case OTA_DELTA_REBOOTING:
-            // Should not reach here - device reboots in APPLYING state
+            // Don't cut off a reading mid-transaction: reboot only while
+            // holding the modem, and keep waiting if an uplink has it
+            if (!modemAcquire("ota-reboot", OTA_MODEM_WAIT_MS)) {
+                LOGW("[OTA-DELTA] Modem busy, reboot deferred\n");
+                return OTA_IDLE_POLL_MS;
+            }
+            LOGI("[OTA-DELTA] Rebooting to new firmware...\n");
+            delay(1000);
+            logFlush(LOG_FLUSH_TIMEOUT_MS);
             ESP.restart();
             break;
     }
+    return 0;
+}
+
+// Delta OTA task - steps the state machine so downloads, verification and
+// flashing never block the loop's capture and reporting
+static void otaDeltaTask(void* arg) {
+    esp_task_wdt_add(NULL);
+    for (;;) {
+        esp_task_wdt_reset();
+        uint32_t waitMs = handleOtaDeltaStep();
+        vTaskDelay(pdMS_TO_TICKS(waitMs > 0 ? waitMs : 10));
+    }
+}
+
+static void otaDeltaTaskStart() {
+    xTaskCreatePinnedToCore(otaDeltaTask, "ota_delta", OTA_TASK_STACK, nullptr,
+                            OTA_TASK_PRIORITY, &g_otaTask, tskNO_AFFINITY);
 }
 
 // Trigger OTA check (called from command handling or after heartbeat)
 static void triggerOtaCheck() {
     if (g_otaDelta.state == OTA_DELTA_IDLE) {
         g_otaDelta.checkPending = true;
-        Serial.println("[OTA-DELTA] OTA check scheduled");
+        LOGI("[OTA-DELTA] OTA check scheduled\n");
     } else {
-        Serial.printf("[OTA-DELTA] OTA already in progress (state=%d)\n", g_otaDelta.state);
+        LOGI("[OTA-DELTA] OTA already in progress (state=%d)\n", g_otaDelta.state);
     }
 }
 
@@ -2691,6 +6315,7 @@ static void handleOtaUpdate() {
     } else {
         g_otaServer->send(200, "text/plain", "Update successful");
         delay(1000);
+        logFlush(LOG_FLUSH_TIMEOUT_MS);
         ESP.restart();
     }
 }
@@ -2699,7 +6324,7 @@ static void handleOtaUpload() {
     HTTPUpload& upload = g_otaServer->upload();
 
     if (upload.status == UPLOAD_FILE_START) {
-        Serial.printf("[OTA] Update start: %s\n", upload.filename.c_str());
+        LOGI("[OTA] Update start: %s\n", upload.filename.c_str());
         if (!Update.begin(UPDATE_SIZE_UNKNOWN)) {
             Update.printError(Serial);
         }
@@ -2709,7 +6334,7 @@ static void handleOtaUpload() {
         }
     } else if (upload.status == UPLOAD_FILE_END) {
         if (Update.end(true)) {
-            Serial.printf("[OTA] Update success: %u bytes\n", upload.totalSize);
+            LOGI("[OTA] Update success: %u bytes\n", upload.totalSize);
         } else {
             Update.printError(Serial);
         }
@@ -2717,16 +6342,20 @@ static void handleOtaUpload() {
 }
 
 static void startOtaMode() {
-    Serial.println("[OTA] Entering OTA update mode...");
+    LOGI("[OTA] Entering OTA update mode...\n");
     ledSetStatus(LED_STATUS_OTA_MODE);
     g_otaInProgress = true;
 
     // Disable watchdog during OTA (long operation)
     esp_task_wdt_delete(NULL);
-    Serial.println("[OTA] Watchdog disabled for OTA");
+    LOGI("[OTA] Watchdog disabled for OTA\n");
 
-    // Stop probe capture
-    stopProbeCapture();
+    // Stop probe and BLE capture, and the timers that would use the modem
+    radioCaptureStop();
+    timerStop(&g_reportTimer);
+    timerStop(&g_uplinkTimer);
+    timerStop(&g_heartbeatTimer);
+    timerStop(&g_statusTimer);
 
     // Stop WiFi promiscuous mode and switch to AP mode
     esp_wifi_set_promiscuous(false);
@@ -2734,21 +6363,25 @@ static void startOtaMode() {
     WiFi.softAP(OTA_AP_SSID, OTA_AP_PASSWORD);
 
     IPAddress ip = WiFi.softAPIP();
-    Serial.printf("[OTA] AP Started - SSID: %s, Password: %s\n", OTA_AP_SSID, OTA_AP_PASSWORD);
-    Serial.printf("[OTA] Connect and browse to http://%s\n", ip.toString().c_str());
+    LOGI("[OTA] AP Started - SSID: %s, Password: %s\n", OTA_AP_SSID, OTA_AP_PASSWORD);
+    LOGI("[OTA] Connect and browse to http://%s\n", ip.toString().c_str());
 
     // Start web server for OTA
     g_otaServer = new WebServer(80);
     g_otaServer->on("/", HTTP_GET, handleOtaRoot);
     g_otaServer->on("/update", HTTP_POST, handleOtaUpdate, handleOtaUpload);
     g_otaServer->begin();
+    timerStart(&g_otaServerTimer, 10, 10);
+    timerStart(&g_otaTimeoutTimer, OTA_TIMEOUT_MS, 0);
 
-    Serial.println("[OTA] Web server started. Waiting for firmware upload...");
+    LOGI("[OTA] Web server started. Waiting for firmware upload...\n");
 }
 
 static void stopOtaMode() {
-    Serial.println("[OTA] Exiting OTA mode...");
+    LOGI("[OTA] Exiting OTA mode...\n");
 
+    timerStop(&g_otaServerTimer);
+    timerStop(&g_otaTimeoutTimer);
     if (g_otaServer) {
         g_otaServer->stop();
         delete g_otaServer;
@@ -2761,10 +6394,11 @@ static void stopOtaMode() {
 
     // Re-enable watchdog timer
     esp_task_wdt_add(NULL);
-    Serial.println("[OTA] Watchdog re-enabled");
+    LOGI("[OTA] Watchdog re-enabled\n");
 
-    // Restart probe capture
-    startProbeCapture();
+    // Restart probe capture and the loop timers
+    radioCaptureStart();
+    loopTimersStart();
 
     // Restore network status LED
     if (g_networkReady) {
@@ -2778,218 +6412,206 @@ static void stopOtaMode() {
 // Reporting Logic
 // =============================================================================
 
-// Get current counts and reset
+// Get current counts and reset into a reading
 // overflowCount: combined WiFi+BLE overflow (indicates data quality issue)
-static void getAndResetCounts(uint32_t* impressions, uint32_t* unique,
-                               int* probeRssiAvg, int* probeRssiMin, int* probeRssiMax,
-                               uint32_t* dwell_0_1, uint32_t* dwell_1_5,
-                               uint32_t* dwell_5_10, uint32_t* dwell_10plus,
-                               uint32_t* rssi_immediate, uint32_t* rssi_near,
-                               uint32_t* rssi_far, uint32_t* rssi_remote,
-                               uint32_t* bleImpressions, uint32_t* bleUnique,
-                               uint32_t* bleApple, uint32_t* bleOther,
-                               int* bleRssiAvg, uint16_t* overflowCount) {
+static void getAndResetCounts(CachedReading* r) {
     // Get WiFi probe counts
+    CountSnapshot wifi;
     portENTER_CRITICAL(&g_probeMux);
-    *impressions = g_totalProbes;
-    *unique = g_uniqueMacCount;
-    uint16_t wifiOverflow = g_uniqueOverflow;  // Capture before reset
-    // Calculate probe RSSI stats
-    if (g_probeRssiCount > 0) {
-        *probeRssiAvg = g_probeRssiSum / (int32_t)g_probeRssiCount;
-        *probeRssiMin = g_probeRssiMin;
-        *probeRssiMax = g_probeRssiMax;
-    } else {
-        *probeRssiAvg = 0;
-        *probeRssiMin = 0;
-        *probeRssiMax = 0;
-    }
-    // Calculate dwell time buckets using parallel arrays
-    // For each MAC, calculate how many minutes they were seen (lastSeen - firstSeen + 1)
-    // Bucket thresholds are configurable via remote config
-    *dwell_0_1 = 0;
-    *dwell_1_5 = 0;
-    *dwell_5_10 = 0;
-    *dwell_10plus = 0;
-    for (uint16_t i = 0; i < g_dwellCount; i++) {
-        uint16_t firstMin = g_dwellFirstSeen[i];
-        uint16_t lastMin = g_dwellLastSeen[i];
-        // Handle minute wrap-around (unlikely in 5-min interval but safe)
-        int duration = (lastMin >= firstMin) ? (lastMin - firstMin + 1) : 1;
-        // Bucket the duration using configurable thresholds
-        if (duration <= g_dwellShortThreshold) {
-            (*dwell_0_1)++;      // Quick Glance
-        } else if (duration <= g_dwellMediumThreshold) {
-            (*dwell_1_5)++;      // Browsing
-        } else if (duration <= g_dwellLongThreshold) {
-            (*dwell_5_10)++;     // Shopping
-        } else {
-            (*dwell_10plus)++;   // Loyal Customer
-        }
-    }
-    // Copy RSSI zone counts
-    *rssi_immediate = g_rssi_immediate;
-    *rssi_near = g_rssi_near;
-    *rssi_far = g_rssi_far;
-    *rssi_remote = g_rssi_remote;
-    // Reset WiFi counters (fixed arrays - just reset counts, no deallocation)
-    g_totalProbes = 0;
+    anomalyOnCounterReset();
+    // Dwell buckets use the configurable thresholds (remote config)
+    g_wifiCounter.takeAndReset(&wifi);
     g_filteredStatic = 0;
-    g_probeRssiSum = 0;
-    g_probeRssiMin = 0;
-    g_probeRssiMax = -999;
-    g_probeRssiCount = 0;
-    g_rssi_immediate = 0;
-    g_rssi_near = 0;
-    g_rssi_far = 0;
-    g_rssi_remote = 0;
-    g_uniqueMacCount = 0;   // Reset array count (no heap ops)
     g_uniqueAPCount = 0;    // Reset array count (no heap ops)
-    g_dwellCount = 0;       // Reset dwell array count (no heap ops)
-    g_uniqueOverflow = 0;   // Reset overflow counter for next period
+    // Capture quality counters
+    for (uint8_t c = 0; c < WIFI_CHANNEL_COUNT; c++) {
+        r->rxMgmtSeen[c] = g_rxMgmtSeen[c];
+        r->rxMgmtProcessed[c] = g_rxMgmtProcessed[c];
+        g_rxMgmtSeen[c] = 0;
+        g_rxMgmtProcessed[c] = 0;
+    }
+    r->rxErrors = g_rxErrors;
+    r->rxCallbackMaxUs = g_rxCallbackMaxUs;
+    r->seqMissed = g_seqMissed;
+    g_rxErrors = 0;
+    g_rxCallbackMaxUs = 0;
+    g_seqMissed = 0;
+    // Rotation-corrected uniques - never above the raw count
+    r->uniqueCorrected = g_rotationUniques < wifi.unique ? g_rotationUniques : wifi.unique;
+    r->rotationsLinked = g_rotationsLinked;
+    rotationResetPeriod();
     portEXIT_CRITICAL(&g_probeMux);
 
-    // Get BLE counts (Apple vs Other)
+    r->impressions = wifi.impressions;
+    r->unique = wifi.unique;
+    r->probeRssiAvg = wifi.rssiAvg;
+    r->probeRssiMin = wifi.rssiMin;
+    r->probeRssiMax = wifi.rssiMax;
+    r->dwell_0_1 = wifi.dwell[0];
+    r->dwell_1_5 = wifi.dwell[1];
+    r->dwell_5_10 = wifi.dwell[2];
+    r->dwell_10plus = wifi.dwell[3];
+    r->rssi_immediate = wifi.zones[OCC_ZONE_IMMEDIATE];
+    r->rssi_near = wifi.zones[OCC_ZONE_NEAR];
+    r->rssi_far = wifi.zones[OCC_ZONE_FAR];
+    r->rssi_remote = wifi.zones[OCC_ZONE_REMOTE];
+
+    // Get BLE counts (Apple vs Other, plus dwell and zones)
+    CountSnapshot ble;
     portENTER_CRITICAL(&g_bleMux);
-    *bleImpressions = g_bleImpressions;
-    *bleUnique = g_bleUniqueMacCount;
-    *bleApple = g_bleAppleCount;
-    *bleOther = g_bleOtherCount;
-    uint16_t bleOverflow = g_bleOverflow;  // Capture before reset
-    if (g_bleRssiCount > 0) {
-        *bleRssiAvg = g_bleRssiSum / (int32_t)g_bleRssiCount;
-    } else {
-        *bleRssiAvg = 0;
-    }
-    // Reset BLE counters (fixed arrays - just reset count, no heap ops)
-    g_bleImpressions = 0;
-    g_bleAppleCount = 0;
-    g_bleOtherCount = 0;
-    g_bleRssiSum = 0;
-    g_bleRssiCount = 0;
-    g_bleUniqueMacCount = 0;  // Reset array count (no heap ops)
-    g_bleOverflow = 0;        // Reset overflow counter for next period
+    g_bleCounter.takeAndReset(&ble);
     portEXIT_CRITICAL(&g_bleMux);
+    r->bleImpressions = ble.impressions;
+    r->bleUnique = ble.unique;
+    r->bleApple = ble.apple;
+    r->bleOther = ble.other;
+    r->bleRssiAvg = ble.rssiAvg;
+    memcpy(r->bleDwell, ble.dwell, sizeof(r->bleDwell));
+    memcpy(r->bleZones, ble.zones, sizeof(r->bleZones));
 
     // Combined overflow count (WiFi + BLE)
-    *overflowCount = wifiOverflow + bleOverflow;
+    r->overflowCount = wifi.overflow + ble.overflow;
+
+    // Close the radio accounting epoch (flush the running segment, keep its slot)
+    radioAccountSwitch(g_listenSlot);
+    if (g_bleCoexSinceUs != 0) radioAccountCoexBle(true);
+    r->radioSchedule = (uint8_t)g_radioSchedule;
+    int64_t nowUs = esp_timer_get_time();
+    r->epochMs = (uint32_t)((nowUs - g_epochStartUs) / 1000);
+    r->wifiListenMs = 0;
+    for (uint8_t c = 0; c < WIFI_CHANNEL_COUNT; c++) {
+        r->channelListenMs[c] = (uint32_t)(g_listenUs[c] / 1000);
+        r->wifiListenMs += r->channelListenMs[c];
+    }
+    r->bleListenMs = (uint32_t)(g_listenUs[LISTEN_SLOT_BLE] / 1000);
+    memset(g_listenUs, 0, sizeof(g_listenUs));
+    g_epochStartUs = nowUs;
 }
 
-// Report counts to backend
-static void reportCounts() {
-    uint32_t impressions, unique;
-    int probeRssiAvg, probeRssiMin, probeRssiMax;
-    uint32_t dwell_0_1, dwell_1_5, dwell_5_10, dwell_10plus;
-    uint32_t rssi_immediate, rssi_near, rssi_far, rssi_remote;
-    uint32_t bleImpressions, bleUnique, bleApple, bleOther;
-    int bleRssiAvg;
-    uint16_t overflowCount;
-
-    getAndResetCounts(&impressions, &unique,
-                      &probeRssiAvg, &probeRssiMin, &probeRssiMax,
-                      &dwell_0_1, &dwell_1_5, &dwell_5_10, &dwell_10plus,
-                      &rssi_immediate, &rssi_near, &rssi_far, &rssi_remote,
-                      &bleImpressions, &bleUnique, &bleApple, &bleOther, &bleRssiAvg,
-                      &overflowCount);
-
-    // Get current cellular signal
-    g_cellRssi = getSignalQuality();
+// Closed period waiting for its upload slot (see Uplink Back-off)
+static CachedReading g_reportPending;
+
+// Close the running period into reading (capture stopped, no modem needed)
+static void reportBuild(CachedReading* out) {
+    CachedReading& reading = *out;
+    reading = CachedReading();
+    getAndResetCounts(&reading);
+    reading.seq = reading.seqLast = seqTake();
+
+    // New day, new salt - between epochs, while capture is stopped
+    bool calendarDay = timeQuality() != TIME_QUALITY_NONE;
+    fingerprintMaybeRotate(calendarDay ? timeNow() / 86400 : millis() / 86400000UL, calendarDay);
+    // Cross-day filters need real calendar days - uptime days would misfile them
+    if (calendarDay) visitorSetDay(timeNow() / 86400);
+
+    // Record the interval and period this epoch ran under, then steer the next one
+    reading.intervalS = reportIntervalMs() / 1000;
+    periodClose(&reading);
+    reading.anomalyFlags = anomalyTakeFlags();
+    uint32_t occupancy = occupancyEstimate(OCC_REPORT_WINDOW_MIN, OCC_REPORT_MIN_ZONE);
+    reading.occupancy = occupancy > 0xFFFF ? 0xFFFF : (uint16_t)occupancy;
+    reading.stableIds = g_visitTodayCount;
+    reading.returningPermille = visitorReturningPermille();
+    adaptiveOnEpoch(reading.unique + reading.bleUnique, reading.epochMs);
+    radioScheduleRecord(reading.radioSchedule, reading.unique, reading.bleUnique, reading.epochMs);
+
+    // Last known cellular signal - refreshed when the reading is uploaded
+    reading.cellRssi = g_cellRssi;
+    reading.cellRssiCount = g_cellRssi != -999 ? 1 : 0;
 
     // Capture current time for age calculation if this reading gets cached
     uint32_t readingMillis = millis();
+    reading.cachedAtMillis = readingMillis;
 
     // Generate ISO 8601 timestamp
-    uint32_t epochTime = g_bootTimestamp + (readingMillis / 1000);
-    char timestamp[25];
+    uint32_t epochTime = timeNow();
+    reading.timeQuality = timeQuality();
     time_t rawtime = (time_t)epochTime;
     struct tm* timeinfo = gmtime(&rawtime);
-    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", timeinfo);
-
-    Serial.printf("[REPORT] WiFi: %lu probes, %lu unique (overflow: %u)\n", impressions, unique, overflowCount);
-    Serial.printf("[REPORT] BLE: %lu ads, %lu unique (Apple:%lu Other:%lu)\n",
-                  bleImpressions, bleUnique, bleApple, bleOther);
-    Serial.printf("[REPORT] Dwell: 0-1min:%lu 1-5min:%lu 5-10min:%lu 10+min:%lu\n",
-                  dwell_0_1, dwell_1_5, dwell_5_10, dwell_10plus);
-    Serial.printf("[REPORT] RSSI zones: immediate:%lu near:%lu far:%lu remote:%lu\n",
-                  rssi_immediate, rssi_near, rssi_far, rssi_remote);
-    Serial.printf("[REPORT] Probe RSSI: avg=%d min=%d max=%d, BLE RSSI: avg=%d, Cell: %d dBm\n",
-                  probeRssiAvg, probeRssiMin, probeRssiMax, bleRssiAvg, g_cellRssi);
+    strftime(reading.timestamp, sizeof(reading.timestamp), "%Y-%m-%dT%H:%M:%SZ", timeinfo);
+
+    LOGI("[REPORT] WiFi: %lu probes, %lu unique (overflow: %u)\n",
+                  reading.impressions, reading.unique, reading.overflowCount);
+    LOGI("[REPORT] BLE: %lu ads, %lu unique (Apple:%lu Other:%lu)\n",
+                  reading.bleImpressions, reading.bleUnique, reading.bleApple, reading.bleOther);
+    LOGI("[REPORT] Dwell: 0-1min:%lu 1-5min:%lu 5-10min:%lu 10+min:%lu\n",
+                  reading.dwell_0_1, reading.dwell_1_5, reading.dwell_5_10, reading.dwell_10plus);
+    LOGI("[REPORT] RSSI zones: immediate:%lu near:%lu far:%lu remote:%lu\n",
+                  reading.rssi_immediate, reading.rssi_near, reading.rssi_far, reading.rssi_remote);
+    LOGI("[REPORT] Probe RSSI: avg=%d min=%d max=%d, BLE RSSI: avg=%d, Cell: %d dBm\n",
+                  reading.probeRssiAvg, reading.probeRssiMin, reading.probeRssiMax,
+                  reading.bleRssiAvg, g_cellRssi);
+    LOGI("[REPORT] Occupancy: %u (last %d min, near or closer)\n",
+                  reading.occupancy, OCC_REPORT_WINDOW_MIN);
+    LOGI("[REPORT] Listen: epoch=%lu ms, WiFi=%lu ms (ch %lu/%lu/%lu), BLE=%lu ms\n",
+                  reading.epochMs, reading.wifiListenMs,
+                  reading.channelListenMs[0], reading.channelListenMs[1], reading.channelListenMs[2],
+                  reading.bleListenMs);
+    reading.valid = true;
+}
 
+// Upload cached readings and the pending one (modem held)
+static void reportSend() {
     // Try to send cached readings first (up to 5 per report cycle to avoid timeout)
+    bool failed = false;
     int cachedSent = 0;
-    CachedReading cached;
-    while (cachedSent < 5 && popCachedReading(&cached)) {
+    CachedReading* oldest;
+    while (cachedSent < 5 && (oldest = peekCachedReading()) != nullptr) {
+        if (seqAcked(*oldest)) {
+            LOGI("[REPORT] Dropping cached reading #%lu - already acknowledged\n", oldest->seq);
+            dropCachedReading();
+            continue;
+        }
+        CachedReading cached = *oldest;
         // Calculate age in seconds: how long since this reading was cached
         uint32_t ageSeconds = (millis() - cached.cachedAtMillis) / 1000;
-        Serial.printf("[REPORT] Retrying cached reading (%d remaining, age=%lu sec)...\n", g_cacheCount, ageSeconds);
-        if (sendReading(cached.timestamp,
-                        cached.impressions,
-                        cached.unique,
-                        cached.probeRssiAvg,
-                        cached.probeRssiMin,
-                        cached.probeRssiMax,
-                        cached.cellRssi,
-                        cached.dwell_0_1,
-                        cached.dwell_1_5,
-                        cached.dwell_5_10,
-                        cached.dwell_10plus,
-                        cached.rssi_immediate,
-                        cached.rssi_near,
-                        cached.rssi_far,
-                        cached.rssi_remote,
-                        cached.bleImpressions,
-                        cached.bleUnique,
-                        cached.bleApple,
-                        cached.bleOther,
-                        cached.bleRssiAvg,
-                        cached.overflowCount,
-                        ageSeconds)) {
+        LOGI("[REPORT] Retrying cached reading (%d remaining, age=%lu sec)...\n", g_cacheCount - 1, ageSeconds);
+        if (sendReading(cached, ageSeconds, false)) {
+            dropCachedReading();
             cachedSent++;
-            Serial.println("[REPORT] Cached reading sent successfully");
+            LOGI("[REPORT] Cached reading sent successfully\n");
         } else {
-            // Re-cache this reading at the front (it failed again)
-            cacheReading(cached);
+            // Leave it at the front of the cache (it failed again)
+            if (g_httpRequestSent) oldest->sentUnacked = true;
+            failed = true;
             break;  // Stop trying if network is down
         }
     }
 
-    // Send current reading (age=0 for live readings)
-    if (!sendReading(timestamp, impressions, unique,
-                     probeRssiAvg, probeRssiMin, probeRssiMax, g_cellRssi,
-                     dwell_0_1, dwell_1_5, dwell_5_10, dwell_10plus,
-                     rssi_immediate, rssi_near, rssi_far, rssi_remote,
-                     bleImpressions, bleUnique, bleApple, bleOther, bleRssiAvg,
-                     overflowCount, 0)) {
-        // Cache for retry using circular buffer
-        CachedReading newReading;
-        newReading.valid = true;
-        strncpy(newReading.timestamp, timestamp, sizeof(newReading.timestamp));
-        newReading.cachedAtMillis = readingMillis;   // When this reading was created
-        newReading.overflowCount = overflowCount;    // Preserve overflow count for this period
-        newReading.impressions = impressions;
-        newReading.unique = unique;
-        newReading.probeRssiAvg = probeRssiAvg;
-        newReading.probeRssiMin = probeRssiMin;
-        newReading.probeRssiMax = probeRssiMax;
-        newReading.cellRssi = g_cellRssi;
-        newReading.dwell_0_1 = dwell_0_1;
-        newReading.dwell_1_5 = dwell_1_5;
-        newReading.dwell_5_10 = dwell_5_10;
-        newReading.dwell_10plus = dwell_10plus;
-        newReading.rssi_immediate = rssi_immediate;
-        newReading.rssi_near = rssi_near;
-        newReading.rssi_far = rssi_far;
-        newReading.rssi_remote = rssi_remote;
-        newReading.bleImpressions = bleImpressions;
-        newReading.bleUnique = bleUnique;
-        newReading.bleApple = bleApple;
-        newReading.bleOther = bleOther;
-        newReading.bleRssiAvg = bleRssiAvg;
-        cacheReading(newReading);
-
-        // Try to re-initialize network for next time
-        g_networkReady = false;
+    // A failed retry ends the cycle: the live reading joins the cache rather
+    // than failing a second time (one failure per cycle for the back-off)
+    if (failed && g_reportPending.valid) {
+        cacheReading(g_reportPending);
+        g_reportPending.valid = false;
+    }
+
+    // Send current reading
+    if (g_reportPending.valid) {
+        // Get current cellular signal (cached from URCs unless stale)
+        g_cellRssi = currentSignalDbm();
+        g_reportPending.cellRssi = g_cellRssi;
+        g_reportPending.cellRssiCount = g_cellRssi != -999 ? 1 : 0;
+
+        uint32_t sendStart = millis();
+        bool otaBusy = g_links[MODEM_LINK_OTA].busy;
+        // Held by jitter or back-off, it may be minutes old - age keeps the
+        // backend's unsynced-clock fallback (now - age) on the right period
+        uint32_t ageSeconds = (millis() - g_reportPending.cachedAtMillis) / 1000;
+        bool sent = sendReading(g_reportPending, ageSeconds, true);
+        latencyRecord(LATENCY_REPORT, otaBusy || g_links[MODEM_LINK_OTA].busy, millis() - sendStart);
+        if (!sent) {
+            // Cache for retry using circular buffer
+            if (g_httpRequestSent) g_reportPending.sentUnacked = true;
+            cacheReading(g_reportPending);
+
+            // Try to re-initialize network for next time
+            g_networkReady = false;
+            failed = true;
+        }
+        g_reportPending.valid = false;
     }
+
+    uplinkOnResult(!failed);
 }
 
 // =============================================================================
@@ -2998,11 +6620,12 @@ static void reportCounts() {
 
 // Perform WiFi scan to collect nearby access points for geolocation
 static void performGeolocationScan() {
-    Serial.println("[GEO] Scanning for WiFi networks...");
+    LOGI("[GEO] Scanning for WiFi networks...\n");
     g_wifiNetworkCount = 0;
 
     // Temporarily disable promiscuous mode for scanning
     esp_wifi_set_promiscuous(false);
+    radioAccountSwitch(LISTEN_SLOT_IDLE);
 
     // Set WiFi to station mode for scanning
     WiFi.mode(WIFI_STA);
@@ -3013,11 +6636,11 @@ static void performGeolocationScan() {
     int numNetworks = WiFi.scanNetworks(false, false, false, 300);
 
     if (numNetworks < 0) {
-        Serial.println("[GEO] WiFi scan failed");
+        LOGW("[GEO] WiFi scan failed\n");
         return;
     }
 
-    Serial.printf("[GEO] Found %d networks\n", numNetworks);
+    LOGI("[GEO] Found %d networks\n", numNetworks);
 
     // Store top networks by signal strength (already sorted by RSSI)
     int count = min(numNetworks, MAX_WIFI_NETWORKS);
@@ -3030,7 +6653,7 @@ static void performGeolocationScan() {
         g_wifiNetworks[i].rssi = WiFi.RSSI(i);
         g_wifiNetworks[i].channel = WiFi.channel(i);
 
-        Serial.printf("[GEO]   %d: %s RSSI:%d CH:%d\n",
+        LOGI("[GEO]   %d: %s RSSI:%d CH:%d\n",
                       i + 1, g_wifiNetworks[i].bssid,
                       g_wifiNetworks[i].rssi, g_wifiNetworks[i].channel);
     }
@@ -3043,11 +6666,11 @@ static void performGeolocationScan() {
 // Send geolocation data to backend
 static bool sendGeolocationData() {
     if (g_wifiNetworkCount == 0) {
-        Serial.println("[GEO] No WiFi networks to send");
+        LOGI("[GEO] No WiFi networks to send\n");
         return false;
     }
 
-    Serial.printf("[GEO] Sending %d WiFi networks for geolocation...\n", g_wifiNetworkCount);
+    LOGI("[GEO] Sending %d WiFi networks for geolocation...\n", g_wifiNetworkCount);
 
     // Build JSON payload
     // Format: {"d":"JBNB0001","wifi":[{"bssid":"AA:BB:CC:DD:EE:FF","rssi":-65,"ch":6},...]}
@@ -3087,15 +6710,15 @@ static bool sendGeolocationData() {
     snprintf(tcpOpenCmd, sizeof(tcpOpenCmd),
              "AT+CIPOPEN=0,\"TCP\",\"%s\",%d", BACKEND_HOST, BACKEND_PORT);
 
-    Serial.printf("[GEO] Connecting to %s:%d\n", BACKEND_HOST, BACKEND_PORT);
+    LOGI("[GEO] Connecting to %s:%d\n", BACKEND_HOST, BACKEND_PORT);
 
     if (!atSendCommand(tcpOpenCmd, "+CIPOPEN: 0,0", TCP_CONNECT_TIMEOUT_MS)) {
-        Serial.println("[GEO] TCP connect failed");
+        LOGW("[GEO] TCP connect failed\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
 
-    Serial.println("[GEO] Connected");
+    LOGI("[GEO] Connected\n");
     delay(500);
 
     // Send data
@@ -3103,7 +6726,7 @@ static bool sendGeolocationData() {
     snprintf(sendCmd, sizeof(sendCmd), "AT+CIPSEND=0,%d", httpLen);
 
     if (!atSendCommand(sendCmd, ">", AT_COMMAND_TIMEOUT_MS)) {
-        Serial.println("[GEO] CIPSEND prompt failed");
+        LOGW("[GEO] CIPSEND prompt failed\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
@@ -3113,7 +6736,7 @@ static bool sendGeolocationData() {
 
     // Wait for send confirmation
     if (!atWaitFor("+CIPSEND:", 15000)) {
-        Serial.println("[GEO] Send confirmation timeout");
+        LOGW("[GEO] Send confirmation timeout\n");
         atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
         return false;
     }
@@ -3125,8 +6748,8 @@ static bool sendGeolocationData() {
     atClearBuffer();
     uint32_t readStart = millis();
     while ((millis() - readStart) < 5000) {
-        while (ModemSerial.available() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
-            char c = ModemSerial.read();
+        while (modemAvailable() && g_atBufferLen < sizeof(g_atBuffer) - 1) {
+            char c = modemRead();
             g_atBuffer[g_atBufferLen++] = c;
         }
         delay(100);
@@ -3134,20 +6757,19 @@ static bool sendGeolocationData() {
     g_atBuffer[g_atBufferLen] = '\0';
 
     if (g_atBufferLen > 0) {
-        Serial.printf("[GEO] Response: %s\n", g_atBuffer);
+        LOGD_DUMP("[GEO] Response: ", g_atBuffer);
     }
 
     // Check for HTTP success
-    bool success = (strstr(g_atBuffer, "200") != NULL ||
-                    strstr(g_atBuffer, "201") != NULL);
+    bool success = httpResponseOk(g_atBuffer);
 
     // Close TCP connection
     atSendCommand("AT+CIPCLOSE=0", "OK", 5000);
 
     if (success) {
-        Serial.println("[GEO] Geolocation sent successfully");
+        LOGI("[GEO] Geolocation sent successfully\n");
     } else {
-        Serial.println("[GEO] Geolocation send failed");
+        LOGW("[GEO] Geolocation send failed\n");
     }
 
     return success;
@@ -3175,12 +6797,12 @@ static void checkButton() {
 
         if (pressDuration > 3000) {
             // Long press (>3 seconds) - enter OTA mode
-            Serial.println("[BTN] Long press - entering OTA mode");
+            LOGI("[BTN] Long press - entering OTA mode\n");
             g_otaRequested = true;
         } else if (pressDuration > 100) {
             // Short press - send data packet immediately
-            Serial.println("[BTN] Short press - sending data now");
-            g_forceSendRequested = true;
+            LOGI("[BTN] Short press - sending data now\n");
+            requestReportNow();
         }
     }
 }
@@ -3200,8 +6822,9 @@ static void checkResetButton() {
         resetButtonPressed = false;
 
         if (pressDuration > 100) {
-            Serial.println("[BTN] Reset button - rebooting...");
+            LOGI("[BTN] Reset button - rebooting...\n");
             delay(500);
+            logFlush(LOG_FLUSH_TIMEOUT_MS);
             ESP.restart();
         }
     }
@@ -3211,291 +6834,417 @@ static void checkResetButton() {
 // Main Setup and Loop
 // =============================================================================
 
+// Next scheduled report - the next period boundary (interval may change at runtime)
+static void reportTimerRearm() {
+    timerStart(&g_reportTimer, periodNextDelayMs(millis() - g_lastReportTime), 0);
+}
+
+// Period boundary (or forced report): close the period into g_reportPending
+// and schedule its upload after this device's jitter / any back-off hold
+static void reportPeriodClose() {
+    bool forced = g_forceSendRequested;
+    g_lastReportTime = millis();
+    g_periodEndMs = g_lastReportTime;
+    g_forceSendRequested = false;
+
+    radioCaptureStop();
+    if (g_reportPending.valid) {
+        // Previous period still held back - it waits in the cache instead
+        cacheReading(g_reportPending);
+    }
+    reportBuild(&g_reportPending);
+    radioCaptureStart();
+
+    uint32_t delayMs = uplinkDelayMs(reportIntervalMs(), forced);
+    LOGI("[LOOP] Period closed, upload in %lu s\n", delayMs / 1000);
+    timerStart(&g_uplinkTimer, delayMs, 0);
+    reportTimerRearm();
+}
+
+// Upload cycle: pause capture, hold the modem, send, resume
+static void runReportCycle() {
+    LOGI("\n[LOOP] Sending report...\n");
+
+    // Temporarily stop scanning during transmission
+    radioCaptureStop();
+
+    // Take the modem for the whole report cycle (waits out an OTA chunk).
+    // OTA holds it for one bounded chunk at a time, so a timeout means
+    // something is wedged - leave the UART alone and keep the reading in
+    // g_reportPending (cached at the next boundary) for a later cycle.
+    if (!modemAcquire("report", MODEM_UPLINK_WAIT_MS)) {
+        LOGW("[LOOP] Modem busy - uplink skipped, reading kept for next cycle\n");
+        radioCaptureStart();
+        reportTimerRearm();
+        return;
+    }
+    modemLinkClaim(MODEM_LINK_REPORT, true);
+
+    // Ensure network is ready (a +CEREG URC may have reported deregistration)
+    if (g_networkReady && linkStateLostRegistration()) {
+        LOGW("[LOOP] Modem reports not registered (stat=%d)\n", linkStateSnapshot().regStat);
+        g_networkReady = false;
+    }
+    if (!g_networkReady) {
+        LOGI("[LOOP] Re-initializing network...\n");
+        initializeNetwork();
+    }
+
+    // Handle pending geolocation (from boot or remote command)
+    if (g_networkReady && g_geolocationPending) {
+        LOGI("[LOOP] Processing geolocation request...\n");
+        // Perform fresh WiFi scan (in case this was a remote command)
+        performGeolocationScan();
+        if (g_wifiNetworkCount > 0) {
+            if (sendGeolocationData()) {
+                g_geolocationPending = false;
+                LOGI("[LOOP] Geolocation sent successfully\n");
+            }
+        } else {
+            LOGI("[LOOP] No WiFi networks found for geolocation\n");
+            g_geolocationPending = false;  // Clear to avoid infinite retries
+        }
+        // Note: probe capture will be restarted at end of report cycle
+    }
+
+    // Handle pending config fetch (v5.4 - remote configuration)
+    if (g_networkReady && g_configFetchPending) {
+        LOGI("[LOOP] Processing config fetch...\n");
+        if (fetchAndApplyConfig()) {
+            g_configFetchPending = false;
+            LOGI("[LOOP] Config fetch successful\n");
+        } else {
+            LOGW("[LOOP] Config fetch failed, will retry later\n");
+            g_configFetchPending = false;  // Clear to avoid repeated failures
+        }
+    }
+
+    // Handle pending log upload (remote "upload_logs" command)
+    if (g_networkReady && g_logUploadPendingKb > 0) {
+        LOGI("[LOOP] Processing log upload...\n");
+        uploadLogs(g_logUploadPendingKb);
+        g_logUploadPendingKb = 0;  // One attempt per request
+    }
+
+    // Refresh network time (the next period boundary is armed against it)
+    if (g_networkReady) {
+        timeMaybeSyncFromModem();
+    }
+
+    // Send report
+    reportSend();
+
+    modemLinkClaim(MODEM_LINK_REPORT, false);
+    modemRelease();
+
+    // Resume scanning (always start in WiFi mode after report)
+    radioCaptureStart();
+
+    LOGI("[LOOP] Resuming probe/BLE capture\n\n");
+
+    reportTimerRearm();
+    if (g_uplinkHeld) {
+        // Retry the cache when the back-off expires, even mid-period
+        timerStart(&g_uplinkTimer, uplinkHoldMs(false), 0);
+    }
+}
+
+// Daily heartbeat
+static void heartbeatExpired() {
+    g_lastHeartbeatTime = millis();
+    if (g_networkReady && modemAcquire("heartbeat", MODEM_UPLINK_WAIT_MS)) {
+        LOGI("[LOOP] Sending daily heartbeat...\n");
+        modemLinkClaim(MODEM_LINK_REPORT, true);
+        sendHeartbeat();
+        modemLinkClaim(MODEM_LINK_REPORT, false);
+        modemRelease();
+    }
+}
+
+// Periodic status (every 60 seconds)
+static void statusExpired() {
+    uint32_t probes, unique, filtered;
+    int probeRssiAvg = 0;
+    portENTER_CRITICAL(&g_probeMux);
+    probes = g_wifiCounter.impressions();
+    unique = g_wifiCounter.uniques();
+    filtered = g_filteredStatic;
+    if (g_wifiCounter.rssiCount() > 0) {
+        probeRssiAvg = g_wifiCounter.rssiSum() / (int32_t)g_wifiCounter.rssiCount();
+    }
+    portEXIT_CRITICAL(&g_probeMux);
+
+    uint32_t bleAds, bleUniq;
+    portENTER_CRITICAL(&g_bleMux);
+    bleAds = g_bleCounter.impressions();
+    bleUniq = g_bleCounter.uniques();
+    portEXIT_CRITICAL(&g_bleMux);
+
+    uint32_t sinceReport = millis() - g_lastReportTime;
+    adaptiveCheckLive(unique + bleUniq, sinceReport);
+    int32_t nextReportMs = (int32_t)(g_reportTimer.expires - schedTickNow()) * SCHED_TICK_MS;
+    uint32_t nextReport = g_reportTimer.active && nextReportMs > 0 ? nextReportMs / 1000 : 0;
+    const char* radioStr = g_radioSchedule == RADIO_SCHEDULE_COEX ? "WiFi+BLE"
+                           : (g_radioMode == RADIO_WIFI) ? "WiFi" : "BLE";
+    LOGI("[STATUS] %s CH:%d WiFi:%lu/%lu BLE:%lu/%lu Filt:%lu Next:%lu sec\n",
+                  radioStr, WIFI_CHANNELS[g_currentChannelIndex],
+                  probes, unique, bleAds, bleUniq,
+                  filtered, nextReport);
+
+    // Heap monitoring for long-term reliability tracking
+    LOGI("[HEAP] Free: %u, Min: %u, MaxBlock: %u\n",
+                  ESP.getFreeHeap(),
+                  ESP.getMinFreeHeap(),
+                  ESP.getMaxAllocHeap());
+
+    // Report vs OTA transaction latency, solo and with the other link busy
+    latencyLog();
+    modemUartLog();
+
+    // Minute-granularity anomaly detection (may request an immediate report)
+    anomalySampleMinute();
+    sessionExpire();
+    visitorProcessPending();
+
+    // Cellular data usage against the monthly budget
+    usageGovernorUpdate();
+    LOGI("[USAGE] Day: %lu B, Month: %lu B, Budget: %lu MB (projected %lu%%), Gov: %u\n",
+         g_usageDayBytes, g_usageMonthBytes, g_dataBudgetMb, g_usageProjectedPct,
+         g_governorLevel);
+
+    schedLogStats();
+
+    // The adaptive interval may have moved - keep the report deadline in step
+    reportTimerRearm();
+}
+
+// Drain URCs into the link state while the modem is idle (no RX event hook)
+static void urcDrainExpired() {
+    if (modemTryAcquire("urc")) {
+        while (modemAvailable()) modemRead();
+        modemRelease();
+    }
+}
+
+static void otaServerExpired() {
+    if (g_otaServer) {
+        g_otaServer->handleClient();
+    }
+}
+
+static void otaTimeoutExpired() {
+    LOGW("[OTA] Timeout - exiting OTA mode\n");
+    stopOtaMode();
+}
+
+// Button edges wake the loop; debounce and press timing stay in checkButton()
+static void IRAM_ATTR buttonIsr() {
+    schedPostFromIsr(SCHED_EVENT_BUTTON);
+}
+
+static void loopTimersStart() {
+    reportTimerRearm();
+    if (g_reportPending.valid || g_cacheCount > 0) {
+        timerStart(&g_uplinkTimer, uplinkHoldMs(false), 0);
+    }
+    uint32_t sinceHeartbeat = millis() - g_lastHeartbeatTime;
+    timerStart(&g_heartbeatTimer,
+               sinceHeartbeat < HEARTBEAT_INTERVAL_MS ? HEARTBEAT_INTERVAL_MS - sinceHeartbeat : 0,
+               HEARTBEAT_INTERVAL_MS);
+    timerStart(&g_statusTimer, 60000, 60000);
+}
+
 void setup() {
     // Initialize USB Serial
     Serial.begin(115200);
+    logInit();    // Deferred logger - all output below goes through the drain task
     delay(2000);  // Wait for USB CDC
 
-    Serial.println();
-    Serial.println("========================================");
-    Serial.printf("  NB-IoT JamBox Probe Counter v%s\n", FIRMWARE_VERSION);
-    Serial.printf("  Device ID: %s\n", DEVICE_ID);
-    Serial.printf("  Report interval: %lu minutes\n", REPORT_INTERVAL_MS / 60000);
-    Serial.println("  Channel hopping: 1, 6, 11 (3s)");
-    Serial.println("  Remote config: enabled");
-    Serial.println("========================================");
-    Serial.println();
-    Serial.println("Default Thresholds (overridden by remote config):");
-    Serial.printf("  RSSI: immediate=%d, near=%d, far=%d dBm\n",
+    LOGI("\n");
+    LOGI("========================================\n");
+    LOGI("  NB-IoT JamBox Probe Counter v%s\n", FIRMWARE_VERSION);
+    LOGI("  Device ID: %s\n", DEVICE_ID);
+    LOGI("  Report interval: %lu minutes (adaptive %lu-%lu)\n", REPORT_INTERVAL_MS / 60000,
+         REPORT_INTERVAL_MIN_MS / 60000, REPORT_INTERVAL_MAX_MS / 60000);
+    LOGI("  Channel hopping: 1, 6, 11 (3s)\n");
+    LOGI("  Remote config: enabled\n");
+    LOGI("========================================\n");
+    LOGI("\n");
+    LOGI("Default Thresholds (overridden by remote config):\n");
+    LOGI("  RSSI: immediate=%d, near=%d, far=%d dBm\n",
                   g_rssiImmediateThreshold, g_rssiNearThreshold, g_rssiFarThreshold);
-    Serial.printf("  Dwell: short=%u, medium=%u, long=%u min\n",
+    LOGI("  Dwell: short=%u, medium=%u, long=%u min\n",
                   g_dwellShortThreshold, g_dwellMediumThreshold, g_dwellLongThreshold);
-    Serial.println("========================================");
-    Serial.println();
-    Serial.println("LED Status:");
-    Serial.println("  PURPLE      = Booting");
-    Serial.println("  RED (slow)  = Searching for network");
-    Serial.println("  RED (fast)  = Error");
-    Serial.println("  GREEN       = Connected, counting");
-    Serial.println("  CYAN        = Transmitting");
-    Serial.println("  GREEN       = Send successful");
-    Serial.println("  BLUE        = Send failed");
-    Serial.println("  YELLOW      = OTA mode");
-    Serial.println();
-    Serial.println("Buttons:");
-    Serial.println("  Main short press  = Send data now");
-    Serial.println("  Main long (3s)    = OTA mode");
-    Serial.println("  Side button       = Reboot");
-    Serial.println();
+    LOGI("========================================\n");
+    LOGI("\n");
+    LOGI("LED Status:\n");
+    LOGI("  PURPLE      = Booting\n");
+    LOGI("  RED (slow)  = Searching for network\n");
+    LOGI("  RED (fast)  = Error\n");
+    LOGI("  GREEN       = Connected, counting\n");
+    LOGI("  CYAN        = Transmitting\n");
+    LOGI("  GREEN       = Send successful\n");
+    LOGI("  BLUE        = Send failed\n");
+    LOGI("  YELLOW      = OTA mode\n");
+    LOGI("\n");
+    LOGI("Buttons:\n");
+    LOGI("  Main short press  = Send data now\n");
+    LOGI("  Main long (3s)    = OTA mode\n");
+    LOGI("  Side button       = Reboot\n");
+    LOGI("\n");
 
     // Initialize LED
     ledInit();
     ledSetStatus(LED_STATUS_BOOTING);
 
-    // Initialize buttons
+    // Event scheduler - timers are armed once their subsystems are up
+    schedInit();
+    schedTimerInit(&g_reportTimer, "period", reportPeriodClose);
+    schedTimerInit(&g_uplinkTimer, "uplink", runReportCycle);
+    schedTimerInit(&g_heartbeatTimer, "hb", heartbeatExpired);
+    schedTimerInit(&g_statusTimer, "status", statusExpired);
+    schedTimerInit(&g_urcTimer, "urc", urcDrainExpired);
+    schedTimerInit(&g_radioSliceTimer, "slice", radioSliceExpired);
+    schedTimerInit(&g_channelHopTimer, "hop", channelHopExpired);
+    schedTimerInit(&g_otaServerTimer, "ota", otaServerExpired);
+    schedTimerInit(&g_otaTimeoutTimer, "otaTo", otaTimeoutExpired);
+
+    // Initialize buttons (edges wake the loop through the event queue)
     pinMode(BUTTON_PIN, INPUT_PULLUP);
     pinMode(RESET_BUTTON_PIN, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(BUTTON_PIN), buttonIsr, CHANGE);
+    attachInterrupt(digitalPinToInterrupt(RESET_BUTTON_PIN), buttonIsr, CHANGE);
 
     // Initialize modem serial
+    ModemSerial.setRxBufferSize(MODEM_RX_BUFFER_SIZE);  // Before begin()
     ModemSerial.begin(MODEM_BAUD, SERIAL_8N1, MODEM_RX_PIN, MODEM_TX_PIN);
+    modemArbiterInit();
     delay(1000);
 
     // Initialize SPIFFS for OTA patch storage
-    Serial.println("[INIT] Initializing SPIFFS...");
+    LOGI("[INIT] Initializing SPIFFS...\n");
     initSpiffs();
 
     // Load OTA state from NVS (for recovery after crash/power loss)
-    Serial.println("[INIT] Loading OTA state from NVS...");
+    LOGI("[INIT] Loading OTA state from NVS...\n");
     otaLoadState();
+    usageLoad();
+    visitorLoadKey();
 
     // If OTA was in progress before reboot, handle recovery
     if (g_otaDelta.state != OTA_DELTA_IDLE) {
         if (g_otaDelta.state == OTA_DELTA_REBOOTING) {
             // We just rebooted after successful OTA - clear state
-            Serial.println("[INIT] OTA complete from previous boot, clearing state");
+            LOGI("[INIT] OTA complete from previous boot, clearing state\n");
             otaClearState();
         } else if (g_otaDelta.state == OTA_DELTA_DOWNLOADING &&
                    g_otaDelta.chunksReceived > 0) {
             // Resume download from where we left off
-            Serial.printf("[INIT] Resuming OTA download at chunk %d/%d\n",
+            LOGI("[INIT] Resuming OTA download at chunk %d/%d\n",
                           g_otaDelta.chunksReceived, g_otaDelta.totalChunks);
         } else {
             // Other interrupted state - restart OTA process
-            Serial.printf("[INIT] OTA interrupted in state %d, restarting\n", g_otaDelta.state);
+            LOGI("[INIT] OTA interrupted in state %d, restarting\n", g_otaDelta.state);
             otaClearState();
         }
     }
 
     // Set boot timestamp (would use NTP in production)
-    g_bootTimestamp = 1769587200;  // 2026-01-28T08:00:00Z - fallback until server sync
+    g_bootTimestamp = TIME_FALLBACK_EPOCH;  // Until modem or server time sync
 
     // Perform WiFi geolocation scan FIRST (fast, before network init)
-    Serial.println("[INIT] Performing geolocation scan...");
+    LOGI("[INIT] Performing geolocation scan...\n");
     performGeolocationScan();
 
     // Initialize network (can take 1-2 minutes for NB-IoT)
-    Serial.println("[INIT] Initializing NB-IoT network...");
+    LOGI("[INIT] Initializing NB-IoT network...\n");
     if (!initializeNetwork()) {
-        Serial.println("[INIT] Network init failed - will retry later");
+        LOGW("[INIT] Network init failed - will retry later\n");
         ledSetStatus(LED_STATUS_SEARCHING);
     }
 
     // Send geolocation data if we have network and found WiFi networks
     if (g_networkReady && g_wifiNetworkCount > 0) {
-        Serial.println("[INIT] Sending geolocation data...");
+        LOGI("[INIT] Sending geolocation data...\n");
         sendGeolocationData();
         g_geolocationPending = false;
     } else if (g_wifiNetworkCount == 0) {
-        Serial.println("[INIT] No WiFi networks found for geolocation");
+        LOGI("[INIT] No WiFi networks found for geolocation\n");
         g_geolocationPending = false;
     } else {
-        Serial.println("[INIT] Network not ready, will send geolocation when connected");
+        LOGI("[INIT] Network not ready, will send geolocation when connected\n");
         g_geolocationPending = true;
     }
 
     // Send initial heartbeat at boot
     if (g_networkReady) {
-        Serial.println("[INIT] Sending initial heartbeat...");
+        LOGI("[INIT] Sending initial heartbeat...\n");
         sendHeartbeat();
     }
     g_lastHeartbeatTime = millis();
 
-    // Start probe capture
-    Serial.println("[INIT] Starting probe capture...");
-    startProbeCapture();
+    // First fingerprint salt - drawn after the radio is up so esp_random() is a true RNG
+    fingerprintNewSalt(0);
+
+    // Reading sequence - a new stream id also wants the true RNG
+    seqLoad();
 
     // Initialize BLE for device type detection
-    Serial.println("[INIT] Initializing BLE scanning...");
+    LOGI("[INIT] Initializing BLE scanning...\n");
     initBle();
 
+    // Start probe capture (radio accounting epoch starts with it) and the
+    // time-slicing / channel hop timers
+    LOGI("[INIT] Starting probe capture...\n");
+    g_epochStartUs = esp_timer_get_time();
+    g_periodStartMs = millis();
+    radioCaptureStart();
+
     // Initialize timing
     g_lastReportTime = millis();
-    g_lastRadioSwitch = millis();  // Initialize radio time-slicing
+    loopTimersStart();
+    timerStart(&g_urcTimer, 50, 50);
 
     // Initialize watchdog timer - reboot if no feed for 5 minutes
     // This provides self-healing if the device gets stuck
     esp_task_wdt_init(300, true);  // 300 seconds (5 minutes), panic on timeout
     esp_task_wdt_add(NULL);        // Add current task (loop) to watchdog
-    Serial.println("[INIT] Watchdog timer initialized (5 min timeout)");
+    LOGI("[INIT] Watchdog timer initialized (5 min timeout)\n");
 
-    Serial.println("[INIT] Initialization complete");
-    Serial.println("[INIT] Monitoring for WiFi probes and BLE advertisements...");
-    Serial.println();
+    // Delta OTA runs in its own task from here on, sharing the modem via the arbiter
+    otaDeltaTaskStart();
+
+    LOGI("[INIT] Initialization complete\n");
+    LOGI("[INIT] Monitoring for WiFi probes and BLE advertisements...\n");
+    LOGI("\n");
 }
 
 void loop() {
     // Feed the watchdog at start of each loop iteration
     esp_task_wdt_reset();
 
-    uint32_t now = millis();
-
-    // Update LED animation
-    ledUpdate();
-
-    // Update radio mode (WiFi/BLE time-slicing) - only when not in OTA mode
-    if (!g_otaInProgress) {
-        updateRadioMode();
+    // Sleep until the next timer deadline or a posted event
+    uint8_t event;
+    if (xQueueReceive(g_schedEvents, &event, pdMS_TO_TICKS(schedIdleMs())) == pdTRUE) {
+        switch (event) {
+            case SCHED_EVENT_BUTTON:
+                checkButton();
+                checkResetButton();
+                break;
+            case SCHED_EVENT_REPORT_NOW:
+                break;  // Flag is acted on below
+        }
     }
 
-    // Check buttons
-    checkButton();
-    checkResetButton();
+    schedRunTimers();
 
     // Handle OTA mode
     if (g_otaRequested && !g_otaInProgress) {
         startOtaMode();
     }
 
-    if (g_otaInProgress) {
-        // In WiFi AP OTA mode - just handle web server
-        if (g_otaServer) {
-            g_otaServer->handleClient();
-        }
-
-        // Timeout check
-        static uint32_t otaStartTime = 0;
-        if (otaStartTime == 0) {
-            otaStartTime = now;
-        }
-        if ((now - otaStartTime) > OTA_TIMEOUT_MS) {
-            Serial.println("[OTA] Timeout - exiting OTA mode");
-            otaStartTime = 0;
-            stopOtaMode();
-        }
-        return;  // Skip normal loop processing during WiFi AP OTA
-    }
-
-    // Handle delta OTA background processing (non-blocking)
-    // This downloads one chunk per call when OTA is in progress
-    handleOtaDeltaBackground();
-
-    // Check if report interval has elapsed OR force send requested
-    if ((now - g_lastReportTime) >= REPORT_INTERVAL_MS || g_forceSendRequested) {
-        g_lastReportTime = now;
-        g_forceSendRequested = false;
-
-        Serial.println("\n[LOOP] Sending report...");
-
-        // Temporarily stop scanning during transmission
-        if (g_radioMode == RADIO_WIFI) {
-            stopProbeCapture();
-        } else {
-            stopBleScan();
-        }
-
-        // Ensure network is ready
-        if (!g_networkReady) {
-            Serial.println("[LOOP] Re-initializing network...");
-            initializeNetwork();
-        }
-
-        // Handle pending geolocation (from boot or remote command)
-        if (g_networkReady && g_geolocationPending) {
-            Serial.println("[LOOP] Processing geolocation request...");
-            // Perform fresh WiFi scan (in case this was a remote command)
-            performGeolocationScan();
-            if (g_wifiNetworkCount > 0) {
-                if (sendGeolocationData()) {
-                    g_geolocationPending = false;
-                    Serial.println("[LOOP] Geolocation sent successfully");
-                }
-            } else {
-                Serial.println("[LOOP] No WiFi networks found for geolocation");
-                g_geolocationPending = false;  // Clear to avoid infinite retries
-            }
-            // Note: probe capture will be restarted at end of report cycle
-        }
-
-        // Handle pending config fetch (v5.4 - remote configuration)
-        if (g_networkReady && g_configFetchPending) {
-            Serial.println("[LOOP] Processing config fetch...");
-            if (fetchAndApplyConfig()) {
-                g_configFetchPending = false;
-                Serial.println("[LOOP] Config fetch successful");
-            } else {
-                Serial.println("[LOOP] Config fetch failed, will retry later");
-                g_configFetchPending = false;  // Clear to avoid repeated failures
-            }
-        }
-
-        // Send report
-        reportCounts();
-
-        // Resume scanning (always start in WiFi mode after report)
-        g_radioMode = RADIO_WIFI;
-        g_lastRadioSwitch = millis();
-        startProbeCapture();
-
-        Serial.println("[LOOP] Resuming probe/BLE capture\n");
-    }
-
-    // Daily heartbeat (every 24 hours)
-    if ((now - g_lastHeartbeatTime) >= HEARTBEAT_INTERVAL_MS) {
-        g_lastHeartbeatTime = now;
-        if (g_networkReady) {
-            Serial.println("[LOOP] Sending daily heartbeat...");
-            sendHeartbeat();
-        }
-    }
-
-    // Periodic status (every 60 seconds)
-    static uint32_t lastStatus = 0;
-    if ((now - lastStatus) >= 60000) {
-        lastStatus = now;
-
-        uint32_t probes, unique, filtered;
-        int probeRssiAvg = 0;
-        portENTER_CRITICAL(&g_probeMux);
-        probes = g_totalProbes;
-        unique = g_uniqueMacCount;
-        filtered = g_filteredStatic;
-        if (g_probeRssiCount > 0) {
-            probeRssiAvg = g_probeRssiSum / (int32_t)g_probeRssiCount;
-        }
-        portEXIT_CRITICAL(&g_probeMux);
-
-        uint32_t bleAds, bleUniq, bleApple, bleOther;
-        portENTER_CRITICAL(&g_bleMux);
-        bleAds = g_bleImpressions;
-        bleUniq = g_bleUniqueMacCount;
-        bleApple = g_bleAppleCount;
-        bleOther = g_bleOtherCount;
-        portEXIT_CRITICAL(&g_bleMux);
-
-        uint32_t nextReport = (REPORT_INTERVAL_MS - (now - g_lastReportTime)) / 1000;
-        const char* radioStr = (g_radioMode == RADIO_WIFI) ? "WiFi" : "BLE";
-        Serial.printf("[STATUS] %s CH:%d WiFi:%lu/%lu BLE:%lu/%lu(Apple:%lu Other:%lu) Filt:%lu Next:%lu sec\n",
-                      radioStr, WIFI_CHANNELS[g_currentChannelIndex],
-                      probes, unique, bleAds, bleUniq, bleApple, bleOther,
-                      filtered, nextReport);
-
-        // Heap monitoring for long-term reliability tracking
-        Serial.printf("[HEAP] Free: %u, Min: %u, MaxBlock: %u\n",
-                      ESP.getFreeHeap(),
-                      ESP.getMinFreeHeap(),
-                      ESP.getMaxAllocHeap());
+    // Out-of-cycle report (button, remote command, anomaly)
+    if (g_forceSendRequested && !g_otaInProgress) {
+        reportPeriodClose();
     }
-
-    // Small delay to yield to other tasks
-    delay(10);
 }
@@ -0,0 +1,202 @@
+// Host tests for delta OTA resume across power loss (pio test -e native)
+
+#include <unity.h>
+#include <string.h>
+
+#include "ota_chunks.h"
+
+#define PATCH_CHUNKS 300     // 150 KB patch - several checkpoints, odd tail byte
+
+// Simulated device: g_otaProgress is lost on a kill, the NVS copy survives.
+// Which chunk comes next and when the bitmap is persisted are decided by the
+// same otaProgress* calls otaDeltaStep() makes; the test only plays the
+// network, NVS and power.
+static OtaChunkProgress g_progress;               // g_otaProgress
+static uint8_t g_nvsBitmap[OTA_MAX_CHUNKS / 8];   // "bitmap" key in NVS
+static uint32_t g_nowMs = 0;                      // millis()
+static uint32_t g_nvsWrites = 0;
+static uint16_t g_fetches[PATCH_CHUNKS];          // Downloads per chunk since the last kill
+static uint32_t g_fetchTotal = 0;
+
+// otaSaveState(): only the bitmap matters here
+static void saveState(uint16_t total) {
+    memcpy(g_nvsBitmap, g_progress.bitmap, otaBitmapBytes(total));
+    g_nvsWrites++;
+    otaProgressCheckpointed(&g_progress, g_nowMs);
+}
+
+// Power loss and reboot, then otaLoadState(); returns chunksReceived
+static uint16_t killAndReload(uint16_t total) {
+    memset(&g_progress, 0xA5, sizeof(g_progress));    // RAM contents are gone
+    g_nowMs = 0;
+    memset(g_fetches, 0, sizeof(g_fetches));
+
+    memset(g_progress.bitmap, 0, sizeof(g_progress.bitmap));
+    memcpy(g_progress.bitmap, g_nvsBitmap, otaBitmapBytes(total));
+    return otaProgressResume(&g_progress, total, g_nowMs);
+}
+
+// The OTA_DELTA_DOWNLOADING step: up to maxChunks, each taking msPerChunk
+static void download(uint16_t total, uint16_t maxChunks, uint32_t msPerChunk) {
+    for (uint16_t n = 0; n < maxChunks; n++) {
+        uint16_t chunk = otaProgressNext(&g_progress, total);
+        if (chunk >= total) return;
+        g_nowMs += msPerChunk;
+        g_fetches[chunk]++;
+        g_fetchTotal++;
+        if (otaProgressMark(&g_progress, chunk, g_nowMs)) {
+            saveState(total);
+        }
+    }
+}
+
+// After a resume completes: every chunk not in the persisted bitmap was
+// fetched exactly once, and no persisted chunk was fetched again
+static void assertRefetchedExactly(const uint8_t* persisted, uint16_t total) {
+    for (uint16_t i = 0; i < total; i++) {
+        TEST_ASSERT_EQUAL_UINT32(otaBitmapHave(persisted, i) ? 0 : 1, g_fetches[i]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(total, otaProgressNext(&g_progress, total));
+    TEST_ASSERT_EQUAL_UINT32(total, otaBitmapCount(g_progress.bitmap, total));
+}
+
+void setUp() {
+    otaProgressClear(&g_progress, 0);
+    memset(g_nvsBitmap, 0, sizeof(g_nvsBitmap));
+    memset(g_fetches, 0, sizeof(g_fetches));
+    g_nowMs = 0;
+    g_nvsWrites = 0;
+    g_fetchTotal = 0;
+}
+
+void tearDown() {}
+
+static void test_bitmap_ops() {
+    uint8_t* bitmap = g_progress.bitmap;
+    TEST_ASSERT_EQUAL_UINT32(0, otaBitmapBytes(0));
+    TEST_ASSERT_EQUAL_UINT32(1, otaBitmapBytes(1));
+    TEST_ASSERT_EQUAL_UINT32(38, otaBitmapBytes(PATCH_CHUNKS));
+    TEST_ASSERT_EQUAL_UINT32(OTA_MAX_CHUNKS / 8, otaBitmapBytes(OTA_MAX_CHUNKS));
+
+    otaBitmapMark(bitmap, 0);
+    otaBitmapMark(bitmap, 1);
+    otaBitmapMark(bitmap, 7);
+    otaBitmapMark(bitmap, 8);
+    otaBitmapMark(bitmap, OTA_MAX_CHUNKS - 1);
+    TEST_ASSERT_TRUE(otaBitmapHave(bitmap, 7));
+    TEST_ASSERT_TRUE(otaBitmapHave(bitmap, 8));
+    TEST_ASSERT_FALSE(otaBitmapHave(bitmap, 2));
+    TEST_ASSERT_EQUAL_UINT32(2, otaProgressNext(&g_progress, PATCH_CHUNKS));
+    TEST_ASSERT_EQUAL_UINT32(4, otaBitmapCount(bitmap, PATCH_CHUNKS));
+    TEST_ASSERT_EQUAL_UINT32(5, otaBitmapCount(bitmap, OTA_MAX_CHUNKS));
+
+    // Marking twice counts once
+    otaBitmapMark(bitmap, 7);
+    TEST_ASSERT_EQUAL_UINT32(4, otaBitmapCount(bitmap, PATCH_CHUNKS));
+}
+
+// Kill at every offset within a checkpoint window: the chunks past the last
+// checkpoint, and only those, are fetched again
+static void test_kill_between_checkpoints() {
+    for (uint16_t offset = 0; offset < OTA_CHECKPOINT_CHUNKS; offset++) {
+        setUp();
+        uint16_t fetchedBeforeKill = 2 * OTA_CHECKPOINT_CHUNKS + offset;
+        download(PATCH_CHUNKS, fetchedBeforeKill, 1000);
+        TEST_ASSERT_EQUAL_UINT32(2, g_nvsWrites);
+
+        uint16_t have = killAndReload(PATCH_CHUNKS);
+        TEST_ASSERT_EQUAL_UINT32(2 * OTA_CHECKPOINT_CHUNKS, have);
+        TEST_ASSERT_EQUAL_UINT32(2 * OTA_CHECKPOINT_CHUNKS, otaProgressNext(&g_progress, PATCH_CHUNKS));
+
+        uint8_t persisted[OTA_MAX_CHUNKS / 8];
+        memcpy(persisted, g_nvsBitmap, sizeof(persisted));
+        download(PATCH_CHUNKS, PATCH_CHUNKS, 1000);
+
+        assertRefetchedExactly(persisted, PATCH_CHUNKS);
+        TEST_ASSERT_EQUAL_UINT32(PATCH_CHUNKS + offset, g_fetchTotal);
+    }
+}
+
+// Several kills in a row, including one before the first checkpoint and
+// one on a checkpoint boundary
+static void test_repeated_kills() {
+    const uint16_t runs[] = { 10, OTA_CHECKPOINT_CHUNKS, 45, 3, 100 };
+    uint32_t lost = 0;
+    for (size_t r = 0; r < sizeof(runs) / sizeof(runs[0]); r++) {
+        uint32_t before = g_fetchTotal;
+        download(PATCH_CHUNKS, runs[r], 1000);
+        TEST_ASSERT_EQUAL_UINT32(runs[r], g_fetchTotal - before);
+        lost += g_progress.sinceCheckpoint;
+        killAndReload(PATCH_CHUNKS);
+        TEST_ASSERT_EQUAL_UINT32(0, otaBitmapCount(g_nvsBitmap, PATCH_CHUNKS) % OTA_CHECKPOINT_CHUNKS);
+    }
+
+    uint8_t persisted[OTA_MAX_CHUNKS / 8];
+    memcpy(persisted, g_nvsBitmap, sizeof(persisted));
+    download(PATCH_CHUNKS, PATCH_CHUNKS, 1000);
+
+    assertRefetchedExactly(persisted, PATCH_CHUNKS);
+    TEST_ASSERT_EQUAL_UINT32(PATCH_CHUNKS + lost, g_fetchTotal);
+}
+
+// A bitmap with holes (chunks persisted out of order) resumes into the holes
+static void test_resume_fills_holes() {
+    for (uint16_t i = 0; i < PATCH_CHUNKS; i += 3) otaBitmapMark(g_nvsBitmap, i);
+    otaBitmapMark(g_nvsBitmap, PATCH_CHUNKS - 1);
+    uint16_t have = killAndReload(PATCH_CHUNKS);
+    TEST_ASSERT_EQUAL_UINT32(PATCH_CHUNKS / 3 + 1, have);
+    TEST_ASSERT_EQUAL_UINT32(1, otaProgressNext(&g_progress, PATCH_CHUNKS));
+
+    uint8_t persisted[OTA_MAX_CHUNKS / 8];
+    memcpy(persisted, g_nvsBitmap, sizeof(persisted));
+    download(PATCH_CHUNKS, PATCH_CHUNKS, 1000);
+
+    assertRefetchedExactly(persisted, PATCH_CHUNKS);
+    TEST_ASSERT_EQUAL_UINT32(PATCH_CHUNKS - have, g_fetchTotal);
+}
+
+// On a slow link the time trigger checkpoints before the chunk count does
+static void test_time_checkpoint_on_slow_link() {
+    const uint32_t msPerChunk = 10000;
+    const uint16_t perCheckpoint = (OTA_CHECKPOINT_MS + msPerChunk - 1) / msPerChunk;
+    TEST_ASSERT_LESS_THAN_UINT32(OTA_CHECKPOINT_CHUNKS, perCheckpoint);
+
+    download(PATCH_CHUNKS, 3 * perCheckpoint + 2, msPerChunk);
+    TEST_ASSERT_EQUAL_UINT32(3, g_nvsWrites);
+    TEST_ASSERT_EQUAL_UINT32(2, g_progress.sinceCheckpoint);
+
+    killAndReload(PATCH_CHUNKS);
+    TEST_ASSERT_EQUAL_UINT32(3 * perCheckpoint, otaBitmapCount(g_progress.bitmap, PATCH_CHUNKS));
+
+    uint8_t persisted[OTA_MAX_CHUNKS / 8];
+    memcpy(persisted, g_nvsBitmap, sizeof(persisted));
+    download(PATCH_CHUNKS, PATCH_CHUNKS, msPerChunk);
+
+    assertRefetchedExactly(persisted, PATCH_CHUNKS);
+}
+
+// Bits past the patch in the persisted tail byte are dropped on resume:
+// not counted as held, and the download still completes
+static void test_resume_drops_stray_bits() {
+    g_nvsBitmap[otaBitmapBytes(PATCH_CHUNKS) - 1] = 0xF0;   // Chunks 300..303 of a 300-chunk patch
+    otaBitmapMark(g_nvsBitmap, 5);
+
+    uint16_t have = killAndReload(PATCH_CHUNKS);
+    TEST_ASSERT_EQUAL_UINT32(1, have);
+    TEST_ASSERT_EQUAL_UINT32(1, otaBitmapCount(g_progress.bitmap, OTA_MAX_CHUNKS));
+
+    download(PATCH_CHUNKS, PATCH_CHUNKS, 1000);
+    TEST_ASSERT_EQUAL_UINT32(PATCH_CHUNKS - 1, g_fetchTotal);
+    TEST_ASSERT_EQUAL_UINT32(PATCH_CHUNKS, otaProgressNext(&g_progress, PATCH_CHUNKS));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_bitmap_ops);
+    RUN_TEST(test_kill_between_checkpoints);
+    RUN_TEST(test_repeated_kills);
+    RUN_TEST(test_resume_fills_holes);
+    RUN_TEST(test_time_checkpoint_on_slow_link);
+    RUN_TEST(test_resume_drops_stray_bits);
+    return UNITY_END();
+}
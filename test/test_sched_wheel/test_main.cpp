@@ -0,0 +1,149 @@
+// Host tests for the loop task's timer wheel (pio test -e native)
+
+#include <unity.h>
+#include <string.h>
+
+#include "sched_wheel.h"
+
+// Fake clock in wheel ticks, advanced by the tests
+static uint32_t g_tick = 0;
+static inline uint32_t schedTickNow() { return g_tick; }
+
+#define TICKS_PER_S   (1000 / SCHED_TICK_MS)
+#define TICKS_PER_H   (3600UL * TICKS_PER_S)
+
+static SchedTimer g_periodic;
+static SchedTimer g_oneShot;
+static SchedTimer g_longShot;
+static uint32_t g_periodicFires = 0;
+static uint32_t g_oneShotTick = 0;
+static uint32_t g_longShotTick = 0;
+
+static void periodicFired() { g_periodicFires++; }
+static void oneShotFired() { g_oneShotTick = g_tick; }
+static void longShotFired() { g_longShotTick = g_tick; }
+
+// Sibling timers due on the same tick: the first stops the second
+static SchedTimer g_stopper;
+static SchedTimer g_stopped;
+static uint32_t g_stoppedFires = 0;
+static void stopperFired() { timerStop(&g_stopped); }
+static void stoppedFired() { g_stoppedFires++; }
+
+// Fresh wheel with the clock at start
+static void schedReset(uint32_t start) {
+    memset(g_schedWheel, 0, sizeof(g_schedWheel));
+    g_schedTimerCount = 0;
+    g_schedPending = nullptr;
+    g_tick = start;
+    g_schedNow = start;
+}
+
+static void runTicks(uint32_t ticks) {
+    for (uint32_t i = 0; i < ticks; i++) {
+        g_tick++;
+        schedRunTimers();
+    }
+}
+
+void setUp() {
+    memset(&g_periodic, 0, sizeof(g_periodic));
+    memset(&g_oneShot, 0, sizeof(g_oneShot));
+    memset(&g_longShot, 0, sizeof(g_longShot));
+    memset(&g_stopper, 0, sizeof(g_stopper));
+    memset(&g_stopped, 0, sizeof(g_stopped));
+    g_periodicFires = 0;
+    g_oneShotTick = 0;
+    g_longShotTick = 0;
+    g_stoppedFires = 0;
+}
+
+void tearDown() {}
+
+// 10 h of a 60 s periodic timer, starting 50 s before the tick counter wraps
+static void test_periodic_across_wrap() {
+    schedReset(0xFFFFFFFFu - 50 * TICKS_PER_S);
+    schedTimerInit(&g_periodic, "periodic", periodicFired);
+    timerStart(&g_periodic, 60000, 60000);
+
+    runTicks(10 * TICKS_PER_H);
+
+    TEST_ASSERT_EQUAL_UINT32(600, g_periodicFires);
+    TEST_ASSERT_EQUAL_UINT32(600, g_periodic.fired);
+    TEST_ASSERT_EQUAL_UINT32(0, g_periodic.missed);
+    TEST_ASSERT_EQUAL_UINT32(0, g_periodic.maxLateMs);
+    TEST_ASSERT_TRUE(g_periodic.active);
+}
+
+// One-shots due just after the wrap, and one parked beyond the wheel span
+static void test_one_shot_across_wrap() {
+    uint32_t start = 0xFFFFFFFFu - TICKS_PER_H;
+    schedReset(start);
+    schedTimerInit(&g_oneShot, "once", oneShotFired);
+    schedTimerInit(&g_longShot, "long", longShotFired);
+    timerStart(&g_oneShot, 3600UL * 1000 + 5000, 0);         // 5 s after the wrap
+    timerStart(&g_longShot, 3UL * 3600UL * 1000, 0);         // 3 h > 44 min span
+
+    runTicks(4 * TICKS_PER_H);
+
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(start + TICKS_PER_H + 5 * TICKS_PER_S), g_oneShotTick);
+    TEST_ASSERT_EQUAL_UINT32((uint32_t)(start + 3 * TICKS_PER_H), g_longShotTick);
+    TEST_ASSERT_EQUAL_UINT32(1, g_oneShot.fired);
+    TEST_ASSERT_EQUAL_UINT32(1, g_longShot.fired);
+    TEST_ASSERT_FALSE(g_oneShot.active);
+    TEST_ASSERT_FALSE(g_longShot.active);
+}
+
+// Sleep hint counts down to a deadline on the far side of the wrap
+static void test_idle_across_wrap() {
+    schedReset(0xFFFFFFFFu - 20);
+    schedTimerInit(&g_oneShot, "once", oneShotFired);
+    timerStart(&g_oneShot, 500, 0);
+
+    TEST_ASSERT_EQUAL_UINT32(500, schedIdleMs());
+    runTicks(30);
+    TEST_ASSERT_EQUAL_UINT32(200, schedIdleMs());
+    runTicks(20);
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFFu + 30, g_oneShotTick);
+    TEST_ASSERT_EQUAL_UINT32(SCHED_MAX_SLEEP_MS, schedIdleMs());
+}
+
+// A late dispatch (loop blocked behind an uplink) is measured in ticks
+static void test_lateness_across_wrap() {
+    schedReset(0xFFFFFFFFu - 10);
+    schedTimerInit(&g_periodic, "periodic", periodicFired);
+    timerStart(&g_periodic, 1000, 1000);
+
+    g_tick += 100 + 30;     // Deadline 100 ticks out, dispatched 300 ms late
+    schedRunTimers();
+
+    TEST_ASSERT_EQUAL_UINT32(1, g_periodicFires);
+    TEST_ASSERT_EQUAL_UINT32(300, g_periodic.maxLateMs);
+    TEST_ASSERT_EQUAL_UINT32(1, g_periodic.missed);
+    TEST_ASSERT_EQUAL_UINT32(0xFFFFFFFFu - 10 + 200, g_periodic.expires);
+}
+
+// A callback may stop a timer still waiting in the slot being expired
+static void test_stop_sibling_from_callback() {
+    schedReset(1000);
+    schedTimerInit(&g_stopper, "stopper", stopperFired);
+    schedTimerInit(&g_stopped, "stopped", stoppedFired);
+    timerStart(&g_stopped, 100, 0);
+    timerStart(&g_stopper, 100, 0);     // Filed ahead of g_stopped in the slot
+
+    runTicks(50);
+
+    TEST_ASSERT_EQUAL_UINT32(1, g_stopper.fired);
+    TEST_ASSERT_EQUAL_UINT32(0, g_stoppedFires);
+    TEST_ASSERT_FALSE(g_stopped.active);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_periodic_across_wrap);
+    RUN_TEST(test_one_shot_across_wrap);
+    RUN_TEST(test_idle_across_wrap);
+    RUN_TEST(test_lateness_across_wrap);
+    RUN_TEST(test_stop_sibling_from_callback);
+    return UNITY_END();
+}